@@ -0,0 +1,156 @@
+// Scaling benchmark for batch decoding, decodes a gallery of PNGs of mixed sizes on 1..N threads.
+// Built with -DIMAGEPLUS_BUILD_BENCHMARKS=ON, run as `ImagePlusBatchBench [images] [max size] [max threads]`.
+// Besides the work-stealing ThreadPool::parallelFor, it times a static split (every thread gets
+// a fixed slice of the batch) to show how much the stealing helps with uneven image sizes.
+
+#include "../src/ThreadPool.hpp"
+
+#include <spng.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using imgp::ThreadPool;
+
+struct Encoded {
+    std::vector<uint8_t> data;
+    size_t pixels = 0;
+};
+
+/// @brief Gradient with some noise, so it compresses about as well as real textures do
+static std::vector<uint8_t> makeImage(uint32_t width, uint32_t height, std::mt19937& rng) {
+    std::vector<uint8_t> data(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t* px = &data[(static_cast<size_t>(y) * width + x) * 4];
+            uint8_t noise = rng() & 15;
+            px[0] = static_cast<uint8_t>(x + noise);
+            px[1] = static_cast<uint8_t>(y + noise);
+            px[2] = static_cast<uint8_t>((x ^ y) + noise);
+            px[3] = 255 - noise;
+        }
+    }
+    return data;
+}
+
+static Encoded encodePng(uint32_t width, uint32_t height, std::mt19937& rng) {
+    auto pixels = makeImage(width, height, rng);
+
+    spng_ctx* ctx = spng_ctx_new(SPNG_CTX_ENCODER);
+    spng_set_option(ctx, SPNG_ENCODE_TO_BUFFER, 1);
+
+    spng_ihdr ihdr{};
+    ihdr.width = width;
+    ihdr.height = height;
+    ihdr.bit_depth = 8;
+    ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    spng_set_ihdr(ctx, &ihdr);
+
+    Encoded result;
+    result.pixels = pixels.size() / 4;
+    if (spng_encode_image(ctx, pixels.data(), pixels.size(), SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE) == 0) {
+        size_t size = 0;
+        int error = 0;
+        auto* buffer = static_cast<uint8_t*>(spng_get_png_buffer(ctx, &size, &error));
+        if (buffer) {
+            result.data.assign(buffer, buffer + size);
+            std::free(buffer);
+        }
+    }
+    spng_ctx_free(ctx);
+    return result;
+}
+
+/// @return Sum of the decoded bytes, to check that every run decoded the same thing
+static uint64_t decodePng(Encoded const& image) {
+    spng_ctx* ctx = spng_ctx_new(0);
+    spng_set_png_buffer(ctx, image.data.data(), image.data.size());
+
+    uint64_t checksum = 0;
+    size_t size = 0;
+    if (spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &size) == 0) {
+        std::vector<uint8_t> out(size);
+        if (spng_decode_image(ctx, out.data(), out.size(), SPNG_FMT_RGBA8, 0) == 0) {
+            for (size_t i = 0; i < out.size(); i += 61) checksum += out[i];
+        }
+    }
+    spng_ctx_free(ctx);
+    return checksum;
+}
+
+template <typename Fn>
+static double measure(Fn&& fn) {
+    // best of several runs, to keep the noise down
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 96;
+    uint32_t maxSize = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+    // galleries are mostly thumbnails with a few large images in between
+    std::mt19937 rng(1337);
+    std::vector<Encoded> images;
+    size_t totalPixels = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t size = rng() % 8 == 0 ? maxSize : std::max<uint32_t>(maxSize / 8, 16);
+        images.push_back(encodePng(size, size, rng));
+        totalPixels += images.back().pixels;
+    }
+
+    size_t hardware = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::thread::hardware_concurrency();
+    hardware = std::max<size_t>(hardware, 1);
+    std::printf("%zu images (%.1f MP total), %zu threads\n\n", count, totalPixels / 1e6, hardware);
+
+    std::vector<uint64_t> reference(count);
+    for (size_t i = 0; i < count; ++i) reference[i] = decodePng(images[i]);
+
+    auto& pool = ThreadPool::get();
+    std::vector<uint64_t> checksums(count);
+    bool ok = true;
+    double baseline = 0;
+
+    std::printf("%-8s %12s %10s %12s %12s\n", "threads", "stealing", "speedup", "static", "images/s");
+    for (size_t threads = 1; threads <= hardware; threads = threads < hardware ? std::min(threads * 2, hardware) : threads + 1) {
+        pool.setMaxThreads(threads);
+
+        double stealing = measure([&] {
+            pool.parallelFor(count, [&](size_t index, size_t) { checksums[index] = decodePng(images[index]); });
+        });
+        ok &= checksums == reference;
+
+        double split = measure([&] {
+            std::vector<ThreadPool::TaskPtr> tasks;
+            for (size_t t = 0; t < threads; ++t) {
+                tasks.push_back(pool.submit([&, t] {
+                    for (size_t i = count * t / threads; i < count * (t + 1) / threads; ++i) {
+                        checksums[i] = decodePng(images[i]);
+                    }
+                }));
+            }
+            for (auto& task : tasks) task->wait();
+        });
+        ok &= checksums == reference;
+
+        if (threads == 1) baseline = stealing;
+        std::printf(
+            "%-8zu %10.2fms %9.2fx %10.2fms %12.0f\n",
+            threads, stealing, baseline / stealing, split, count / stealing * 1000.0
+        );
+    }
+
+    if (!ok) std::printf("\nDecoded images don't match the single-threaded run\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,466 @@
+// Decode/encode benchmark for every format, built from src/formats without Geode (see IMAGEPLUS_HEADLESS).
+// Built with -DIMAGEPLUS_BUILD_BENCHMARKS=ON, run as `ImagePlusCodecBench [--corpus dir] [--filter text] [--min-time ms]`.
+// The reference corpus is generated from a fixed seed, so results stay comparable between releases:
+// small/medium/large static images and animations, in every format ImagePlus can decode.
+// Files from --corpus are benchmarked too (decode only). Results are printed as JSON.
+
+#include <api.hpp>
+#include "../src/BufferPool.hpp"
+#include "../src/ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include <sys/resource.h>
+#endif
+
+using namespace imgp;
+
+// == Allocation counting == //
+
+static std::atomic<uint64_t> s_allocations = 0;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+// the codecs allocate with malloc, so that's what gets counted (operator new ends up there too)
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+
+    void* malloc(size_t size) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+#else
+// without glibc only operator new can be replaced portably, so allocations inside the C codecs aren't counted
+void* operator new(size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, std::nothrow_t const& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+#endif
+
+// == Peak RSS == //
+
+/// @brief Resets the peak RSS, so every case reports its own peak (Linux only, elsewhere it's the process peak)
+static void resetPeakRss() {
+#ifdef __linux__
+    if (std::FILE* file = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+#endif
+}
+
+/// @return Peak resident memory in KiB
+static uint64_t peakRss() {
+#ifdef __linux__
+    if (std::FILE* file = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        uint64_t peak = 0;
+        while (std::fgets(line, sizeof(line), file)) {
+            if (std::sscanf(line, "VmHWM: %lu kB", &peak) == 1) break;
+        }
+        std::fclose(file);
+        return peak;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+#else
+    return 0;
+#endif
+}
+
+// == Reference corpus == //
+
+struct Pixels {
+    uint16_t width = 0, height = 0;
+    std::vector<std::vector<uint8_t>> frames; // RGBA
+    uint32_t delay = 50;
+
+    bool isAnimated() const { return frames.size() > 1; }
+
+    DecodedAnimation toAnimation() const {
+        DecodedAnimation anim;
+        anim.width = width;
+        anim.height = height;
+        anim.hasAlpha = true;
+        for (auto const& frame : frames) {
+            AnimationFrame out;
+            out.data = std::make_unique<uint8_t[]>(frame.size());
+            std::memcpy(out.data.get(), frame.data(), frame.size());
+            out.delay = delay;
+            anim.frames.push_back(std::move(out));
+        }
+        return anim;
+    }
+};
+
+/// @brief Noisy gradient background with a few flat shapes, moving with the frame index
+static Pixels makePixels(uint16_t width, uint16_t height, size_t frameCount, std::mt19937& rng) {
+    Pixels pixels{width, height};
+    std::vector<uint8_t> noise(static_cast<size_t>(width) * height);
+    for (auto& n : noise) n = rng() & 15;
+
+    for (size_t f = 0; f < frameCount; ++f) {
+        std::vector<uint8_t> data(static_cast<size_t>(width) * height * 4);
+        uint32_t boxX = static_cast<uint32_t>(f * width / std::max<size_t>(frameCount, 1));
+        uint32_t boxSize = std::max(width, height) / 4;
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                size_t i = static_cast<size_t>(y) * width + x;
+                uint8_t* px = &data[i * 4];
+                bool inBox = x >= boxX && x < boxX + boxSize && y >= height / 3 && y < height / 3 + boxSize;
+                if (inBox) {
+                    px[0] = 240; px[1] = 60; px[2] = 40; px[3] = 255;
+                } else {
+                    px[0] = static_cast<uint8_t>(x * 255 / width + noise[i]);
+                    px[1] = static_cast<uint8_t>(y * 255 / height + noise[i]);
+                    px[2] = static_cast<uint8_t>((x ^ y) + noise[i]);
+                    px[3] = x < width / 8 ? 128 : 255;
+                }
+            }
+        }
+        pixels.frames.push_back(std::move(data));
+    }
+    return pixels;
+}
+
+/// @brief Minimal GIF writer (ImagePlus can't encode GIFs), using a 6x6x6 color cube and uncompressed LZW codes
+static std::vector<uint8_t> writeGif(Pixels const& pixels) {
+    std::vector<uint8_t> out;
+    auto u8 = [&](uint8_t v) { out.push_back(v); };
+    auto u16 = [&](uint16_t v) { u8(v & 0xFF); u8(v >> 8); };
+    auto str = [&](char const* s) { out.insert(out.end(), s, s + std::strlen(s)); };
+
+    str("GIF89a");
+    u16(pixels.width);
+    u16(pixels.height);
+    u8(0xF7); // global color table with 256 entries
+    u8(0);
+    u8(0);
+    for (int i = 0; i < 256; ++i) {
+        int r = i < 216 ? i / 36 * 51 : (i - 216) * 6;
+        int g = i < 216 ? i / 6 % 6 * 51 : (i - 216) * 6;
+        int b = i < 216 ? i % 6 * 51 : (i - 216) * 6;
+        u8(r); u8(g); u8(b);
+    }
+
+    if (pixels.isAnimated()) {
+        u8(0x21); u8(0xFF); u8(11);
+        str("NETSCAPE2.0");
+        u8(3); u8(1); u16(0); u8(0);
+    }
+
+    for (auto const& frame : pixels.frames) {
+        // graphic control extension, with the delay in centiseconds
+        u8(0x21); u8(0xF9); u8(4);
+        u8(0x04);
+        u16(static_cast<uint16_t>(pixels.delay / 10));
+        u8(0); u8(0);
+
+        u8(0x2C);
+        u16(0); u16(0);
+        u16(pixels.width); u16(pixels.height);
+        u8(0);
+
+        // 9-bit codes only: a clear code before the table would grow, so every pixel is a literal
+        std::vector<uint8_t> codes;
+        uint32_t bits = 0, bitCount = 0;
+        auto put = [&](uint32_t code) {
+            bits |= code << bitCount;
+            bitCount += 9;
+            while (bitCount >= 8) {
+                codes.push_back(bits & 0xFF);
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        };
+
+        size_t count = static_cast<size_t>(pixels.width) * pixels.height;
+        for (size_t i = 0; i < count; ++i) {
+            if (i % 253 == 0) put(256);
+            uint8_t const* px = &frame[i * 4];
+            put(px[0] * 6 / 256 * 36 + px[1] * 6 / 256 * 6 + px[2] * 6 / 256);
+        }
+        put(257);
+        if (bitCount) codes.push_back(bits & 0xFF);
+
+        u8(8);
+        for (size_t i = 0; i < codes.size(); i += 255) {
+            size_t block = std::min<size_t>(255, codes.size() - i);
+            u8(static_cast<uint8_t>(block));
+            out.insert(out.end(), codes.begin() + i, codes.begin() + i + block);
+        }
+        u8(0);
+    }
+
+    u8(0x3B);
+    return out;
+}
+
+/// @brief Encodes the pixels as the given format, with the default settings
+/// @param anim The same pixels as an animation, if there's more than one frame
+static geode::Result<geode::ByteVector> encodeAs(ImageFormat format, Pixels const& pixels, DecodedAnimation const& anim) {
+    if (format == ImageFormat::Gif) return geode::Ok(writeGif(pixels));
+
+    if (pixels.isAnimated()) {
+        switch (format) {
+            case ImageFormat::Webp: return encode::webp(anim);
+            case ImageFormat::JpegXL: return encode::jpegxl(anim);
+            default: return geode::Err("Format doesn't support animations");
+        }
+    }
+
+    void const* data = pixels.frames[0].data();
+    switch (format) {
+        case ImageFormat::Png: return encode::png(data, pixels.width, pixels.height);
+        case ImageFormat::Qoi: return encode::qoi(data, pixels.width, pixels.height);
+        case ImageFormat::Webp: return encode::webp(data, pixels.width, pixels.height);
+        case ImageFormat::JpegXL: return encode::jpegxl(data, pixels.width, pixels.height);
+        default: return geode::Err("Unsupported format");
+    }
+}
+
+struct Case {
+    std::string name;
+    ImageFormat format = ImageFormat::Unknown;
+    Pixels pixels;                // empty for files from --corpus
+    DecodedAnimation anim;        // pixels as an animation, if there's more than one frame
+    std::vector<uint8_t> encoded;
+    uint16_t width = 0, height = 0;
+    size_t frames = 1;
+};
+
+static std::vector<Case> makeCorpus() {
+    struct Size {
+        char const* name;
+        uint16_t side;
+        size_t frames;
+    };
+    constexpr Size STATIC_SIZES[] = {{"small", 64, 1}, {"medium", 512, 1}, {"large", 2048, 1}};
+    constexpr Size ANIMATED_SIZES[] = {{"small", 64, 16}, {"medium", 256, 32}, {"large", 512, 48}};
+    constexpr ImageFormat STATIC_FORMATS[] = {ImageFormat::Png, ImageFormat::Qoi, ImageFormat::Webp, ImageFormat::JpegXL, ImageFormat::Gif};
+    constexpr ImageFormat ANIMATED_FORMATS[] = {ImageFormat::Webp, ImageFormat::JpegXL, ImageFormat::Gif};
+
+    std::mt19937 rng(1337);
+    std::vector<Case> corpus;
+    auto add = [&](Size const& size, bool animated, std::span<ImageFormat const> formats) {
+        Pixels pixels = makePixels(size.side, size.side, size.frames, rng);
+        for (auto format : formats) {
+            Case c;
+            if (animated) c.anim = pixels.toAnimation();
+
+            auto encoded = encodeAs(format, pixels, c.anim);
+            if (encoded.isErr()) {
+                std::fprintf(stderr, "Failed to create %s/%s: %s\n", format_as(format).data(), size.name, encoded.unwrapErr().c_str());
+                continue;
+            }
+
+            c.name = std::string(format_as(format)) + "/" + size.name + (animated ? "/animated" : "/static");
+            c.format = format;
+            c.pixels = pixels;
+            c.encoded = std::move(encoded).unwrap();
+            c.width = c.height = size.side;
+            c.frames = size.frames;
+            corpus.push_back(std::move(c));
+        }
+    };
+
+    for (auto const& size : STATIC_SIZES) add(size, false, STATIC_FORMATS);
+    for (auto const& size : ANIMATED_SIZES) add(size, true, ANIMATED_FORMATS);
+    return corpus;
+}
+
+static void addFiles(std::vector<Case>& corpus, std::filesystem::path const& dir) {
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file()) continue;
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        auto info = getImageInfo(data.data(), data.size());
+        if (info.isErr()) continue;
+
+        Case c;
+        c.name = "file/" + entry.path().filename().string();
+        c.format = info.unwrap().format;
+        c.encoded = std::move(data);
+        c.width = info.unwrap().width;
+        c.height = info.unwrap().height;
+        c.frames = std::max<uint32_t>(info.unwrap().frameCount, 1);
+        corpus.push_back(std::move(c));
+    }
+}
+
+// == Measurement == //
+
+struct Measurement {
+    size_t iterations = 0;
+    double median = 0; // milliseconds
+    double best = 0;
+    uint64_t allocations = 0; // per iteration
+    uint64_t peakRssKb = 0;
+    bool ok = true;
+};
+
+/// @brief Runs fn until min time passed (at least 3 times), fn returns false on failure
+static Measurement measure(std::function<bool()> const& fn, double minTimeMs) {
+    // warm up, so one-time setup (thread pool, codec tables) isn't measured
+    Measurement m;
+    m.ok = fn();
+
+    resetPeakRss();
+    uint64_t allocationsBefore = s_allocations.load();
+    std::vector<double> times;
+    double total = 0;
+    while (m.ok && (times.size() < 3 || total < minTimeMs)) {
+        auto start = std::chrono::steady_clock::now();
+        m.ok = fn();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        total += times.back();
+    }
+
+    m.iterations = times.size();
+    if (!times.empty()) {
+        m.allocations = (s_allocations.load() - allocationsBefore) / times.size();
+        std::sort(times.begin(), times.end());
+        m.median = times[times.size() / 2];
+        m.best = times.front();
+    }
+    m.peakRssKb = peakRss();
+    return m;
+}
+
+static std::string jsonEscape(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+static bool s_firstResult = true;
+
+static void printResult(Case const& c, char const* op, size_t bytes, Measurement const& m) {
+    double pixels = static_cast<double>(c.width) * c.height * c.frames;
+    double rawMb = pixels * 4 / 1e6;
+    std::printf(
+        "%s\n    {\"name\": \"%s\", \"op\": \"%s\", \"format\": \"%s\", \"width\": %u, \"height\": %u, \"frames\": %zu, "
+        "\"encoded_bytes\": %zu, \"ok\": %s, \"iterations\": %zu, \"median_ms\": %.3f, \"best_ms\": %.3f, "
+        "\"mb_per_s\": %.2f, \"ns_per_pixel\": %.2f, \"peak_rss_kb\": %llu, \"allocations\": %llu}",
+        s_firstResult ? "" : ",", jsonEscape(c.name).c_str(), op, format_as(c.format).data(), c.width, c.height, c.frames,
+        bytes, m.ok ? "true" : "false", m.iterations, m.median, m.best,
+        m.median > 0 ? rawMb / (m.median / 1000.0) : 0.0, pixels > 0 ? m.median * 1e6 / pixels : 0.0,
+        static_cast<unsigned long long>(m.peakRssKb), static_cast<unsigned long long>(m.allocations)
+    );
+    s_firstResult = false;
+}
+
+int main(int argc, char** argv) {
+    std::filesystem::path corpusDir;
+    std::string filter;
+    double minTimeMs = 200;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--corpus") corpusDir = argv[i + 1];
+        else if (arg == "--filter") filter = argv[i + 1];
+        else if (arg == "--min-time") minTimeMs = std::strtod(argv[i + 1], nullptr);
+    }
+
+    // same as the mod's default "buffer-pool-size", so allocation counts match the game
+    BufferPool::get().setMaxSize(16 << 20);
+
+    auto corpus = makeCorpus();
+    if (!corpusDir.empty()) addFiles(corpus, corpusDir);
+
+    std::printf("{\n  \"threads\": %zu,\n  \"results\": [", ThreadPool::get().getThreadCount());
+
+    bool ok = true;
+    for (auto const& c : corpus) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+
+        auto decode = measure([&] {
+            return tryDecode(c.encoded.data(), c.encoded.size(), c.format).isOk();
+        }, minTimeMs);
+        printResult(c, "decode", c.encoded.size(), decode);
+        ok &= decode.ok;
+
+        // GIFs can't be encoded, and files from --corpus have no source pixels
+        if (c.format == ImageFormat::Gif || c.pixels.frames.empty()) continue;
+
+        size_t encodedSize = 0;
+        auto encode = measure([&] {
+            auto res = encodeAs(c.format, c.pixels, c.anim);
+            encodedSize = res.isOk() ? res.unwrap().size() : 0;
+            return res.isOk();
+        }, minTimeMs);
+        printResult(c, "encode", encodedSize, encode);
+        ok &= encode.ok;
+
+        // the default is WebPAnimEncoder, this is the same animation through the parallel frame encoder
+        if (c.format == ImageFormat::Webp && c.pixels.isAnimated()) {
+            EncodeOptions options;
+            options.webp.parallelFrames = 1;
+
+            size_t parallelSize = 0;
+            auto parallel = measure([&] {
+                auto res = encode::webp(c.anim, options);
+                parallelSize = res.isOk() ? res.unwrap().size() : 0;
+                return res.isOk();
+            }, minTimeMs);
+            printResult(c, "encode-parallel", parallelSize, parallel);
+            ok &= parallel.ok;
+        }
+    }
+
+    std::printf("\n  ]\n}\n");
+    return ok ? 0 : 1;
+}
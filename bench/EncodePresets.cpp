@@ -0,0 +1,209 @@
+// Encode time vs output size for every EncodePreset, for PNG, WebP (lossy and lossless) and JPEG XL.
+// Built with -DIMAGEPLUS_BUILD_BENCHMARKS=ON, run as `ImagePlusEncodeBench [size]`.
+// The codecs are called directly with the same settings encode::makeConfig/makeFrameSettings
+// and png() pick for each preset (the mod sources need Geode), all on a single thread.
+
+#include <jxl/encode_cxx.h>
+#include <spng.h>
+#include <webp/encode.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+// Fastest, Fast, Balanced, Smallest, same as the tables in src/formats
+static constexpr char const* PRESETS[] = {"Fastest", "Fast", "Balanced", "Smallest"};
+static constexpr int PNG_LEVEL[] = {1, 3, -1, 9};
+static constexpr int WEBP_METHOD[] = {0, 2, 4, 6};
+static constexpr int WEBP_LOSSLESS_QUALITY[] = {25, 50, 70, 100};
+static constexpr int JXL_EFFORT[] = {1, 3, 7, 9};
+
+static constexpr float QUALITY = 75.f;
+
+struct Image {
+    char const* name;
+    uint32_t width, height;
+    std::vector<uint8_t> rgba;
+};
+
+/// @brief Gradient with some noise, close to a photo or a textured sprite
+static Image makeTexture(uint32_t size, std::mt19937& rng) {
+    Image image{"texture", size, size, std::vector<uint8_t>(static_cast<size_t>(size) * size * 4)};
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            uint8_t* px = &image.rgba[(static_cast<size_t>(y) * size + x) * 4];
+            uint8_t noise = rng() & 15;
+            px[0] = static_cast<uint8_t>(x + noise);
+            px[1] = static_cast<uint8_t>(y + noise);
+            px[2] = static_cast<uint8_t>((x ^ y) + noise);
+            px[3] = 255;
+        }
+    }
+    return image;
+}
+
+/// @brief Flat colored rectangles on a transparent background, like a UI screenshot or pixel art
+static Image makeFlat(uint32_t size, std::mt19937& rng) {
+    Image image{"flat", size, size, std::vector<uint8_t>(static_cast<size_t>(size) * size * 4)};
+    for (int i = 0; i < 24; ++i) {
+        uint32_t x0 = rng() % size, y0 = rng() % size;
+        uint32_t x1 = std::min(size, x0 + 16 + rng() % (size / 4));
+        uint32_t y1 = std::min(size, y0 + 16 + rng() % (size / 4));
+        uint32_t color = rng() | 0xFF000000;
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                uint8_t* px = &image.rgba[(static_cast<size_t>(y) * size + x) * 4];
+                px[0] = color & 0xFF;
+                px[1] = (color >> 8) & 0xFF;
+                px[2] = (color >> 16) & 0xFF;
+                px[3] = color >> 24;
+            }
+        }
+    }
+    return image;
+}
+
+static size_t encodePng(Image const& image, int preset) {
+    spng_ctx* ctx = spng_ctx_new(SPNG_CTX_ENCODER);
+    spng_set_option(ctx, SPNG_ENCODE_TO_BUFFER, 1);
+    if (PNG_LEVEL[preset] >= 0) spng_set_option(ctx, SPNG_IMG_COMPRESSION_LEVEL, PNG_LEVEL[preset]);
+
+    spng_ihdr ihdr{};
+    ihdr.width = image.width;
+    ihdr.height = image.height;
+    ihdr.bit_depth = 8;
+    ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    spng_set_ihdr(ctx, &ihdr);
+
+    size_t size = 0;
+    if (spng_encode_image(ctx, image.rgba.data(), image.rgba.size(), SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE) == 0) {
+        int error = 0;
+        void* buffer = spng_get_png_buffer(ctx, &size, &error);
+        std::free(buffer);
+    }
+    spng_ctx_free(ctx);
+    return size;
+}
+
+static size_t encodeWebp(Image const& image, int preset, bool lossless) {
+    WebPConfig config;
+    WebPConfigInit(&config);
+    config.lossless = lossless;
+    config.method = WEBP_METHOD[preset];
+    config.quality = lossless ? WEBP_LOSSLESS_QUALITY[preset] : QUALITY;
+
+    WebPPicture picture;
+    WebPPictureInit(&picture);
+    picture.use_argb = lossless;
+    picture.width = static_cast<int>(image.width);
+    picture.height = static_cast<int>(image.height);
+
+    WebPMemoryWriter writer;
+    WebPMemoryWriterInit(&writer);
+    picture.writer = WebPMemoryWrite;
+    picture.custom_ptr = &writer;
+
+    size_t size = 0;
+    if (WebPPictureImportRGBA(&picture, image.rgba.data(), static_cast<int>(image.width * 4)) && WebPEncode(&config, &picture)) {
+        size = writer.size;
+    }
+    WebPPictureFree(&picture);
+    WebPMemoryWriterClear(&writer);
+    return size;
+}
+
+static size_t encodeJpegXL(Image const& image, int preset) {
+    auto encoder = JxlEncoderMake(nullptr);
+
+    JxlBasicInfo info;
+    JxlEncoderInitBasicInfo(&info);
+    info.xsize = image.width;
+    info.ysize = image.height;
+    info.bits_per_sample = 8;
+    info.num_color_channels = 3;
+    info.num_extra_channels = 1;
+    info.alpha_bits = 8;
+    JxlEncoderSetBasicInfo(encoder.get(), &info);
+
+    JxlColorEncoding color;
+    JxlColorEncodingSetToSRGB(&color, JXL_FALSE);
+    JxlEncoderSetColorEncoding(encoder.get(), &color);
+
+    auto* settings = JxlEncoderFrameSettingsCreate(encoder.get(), nullptr);
+    JxlEncoderSetFrameDistance(settings, JxlEncoderDistanceFromQuality(QUALITY));
+    JxlEncoderFrameSettingsSetOption(settings, JXL_ENC_FRAME_SETTING_EFFORT, JXL_EFFORT[preset]);
+
+    JxlPixelFormat format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+    if (JxlEncoderAddImageFrame(settings, &format, image.rgba.data(), image.rgba.size()) != JXL_ENC_SUCCESS)
+        return 0;
+    JxlEncoderCloseInput(encoder.get());
+
+    std::vector<uint8_t> out(64 * 1024);
+    uint8_t* next = out.data();
+    size_t avail = out.size();
+    JxlEncoderStatus status;
+    while ((status = JxlEncoderProcessOutput(encoder.get(), &next, &avail)) == JXL_ENC_NEED_MORE_OUTPUT) {
+        size_t offset = next - out.data();
+        out.resize(out.size() * 2);
+        next = out.data() + offset;
+        avail = out.size() - offset;
+    }
+    return status == JXL_ENC_SUCCESS ? static_cast<size_t>(next - out.data()) : 0;
+}
+
+/// @return Best time out of a few runs in milliseconds, and the encoded size
+static std::pair<double, size_t> measure(std::function<size_t()> const& fn) {
+    double best = 1e30;
+    size_t size = 0;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        size = fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return {best, size};
+}
+
+int main(int argc, char** argv) {
+    uint32_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 512;
+    size = std::max<uint32_t>(size, 64);
+
+    std::mt19937 rng(1337);
+    Image images[] = {makeTexture(size, rng), makeFlat(size, rng)};
+
+    struct Codec {
+        char const* name;
+        std::function<size_t(Image const&, int)> encode;
+    };
+    Codec codecs[] = {
+        {"png", encodePng},
+        {"webp", [](Image const& image, int preset) { return encodeWebp(image, preset, false); }},
+        {"webp-lossless", [](Image const& image, int preset) { return encodeWebp(image, preset, true); }},
+        {"jxl", encodeJpegXL},
+    };
+
+    bool ok = true;
+    for (auto const& image : images) {
+        size_t raw = image.rgba.size();
+        std::printf("%s %ux%u (%zu KiB raw)\n", image.name, image.width, image.height, raw / 1024);
+        std::printf("%-14s %-9s %10s %10s %8s\n", "format", "preset", "time", "size", "ratio");
+        for (auto const& codec : codecs) {
+            for (int preset = 0; preset < 4; ++preset) {
+                auto [time, bytes] = measure([&] { return codec.encode(image, preset); });
+                ok &= bytes != 0;
+                std::printf(
+                    "%-14s %-9s %8.2fms %8zuKiB %7.2fx\n",
+                    codec.name, PRESETS[preset], time, bytes / 1024, bytes ? static_cast<double>(raw) / bytes : 0.0
+                );
+            }
+        }
+        std::printf("\n");
+    }
+
+    if (!ok) std::printf("Some encodes failed\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// Microbenchmark for the pixel kernels, also checks every SIMD path against the scalar one.
+// Built with -DIMAGEPLUS_BUILD_BENCHMARKS=ON, run as `ImagePlusKernelBench [width] [height]`.
+
+#include "../src/PixelKernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace imgp::pixels;
+
+static std::vector<uint8_t> makeImage(size_t pixels, bool opaque) {
+    std::mt19937 rng(1337);
+    std::vector<uint8_t> data(pixels * 4);
+    for (auto& byte : data) byte = static_cast<uint8_t>(rng());
+    if (opaque) {
+        for (size_t i = 0; i < pixels; ++i) data[i * 4 + 3] = 255;
+    }
+    return data;
+}
+
+/// @brief Every (channel, alpha) combination, with a few odd pixels at the end to hit the scalar tail
+static std::vector<uint8_t> makeExhaustive() {
+    std::vector<uint8_t> data;
+    for (int a = 0; a < 256; ++a) {
+        for (int c = 0; c < 256; ++c) {
+            data.insert(data.end(), { uint8_t(c), uint8_t(255 - c), uint8_t(c / 2), uint8_t(a) });
+        }
+    }
+    data.insert(data.end(), { 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120 });
+    return data;
+}
+
+static bool verify(Kernels const& kernels) {
+    auto const& ref = getScalarKernels();
+    bool ok = true;
+    auto check = [&](char const* what, std::vector<uint8_t> const& a, std::vector<uint8_t> const& b) {
+        if (a != b) {
+            std::printf("  %s: %s does not match scalar\n", kernels.name, what);
+            ok = false;
+        }
+    };
+
+    auto input = makeExhaustive();
+    size_t count = input.size() / 4;
+
+    auto expected = input, actual = input;
+    ref.premultiply(expected.data(), count);
+    kernels.premultiply(actual.data(), count);
+    check("premultiply", expected, actual);
+
+    expected = input, actual = input;
+    ref.unpremultiply(expected.data(), count);
+    kernels.unpremultiply(actual.data(), count);
+    check("unpremultiply", expected, actual);
+
+    expected.assign(input.size(), 0), actual.assign(input.size(), 0);
+    ref.swapRedBlue(input.data(), expected.data(), count);
+    kernels.swapRedBlue(input.data(), actual.data(), count);
+    check("swapRedBlue", expected, actual);
+
+    size_t rgbCount = input.size() / 3;
+    expected.assign(rgbCount * 4, 0), actual.assign(rgbCount * 4, 0);
+    ref.rgbToRgba(input.data(), expected.data(), rgbCount);
+    kernels.rgbToRgba(input.data(), actual.data(), rgbCount);
+    check("rgbToRgba", expected, actual);
+
+    auto opaque = makeImage(1027, true);
+    for (size_t hole : { size_t(0), size_t(517), size_t(1026) }) {
+        auto copy = opaque;
+        copy[hole * 4 + 3] = 254;
+        if (kernels.isOpaque(copy.data(), 1027)) {
+            std::printf("  %s: isOpaque missed a translucent pixel at %zu\n", kernels.name, hole);
+            ok = false;
+        }
+    }
+    if (!kernels.isOpaque(opaque.data(), 1027)) {
+        std::printf("  %s: isOpaque rejected an opaque image\n", kernels.name);
+        ok = false;
+    }
+
+    // every (dst, src, alpha) combination, one alpha value at a time
+    std::vector<uint8_t> src(256 * 256 * 4 + 12), dst(src.size());
+    for (int a = 0; a < 256 && ok; ++a) {
+        for (int d = 0; d < 256; ++d) {
+            for (int s = 0; s < 256; ++s) {
+                size_t i = (d * 256 + s) * 4;
+                dst[i] = uint8_t(d), dst[i + 1] = uint8_t(s), dst[i + 2] = uint8_t(d ^ s), dst[i + 3] = uint8_t(s);
+                src[i] = uint8_t(s), src[i + 1] = uint8_t(d), src[i + 2] = uint8_t(s ^ 0x55), src[i + 3] = uint8_t(a);
+            }
+        }
+
+        count = src.size() / 4;
+        expected = dst, actual = dst;
+        ref.blendAlpha(expected.data(), src.data(), count);
+        kernels.blendAlpha(actual.data(), src.data(), count);
+        check("blendAlpha", expected, actual);
+    }
+
+    return ok;
+}
+
+template <typename Fn>
+static double measure(Fn&& fn) {
+    // best of several runs, to keep the noise down
+    double best = 1e30;
+    for (int run = 0; run < 15; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t width = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2048;
+    size_t height = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2048;
+    size_t count = width * height;
+
+    auto kernels = getAvailableKernels();
+    std::printf("Using %s, %zux%zu image\n\n", getKernels().name, width, height);
+
+    bool ok = true;
+    for (auto kernel : kernels) ok &= verify(*kernel);
+
+    auto input = makeImage(count, false);
+    auto opaque = makeImage(count, true);
+    std::vector<uint8_t> work(count * 4), output(count * 4);
+
+    // animation frames are mostly opaque, with translucent edges
+    auto frame = makeImage(count, false);
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t& alpha = frame[i * 4 + 3];
+        alpha = alpha < 64 ? 0 : alpha > 160 ? 255 : alpha;
+    }
+
+    std::printf(
+        "%-8s %12s %12s %12s %12s %12s %12s\n",
+        "kernel", "premul", "unpremul", "rgb->rgba", "swap r/b", "opaque", "blend"
+    );
+    for (auto kernel : kernels) {
+        double premul = measure([&] {
+            std::memcpy(work.data(), input.data(), work.size());
+            kernel->premultiply(work.data(), count);
+        });
+        double unpremul = measure([&] {
+            std::memcpy(work.data(), input.data(), work.size());
+            kernel->unpremultiply(work.data(), count);
+        });
+        double copy = measure([&] { std::memcpy(work.data(), input.data(), work.size()); });
+        double expand = measure([&] { kernel->rgbToRgba(input.data(), output.data(), count); });
+        double swap = measure([&] { kernel->swapRedBlue(input.data(), output.data(), count); });
+        double scan = measure([&] { ok &= kernel->isOpaque(opaque.data(), count); });
+        double blend = measure([&] {
+            std::memcpy(work.data(), input.data(), work.size());
+            kernel->blendAlpha(work.data(), frame.data(), count);
+        });
+
+        std::printf(
+            "%-8s %10.3fms %10.3fms %10.3fms %10.3fms %10.3fms %10.3fms\n",
+            kernel->name, premul - copy, unpremul - copy, expand, swap, scan, blend - copy
+        );
+    }
+
+    return ok ? 0 : 1;
+}
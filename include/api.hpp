@@ -3,13 +3,22 @@
 #define IMAGE_PLUS_API_HPP
 
 #include <Geode/Result.hpp>
+#ifndef IMAGEPLUS_HEADLESS
 #include <Geode/platform/cplatform.h>
 #include <Geode/utils/general.hpp>
+#endif
 #include "types.hpp"
 
 #include <cstddef>
+#include <span>
 
-#ifdef GEODE_IS_WINDOWS
+#ifdef IMAGEPLUS_HEADLESS
+    // codecs built without Geode or the game (see IMAGEPLUS_HEADLESS in CMakeLists.txt)
+    namespace geode {
+        using ByteVector = std::vector<uint8_t>;
+    }
+    #define IMAGE_PLUS_DLL
+#elif defined(GEODE_IS_WINDOWS)
     #ifdef IMAGE_PLUS_EXPORTING
         #define IMAGE_PLUS_DLL __declspec(dllexport)
     #else
@@ -106,6 +115,20 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         /// @return Result containing the decoded image or an error message
         geode::Result<DecodedImage> IMAGE_PLUS_DLL qoi(void const* data, size_t size);
 
+        /// @brief Decodes a QOI header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        geode::Result<DecodedImage> IMAGE_PLUS_DLL qoiHeader(void const* data, size_t size);
+
+        /// @brief Decodes a QOI image into the given buffer, returning an error if the buffer is too small or if decoding fails
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @return Result containing the size of the decoded image data or an error message
+        geode::Result<size_t> IMAGE_PLUS_DLL qoiInto(void const* data, size_t size, void* buf, size_t bufSize);
+
     #if defined(GEODE_IS_IOS) || defined(GEODE_IS_MACOS)\
         /// @brief Decodes a CgBI image (Apple's PNG variant) and returns the decoded image data
         /// @note User is responsible for freeing the image data
@@ -124,6 +147,23 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         /// @return Result containing the decoded image or an error message
         geode::Result<DecodedResult> IMAGE_PLUS_DLL jpegxl(void const* data, size_t size);
 
+        /// @brief Decodes a JPEG XL header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        geode::Result<DecodedResult> IMAGE_PLUS_DLL jpegxlHeader(void const* data, size_t size);
+
+        /// @brief Decodes a single JPEG XL frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by jpegxl(), use jpegxlHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        geode::Result<size_t> IMAGE_PLUS_DLL jpegxlInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame = 0);
+
         /// @brief Decodes a WEBP image and returns either a single frame or an animation
         /// @note User is responsible for freeing the image data (if single frame)
         /// @param data Pointer to the image data
@@ -137,12 +177,40 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         /// @return Result containing the decoded metadata or an error message
         geode::Result<DecodedResult> IMAGE_PLUS_DLL webpHeader(void const* data, size_t size);
 
+        /// @brief Decodes a single WEBP frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by webp(), use webpHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        geode::Result<size_t> IMAGE_PLUS_DLL webpInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame = 0);
+
         /// @brief Decodes a GIF image and returns either a single frame or an animation
         /// @note User is responsible for freeing the image data (if single frame)
         /// @param data Pointer to the image data
         /// @param size Size of the image data
         /// @return Result containing the decoded image or an error message
         geode::Result<DecodedResult> IMAGE_PLUS_DLL gif(void const* data, size_t size);
+
+        /// @brief Decodes a GIF header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        geode::Result<DecodedResult> IMAGE_PLUS_DLL gifHeader(void const* data, size_t size);
+
+        /// @brief Decodes a single GIF frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by gif(), use gifHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        geode::Result<size_t> IMAGE_PLUS_DLL gifInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame = 0);
     }
 
     namespace encode {
@@ -199,6 +267,87 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         /// @param quality The quality of the encoding (default is 75.f)
         /// @return Result containing the encoded animation data or an error message
         geode::Result<geode::ByteVector> IMAGE_PLUS_DLL jpegxl(DecodedAnimation const& anim, float quality = 75.f);
+
+        // == Encoding with options, see EncodeOptions for the presets and per-format settings == //
+
+        /// @brief Encodes a PNG image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset and compression level (quality and lossless are ignored)
+        /// @return Result containing the encoded image data or an error message
+        geode::Result<geode::ByteVector> IMAGE_PLUS_DLL png(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options
+        );
+
+        /// @brief Encodes a WEBP image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset, quality and WebP settings
+        /// @return Result containing the encoded image data or an error message
+        geode::Result<geode::ByteVector> IMAGE_PLUS_DLL webp(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options
+        );
+
+        /// @brief Encodes a JPEG XL image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset, quality and JPEG XL effort
+        /// @return Result containing the encoded image data or an error message
+        geode::Result<geode::ByteVector> IMAGE_PLUS_DLL jpegxl(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options
+        );
+
+        /// @brief Encodes a WEBP animation from a DecodedAnimation
+        /// @param anim The animation to encode
+        /// @param options Preset, quality and WebP settings
+        /// @return Result containing the encoded animation data or an error message
+        geode::Result<geode::ByteVector> IMAGE_PLUS_DLL webp(DecodedAnimation const& anim, EncodeOptions const& options);
+
+        /// @brief Encodes a JPEG XL animation from a DecodedAnimation
+        /// @param anim The animation to encode
+        /// @param options Preset, quality and JPEG XL effort
+        /// @return Result containing the encoded animation data or an error message
+        geode::Result<geode::ByteVector> IMAGE_PLUS_DLL jpegxl(DecodedAnimation const& anim, EncodeOptions const& options);
+
+        // == Encoding into an OutputSink, the data is written as the encoder produces it == //
+        // These return the total size of the encoded data. With OutputSink::buffer, a size bigger than
+        // the buffer means it was too small, and the encode has to be repeated with a buffer of that size
+
+        /// @brief Encodes a PNG image from raw pixel data into the sink, written as it's compressed
+        geode::Result<size_t> IMAGE_PLUS_DLL pngTo(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+        );
+
+        /// @brief Encodes a QOI image from raw pixel data into the sink
+        /// @note The encoded image is still built in memory first and then written in one piece
+        geode::Result<size_t> IMAGE_PLUS_DLL qoiTo(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, OutputSink const& sink
+        );
+
+        /// @brief Encodes a WEBP image from raw pixel data into the sink, written as it's encoded
+        geode::Result<size_t> IMAGE_PLUS_DLL webpTo(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+        );
+
+        /// @brief Encodes a JPEG XL image from raw pixel data into the sink, written in chunks
+        /// @note The encoder still holds the whole file internally, this only avoids copying it into a ByteVector
+        geode::Result<size_t> IMAGE_PLUS_DLL jpegxlTo(
+            void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+        );
+
+        /// @brief Encodes a WEBP animation into the sink
+        /// @note The animation is still assembled in memory first and then written in one piece
+        geode::Result<size_t> IMAGE_PLUS_DLL webpTo(DecodedAnimation const& anim, EncodeOptions const& options, OutputSink const& sink);
+
+        /// @brief Encodes a JPEG XL animation into the sink, written in chunks
+        /// @note The encoder still holds the whole file internally, this only avoids copying it into a ByteVector
+        geode::Result<size_t> IMAGE_PLUS_DLL jpegxlTo(DecodedAnimation const& anim, EncodeOptions const& options, OutputSink const& sink);
     }
 
     /// @brief Attempts to guess the image format based on the header data
@@ -216,6 +365,64 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         void const* data, size_t size, ImageFormat format = ImageFormat::Unknown
     );
 
+    /// @brief Decodes a batch of images on the thread pool (see setMaxThreads)
+    /// @param images Encoded images with optional format hints
+    /// @return Results in the same order as the images
+    std::vector<geode::Result<DecodedResult>> IMAGE_PLUS_DLL tryDecodeBatch(std::span<EncodedImage const> images);
+
+    /// @brief Decodes a batch of images on the thread pool (see setMaxThreads), passing each result to the callback
+    /// as soon as it's ready. Returns once every image was handled
+    /// @note The callback is called from the decoding threads in completion order, but never for two images at once
+    /// @param images Encoded images with optional format hints
+    /// @param callback Receives the index of the image and its result
+    void IMAGE_PLUS_DLL tryDecodeBatch(std::span<EncodedImage const> images, BatchCallback const& callback);
+
+    /// @brief Reads image metadata (dimensions, frame count, duration, etc.) without decoding any pixels
+    /// @param data Pointer to the image data
+    /// @param size Size of the image data
+    /// @param format The format of the image data, defaults to ImageFormat::Unknown (auto-detect)
+    /// @return Result containing the image metadata or an error message
+    geode::Result<ImageInfo> IMAGE_PLUS_DLL getImageInfo(
+        void const* data, size_t size, ImageFormat format = ImageFormat::Unknown
+    );
+
+    /// @brief Decodes an image (or a single animation frame) into a buffer from the given allocator
+    /// @note Pixel layout is the same as the one returned by tryDecode
+    /// @param data Pointer to the image data
+    /// @param size Size of the image data
+    /// @param allocator Allocator for the pixel buffer, the caller releases the buffer with it
+    /// @param format The format of the image data, defaults to ImageFormat::Unknown (auto-detect)
+    /// @param frame Index of the animation frame to decode, composited with the frames before it
+    /// @return Result containing the decoded image or an error message
+    geode::Result<AllocatedImage> IMAGE_PLUS_DLL tryDecodeWith(
+        void const* data, size_t size, PixelAllocator const& allocator,
+        ImageFormat format = ImageFormat::Unknown, size_t frame = 0
+    );
+
+    /// @brief Sets the allocator for pixel buffers that ImagePlus owns itself (decoded animation frames,
+    /// frame history, etc). Buffers keep a copy of the allocator they came from, so it can be changed at any time.
+    /// @note DecodedImage and AnimationFrame buffers are released with delete[], so they never come from this allocator,
+    /// use tryDecodeWith to decode into your own memory instead
+    /// @param allocator Allocator to use, or an empty one to restore the default (operator new[])
+    void IMAGE_PLUS_DLL setPixelAllocator(PixelAllocator const& allocator);
+
+    /// @brief Limits the number of threads shared by all codecs (animation frames, JPEG XL, WebP encoding, batches)
+    /// @note Overrides the "Codec Threads" setting until the user changes it
+    /// @param count Maximum number of threads, including the calling one. 0 picks it based on the CPU (default)
+    void IMAGE_PLUS_DLL setMaxThreads(size_t count);
+
+    /// @brief Returns the thread limit set with setMaxThreads, or 0 if it's picked automatically
+    size_t IMAGE_PLUS_DLL getMaxThreads();
+
+    /// @brief Returns the counters of the format since the game started (or since resetCodecStats).
+    /// Decodes are counted in tryDecode, tryDecodeWith and when the game loads an image, encodes in every encoder
+    /// @note Cache hits are not decodes, see the "Log Codec Stats" setting for the cache counters
+    FormatStats IMAGE_PLUS_DLL getCodecStats(ImageFormat format);
+
+    /// @brief Resets the counters of every format
+    void IMAGE_PLUS_DLL resetCodecStats();
+
+#ifndef IMAGEPLUS_HEADLESS
     /// @brief Thin wrapper for calling extension functions on animated sprites
     /// @note AnimatedSprite is not actually used, so typeinfo_cast will never show it.
     /// To check if a CCSprite supports animations, use `isAnimated()` method.
@@ -271,6 +478,7 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         /// @brief Gets the total number of frames in the animation
         size_t getFrameCount();
     };
+#endif
 
 IMAGE_PLUS_END_NAMESPACE
 
@@ -4,6 +4,7 @@
 #define IMAGE_PLUS_USE_EVENTS
 
 #include <cstddef>
+#include <span>
 #include <Geode/Result.hpp>
 #include <Geode/loader/Event.hpp>
 
@@ -20,11 +21,17 @@ namespace imgp {
             using DecodeFunc1Into = geode::Result<size_t> (*)(void const*, size_t, void*, size_t);
             using DecodeFunc2 = geode::Result<DecodedResult> (*)(void const*, size_t);
             using DecodeFunc2Hdr = geode::Result<DecodedResult> (*)(void const*, size_t);
+            using DecodeFunc2Into = geode::Result<size_t> (*)(void const*, size_t, void*, size_t, size_t);
             using DecodeFunc3 = geode::Result<DecodedResult> (*)(void const*, size_t, ImageFormat);
             using EncodeFunc1 = geode::Result<geode::ByteVector> (*)(void const*, uint16_t, uint16_t, bool);
             using EncodeFunc2 = geode::Result<geode::ByteVector> (*)(void const*, uint16_t, uint16_t, bool, float);
             using EncodeFunc3 = geode::Result<geode::ByteVector> (*)(DecodedAnimation const&, float);
             using EncodeFunc4 = geode::Result<geode::ByteVector> (*)(DecodedAnimation const&);
+            using EncodeFunc5 = geode::Result<geode::ByteVector> (*)(void const*, uint16_t, uint16_t, bool, EncodeOptions const&);
+            using EncodeFunc6 = geode::Result<geode::ByteVector> (*)(DecodedAnimation const&, EncodeOptions const&);
+            using EncodeToFunc1 = geode::Result<size_t> (*)(void const*, uint16_t, uint16_t, bool, OutputSink const&);
+            using EncodeToFunc2 = geode::Result<size_t> (*)(void const*, uint16_t, uint16_t, bool, EncodeOptions const&, OutputSink const&);
+            using EncodeToFunc3 = geode::Result<size_t> (*)(DecodedAnimation const&, EncodeOptions const&, OutputSink const&);
             using AnimatedSpriteBoolRet = bool (cocos2d::CCSprite::*)();
             using AnimatedSpriteVoidRet = void (cocos2d::CCSprite::*)();
             using AnimatedSpriteSetPlaybackSpeed = void (cocos2d::CCSprite::*)(float);
@@ -34,9 +41,17 @@ namespace imgp {
             using AnimatedSpriteGetCurrentFrame = uint32_t (cocos2d::CCSprite::*)();
             using AnimatedSpriteSetCurrentFrame = void (cocos2d::CCSprite::*)(uint32_t);
             using AnimatedSpriteGetFrameCount = size_t (cocos2d::CCSprite::*)();
+            using SetMaxThreads = void (*)(size_t);
+            using GetMaxThreads = size_t (*)();
+            using GetImageInfo = geode::Result<ImageInfo> (*)(void const*, size_t, ImageFormat);
+            using TryDecodeWith = geode::Result<AllocatedImage> (*)(void const*, size_t, PixelAllocator const&, ImageFormat, size_t);
+            using SetPixelAllocator = void (*)(PixelAllocator const&);
+            using TryDecodeBatch = void (*)(std::span<EncodedImage const>, BatchCallback const&);
+            using GetCodecStats = FormatStats (*)(ImageFormat);
+            using ResetCodecStats = void (*)();
 
             // For adding new functions and checking version compatibility
-            size_t version = 2;
+            size_t version = 10;
 
             // == Guessing Format == //
             GuessFormat guessFormat = nullptr;
@@ -99,6 +114,60 @@ namespace imgp {
             // == Static Image Decoding (into a user-provided buffer) == //
             DecodeFunc1Into decodePngInto = nullptr;
             DecodeFunc1Into decodeQoiInto = nullptr;
+
+            // Version 3 additions:
+
+            // == Threading == //
+            SetMaxThreads setMaxThreads = nullptr;
+            GetMaxThreads getMaxThreads = nullptr;
+
+            // Version 4 additions:
+
+            // == Metadata == //
+            GetImageInfo getImageInfo = nullptr;
+
+            // Version 5 additions:
+
+            // == Animated Image Decoding (into a user-provided buffer) == //
+            DecodeFunc2Into decodeJpegXLInto = nullptr;
+            DecodeFunc2Into decodeWebpInto = nullptr;
+            DecodeFunc2Into decodeGifInto = nullptr;
+
+            // Version 6 additions:
+
+            // == Memory == //
+            TryDecodeWith tryDecodeWith = nullptr;
+            SetPixelAllocator setPixelAllocator = nullptr;
+
+            // Version 7 additions:
+
+            // == Batch Decoding == //
+            TryDecodeBatch tryDecodeBatch = nullptr;
+
+            // Version 8 additions:
+
+            // == Encoding with options == //
+            EncodeFunc5 encodePngWith = nullptr;
+            EncodeFunc5 encodeWebpWith = nullptr;
+            EncodeFunc5 encodeJpegXLWith = nullptr;
+            EncodeFunc6 encodeWebpAnimWith = nullptr;
+            EncodeFunc6 encodeJpegXLAnimWith = nullptr;
+
+            // Version 9 additions:
+
+            // == Encoding into an OutputSink == //
+            EncodeToFunc2 encodePngTo = nullptr;
+            EncodeToFunc1 encodeQoiTo = nullptr;
+            EncodeToFunc2 encodeWebpTo = nullptr;
+            EncodeToFunc2 encodeJpegXLTo = nullptr;
+            EncodeToFunc3 encodeWebpAnimTo = nullptr;
+            EncodeToFunc3 encodeJpegXLAnimTo = nullptr;
+
+            // Version 10 additions:
+
+            // == Statistics == //
+            GetCodecStats getCodecStats = nullptr;
+            ResetCodecStats resetCodecStats = nullptr;
         };
 
         struct FetchTableEvent : geode::Event<FetchTableEvent, bool(FunctionTable const*&)> {
@@ -143,6 +212,122 @@ namespace imgp {
         return table->tryDecode(data, size, format);
     }
 
+    /// @brief Decodes a batch of images on the thread pool (see setMaxThreads), passing each result to the callback
+    /// as soon as it's ready. Returns once every image was handled
+    /// @note The callback is called from the decoding threads in completion order, but never for two images at once
+    /// @param images Encoded images with optional format hints
+    /// @param callback Receives the index of the image and its result
+    inline void tryDecodeBatch(std::span<EncodedImage const> images, BatchCallback const& callback) {
+        auto table = __detail::getFunctionTable();
+        if (table && table->version >= 7 && table->tryDecodeBatch)
+            return table->tryDecodeBatch(images, callback);
+
+        // older versions only have the single image function, so decode them one by one
+        for (size_t i = 0; i < images.size(); ++i) {
+            callback(i, tryDecode(images[i].data, images[i].size, images[i].format));
+        }
+    }
+
+    /// @brief Decodes a batch of images on the thread pool (see setMaxThreads)
+    /// @param images Encoded images with optional format hints
+    /// @return Results in the same order as the images
+    inline std::vector<geode::Result<DecodedResult>> tryDecodeBatch(std::span<EncodedImage const> images) {
+        std::vector<std::optional<geode::Result<DecodedResult>>> slots(images.size());
+        tryDecodeBatch(images, [&](size_t index, geode::Result<DecodedResult> result) {
+            slots[index] = std::move(result);
+        });
+
+        std::vector<geode::Result<DecodedResult>> results;
+        results.reserve(slots.size());
+        for (auto& slot : slots) {
+            results.push_back(std::move(*slot));
+        }
+        return results;
+    }
+
+    /// @brief Reads image metadata (dimensions, frame count, duration, etc.) without decoding any pixels
+    /// @param data Pointer to the image data
+    /// @param size Size of the image data
+    /// @param format The format of the image data, defaults to ImageFormat::Unknown (auto-detect)
+    /// @return Result containing the image metadata or an error message
+    inline geode::Result<ImageInfo> getImageInfo(void const* data, size_t size, ImageFormat format = ImageFormat::Unknown) {
+        auto table = __detail::getFunctionTable();
+        if (!table)
+            return geode::Err("ImagePlus is not available");
+        if (table->version < 4 || !table->getImageInfo)
+            return geode::Err("Installed ImagePlus version does not support reading image info");
+        return table->getImageInfo(data, size, format);
+    }
+
+    /// @brief Decodes an image (or a single animation frame) into a buffer from the given allocator
+    /// @note Pixel layout is the same as the one returned by tryDecode
+    /// @param data Pointer to the image data
+    /// @param size Size of the image data
+    /// @param allocator Allocator for the pixel buffer, the caller releases the buffer with it
+    /// @param format The format of the image data, defaults to ImageFormat::Unknown (auto-detect)
+    /// @param frame Index of the animation frame to decode, composited with the frames before it
+    /// @return Result containing the decoded image or an error message
+    inline geode::Result<AllocatedImage> tryDecodeWith(
+        void const* data, size_t size, PixelAllocator const& allocator,
+        ImageFormat format = ImageFormat::Unknown, size_t frame = 0
+    ) {
+        auto table = __detail::getFunctionTable();
+        if (!table)
+            return geode::Err("ImagePlus is not available");
+        if (table->version < 6 || !table->tryDecodeWith)
+            return geode::Err("Installed ImagePlus version does not support custom allocators");
+        return table->tryDecodeWith(data, size, allocator, format, frame);
+    }
+
+    /// @brief Sets the allocator for pixel buffers that ImagePlus owns itself (decoded animation frames,
+    /// frame history, etc). Buffers keep a copy of the allocator they came from, so it can be changed at any time.
+    /// @note DecodedImage and AnimationFrame buffers are released with delete[], so they never come from this allocator,
+    /// use tryDecodeWith to decode into your own memory instead
+    /// @param allocator Allocator to use, or an empty one to restore the default (operator new[])
+    inline void setPixelAllocator(PixelAllocator const& allocator) {
+        auto table = __detail::getFunctionTable();
+        if (!table || table->version < 6 || !table->setPixelAllocator)
+            return;
+        table->setPixelAllocator(allocator);
+    }
+
+    /// @brief Limits the number of threads shared by all codecs (animation frames, JPEG XL, WebP encoding, batches)
+    /// @note Overrides the "Codec Threads" setting until the user changes it
+    /// @param count Maximum number of threads, including the calling one. 0 picks it based on the CPU (default)
+    inline void setMaxThreads(size_t count) {
+        auto table = __detail::getFunctionTable();
+        if (!table || table->version < 3 || !table->setMaxThreads)
+            return;
+        table->setMaxThreads(count);
+    }
+
+    /// @brief Returns the thread limit set with setMaxThreads, or 0 if it's picked automatically
+    inline size_t getMaxThreads() {
+        auto table = __detail::getFunctionTable();
+        if (!table || table->version < 3 || !table->getMaxThreads)
+            return 0;
+        return table->getMaxThreads();
+    }
+
+    /// @brief Returns the counters of the format since the game started (or since resetCodecStats).
+    /// Decodes are counted in tryDecode, tryDecodeWith and when the game loads an image, encodes in every encoder
+    /// @note Cache hits are not decodes, see the "Log Codec Stats" setting for the cache counters.
+    /// Returns empty counters on ImagePlus versions without statistics
+    inline FormatStats getCodecStats(ImageFormat format) {
+        auto table = __detail::getFunctionTable();
+        if (!table || table->version < 10 || !table->getCodecStats)
+            return {};
+        return table->getCodecStats(format);
+    }
+
+    /// @brief Resets the counters of every format
+    inline void resetCodecStats() {
+        auto table = __detail::getFunctionTable();
+        if (!table || table->version < 10 || !table->resetCodecStats)
+            return;
+        table->resetCodecStats();
+    }
+
     #define IMAGE_PLUS_GEN_CHECK_FUNC(name) \
         inline bool name(void const* data, size_t size) { \
             auto table = __detail::getFunctionTable(); \
@@ -197,6 +382,16 @@ namespace imgp {
             return table->func(data, size); \
         }
 
+    #define IMAGE_PLUS_GEN_DECODE_FUNC2_USER_BUF(name, func) \
+        inline geode::Result<size_t> name(void const* data, size_t size, void* buf, size_t bufSize, size_t frame = 0) { \
+            auto table = __detail::getFunctionTable(); \
+            if (!table) \
+                return geode::Err("ImagePlus is not available"); \
+            if (table->version < 5 || !table->func) \
+                return geode::Err("Installed ImagePlus version does not support user buffer decoding"); \
+            return table->func(data, size, buf, bufSize, frame); \
+        }
+
     #define IMAGE_PLUS_GEN_ENCODE_FUNC1(name, func) \
         inline geode::Result<geode::ByteVector> name(void const* image, uint16_t width, uint16_t height, bool hasAlpha = true) { \
             auto table = __detail::getFunctionTable(); \
@@ -221,6 +416,66 @@ namespace imgp {
             return table->func(anim, quality); \
         }
 
+    // Versions before 8 don't take EncodeOptions, so these fall back to the quality-only functions
+    #define IMAGE_PLUS_GEN_ENCODE_FUNC1_OPTS(name, func, legacy) \
+        inline geode::Result<geode::ByteVector> name(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options) { \
+            auto table = __detail::getFunctionTable(); \
+            if (!table) \
+                return geode::Err("ImagePlus is not available"); \
+            if (table->version >= 8 && table->func) \
+                return table->func(image, width, height, hasAlpha, options); \
+            if (!table->legacy) \
+                return geode::Err("ImagePlus is not available"); \
+            return table->legacy(image, width, height, hasAlpha); \
+        }
+
+    #define IMAGE_PLUS_GEN_ENCODE_FUNC2_OPTS(name, func, legacy) \
+        inline geode::Result<geode::ByteVector> name(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options) { \
+            auto table = __detail::getFunctionTable(); \
+            if (!table) \
+                return geode::Err("ImagePlus is not available"); \
+            if (table->version >= 8 && table->func) \
+                return table->func(image, width, height, hasAlpha, options); \
+            if (!table->legacy) \
+                return geode::Err("ImagePlus is not available"); \
+            return table->legacy(image, width, height, hasAlpha, options.lossless ? 100.f : options.quality); \
+        }
+
+    #define IMAGE_PLUS_GEN_ENCODE_FUNC3_OPTS(name, func, legacy) \
+        inline geode::Result<geode::ByteVector> name(DecodedAnimation const& anim, EncodeOptions const& options) { \
+            auto table = __detail::getFunctionTable(); \
+            if (!table) \
+                return geode::Err("ImagePlus is not available"); \
+            if (table->version >= 8 && table->func) \
+                return table->func(anim, options); \
+            if (!table->legacy) \
+                return geode::Err("ImagePlus is not available"); \
+            return table->legacy(anim, options.lossless ? 100.f : options.quality); \
+        }
+
+    // Versions before 9 can't write into a sink, so these encode into a ByteVector and pass it on in one piece
+    #define IMAGE_PLUS_GEN_ENCODE_FUNC2_TO(name, func, fallback) \
+        inline geode::Result<size_t> name(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink) { \
+            auto table = __detail::getFunctionTable(); \
+            if (table && table->version >= 9 && table->func) \
+                return table->func(image, width, height, hasAlpha, options, sink); \
+            GEODE_UNWRAP_INTO(auto data, fallback(image, width, height, hasAlpha, options)); \
+            if (!sink.write || !sink.write(data.data(), data.size())) \
+                return geode::Err("Failed to write encoded data"); \
+            return geode::Ok(data.size()); \
+        }
+
+    #define IMAGE_PLUS_GEN_ENCODE_FUNC3_TO(name, func, fallback) \
+        inline geode::Result<size_t> name(DecodedAnimation const& anim, EncodeOptions const& options, OutputSink const& sink) { \
+            auto table = __detail::getFunctionTable(); \
+            if (table && table->version >= 9 && table->func) \
+                return table->func(anim, options, sink); \
+            GEODE_UNWRAP_INTO(auto data, fallback(anim, options)); \
+            if (!sink.write || !sink.write(data.data(), data.size())) \
+                return geode::Err("Failed to write encoded data"); \
+            return geode::Ok(data.size()); \
+        }
+
     namespace formats {
         /// @brief Checks whether the data buffer contains valid JPEG magic
         /// @param data Pointer to the buffer
@@ -294,6 +549,20 @@ namespace imgp {
         /// @return Result containing the decoded image or an error message
         IMAGE_PLUS_GEN_DECODE_FUNC1(qoi, decodeQoi)
 
+        /// @brief Decodes a QOI header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC1_HDR(qoiHeader, decodeQoiHeader)
+
+        /// @brief Decodes a QOI image into the given buffer, returning an error if the buffer is too small or if decoding fails
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @return Result containing the size of the decoded image data or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC1_USER_BUF(qoiInto, decodeQoiInto)
+
         // == Animated Images == //
 
         /// @brief Decodes a JPEG XL image and returns either a single frame or an animation
@@ -303,6 +572,23 @@ namespace imgp {
         /// @return Result containing the decoded image or an error message
         IMAGE_PLUS_GEN_DECODE_FUNC2(jpegxl, decodeJpegXL)
 
+        /// @brief Decodes a JPEG XL header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC2_HDR(jpegxlHeader, decodeJpegXLHeader)
+
+        /// @brief Decodes a single JPEG XL frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by jpegxl(), use jpegxlHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC2_USER_BUF(jpegxlInto, decodeJpegXLInto)
+
         /// @brief Decodes a WEBP image and returns either a single frame or an animation
         /// @note User is responsible for freeing the image data (if single frame)
         /// @param data Pointer to the image data
@@ -316,12 +602,40 @@ namespace imgp {
         /// @return Result containing the decoded metadata or an error message
         IMAGE_PLUS_GEN_DECODE_FUNC2_HDR(webpHeader, decodeWebpHeader)
 
+        /// @brief Decodes a single WEBP frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by webp(), use webpHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC2_USER_BUF(webpInto, decodeWebpInto)
+
         /// @brief Decodes a GIF image and returns either a single frame or an animation
         /// @note User is responsible for freeing the image data (if single frame)
         /// @param data Pointer to the image data
         /// @param size Size of the image data
         /// @return Result containing the decoded image or an error message
         IMAGE_PLUS_GEN_DECODE_FUNC2(gif, decodeGif)
+
+        /// @brief Decodes a GIF header and returns the image metadata, without decoding pixels
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @return Result containing the decoded metadata or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC2_HDR(gifHeader, decodeGifHeader)
+
+        /// @brief Decodes a single GIF frame (or the static image) into the given buffer,
+        /// returning an error if the buffer is too small, the frame doesn't exist or if decoding fails
+        /// @note Pixel layout is the same as the frames returned by gif(), use gifHeader() to get the required size
+        /// @param data Pointer to the image data
+        /// @param size Size of the image data
+        /// @param buf Pointer to the buffer to decode into
+        /// @param bufSize Size of the buffer
+        /// @param frame Index of the frame to decode, composited with the frames before it
+        /// @return Result containing the size of the decoded frame data or an error message
+        IMAGE_PLUS_GEN_DECODE_FUNC2_USER_BUF(gifInto, decodeGifInto)
     }
 
     namespace encode {
@@ -370,6 +684,81 @@ namespace imgp {
         /// @param quality The quality of the encoding (default is 75.f)
         /// @return Result containing the encoded animation data or an error message
         IMAGE_PLUS_GEN_ENCODE_FUNC3(jpegxl, encodeJpegXLAnim)
+
+        // == Encoding with options, see EncodeOptions for the presets and per-format settings == //
+        // On ImagePlus versions without EncodeOptions, these use the default settings with the given quality
+
+        /// @brief Encodes a PNG image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset and compression level (quality and lossless are ignored)
+        /// @return Result containing the encoded image data or an error message
+        IMAGE_PLUS_GEN_ENCODE_FUNC1_OPTS(png, encodePngWith, encodePng)
+
+        /// @brief Encodes a WEBP image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset, quality and WebP settings
+        /// @return Result containing the encoded image data or an error message
+        IMAGE_PLUS_GEN_ENCODE_FUNC2_OPTS(webp, encodeWebpWith, encodeWebp)
+
+        /// @brief Encodes a JPEG XL image from raw pixel data
+        /// @param image Pointer to the raw pixel data
+        /// @param width Width of the image
+        /// @param height Height of the image
+        /// @param hasAlpha Whether the image has an alpha channel
+        /// @param options Preset, quality and JPEG XL effort
+        /// @return Result containing the encoded image data or an error message
+        IMAGE_PLUS_GEN_ENCODE_FUNC2_OPTS(jpegxl, encodeJpegXLWith, encodeJpegXL)
+
+        /// @brief Encodes a WEBP animation from a DecodedAnimation
+        /// @param anim The animation to encode
+        /// @param options Preset, quality and WebP settings
+        /// @return Result containing the encoded animation data or an error message
+        IMAGE_PLUS_GEN_ENCODE_FUNC3_OPTS(webp, encodeWebpAnimWith, encodeWebpAnim)
+
+        /// @brief Encodes a JPEG XL animation from a DecodedAnimation
+        /// @param anim The animation to encode
+        /// @param options Preset, quality and JPEG XL effort
+        /// @return Result containing the encoded animation data or an error message
+        IMAGE_PLUS_GEN_ENCODE_FUNC3_OPTS(jpegxl, encodeJpegXLAnimWith, encodeJpegXLAnim)
+
+        // == Encoding into an OutputSink, the data is written as the encoder produces it == //
+        // These return the total size of the encoded data. With OutputSink::buffer, a size bigger than
+        // the buffer means it was too small, and the encode has to be repeated with a buffer of that size.
+        // On ImagePlus versions without sinks, the whole file is encoded first and then written in one piece
+
+        /// @brief Encodes a PNG image from raw pixel data into the sink, written as it's compressed
+        IMAGE_PLUS_GEN_ENCODE_FUNC2_TO(pngTo, encodePngTo, png)
+
+        /// @brief Encodes a QOI image from raw pixel data into the sink
+        /// @note The encoded image is still built in memory first and then written in one piece
+        inline geode::Result<size_t> qoiTo(void const* image, uint16_t width, uint16_t height, bool hasAlpha, OutputSink const& sink) {
+            auto table = __detail::getFunctionTable();
+            if (table && table->version >= 9 && table->encodeQoiTo)
+                return table->encodeQoiTo(image, width, height, hasAlpha, sink);
+            GEODE_UNWRAP_INTO(auto data, qoi(image, width, height, hasAlpha));
+            if (!sink.write || !sink.write(data.data(), data.size()))
+                return geode::Err("Failed to write encoded data");
+            return geode::Ok(data.size());
+        }
+
+        /// @brief Encodes a WEBP image from raw pixel data into the sink, written as it's encoded
+        IMAGE_PLUS_GEN_ENCODE_FUNC2_TO(webpTo, encodeWebpTo, webp)
+
+        /// @brief Encodes a JPEG XL image from raw pixel data into the sink, written in chunks as it's encoded
+        IMAGE_PLUS_GEN_ENCODE_FUNC2_TO(jpegxlTo, encodeJpegXLTo, jpegxl)
+
+        /// @brief Encodes a WEBP animation into the sink
+        /// @note The animation is still assembled in memory first and then written in one piece
+        IMAGE_PLUS_GEN_ENCODE_FUNC3_TO(webpTo, encodeWebpAnimTo, webp)
+
+        /// @brief Encodes a JPEG XL animation into the sink, written in chunks as it's encoded
+        IMAGE_PLUS_GEN_ENCODE_FUNC3_TO(jpegxlTo, encodeJpegXLAnimTo, jpegxl)
     }
 
     #undef IMAGE_PLUS_GEN_CHECK_FUNC
@@ -378,6 +767,11 @@ namespace imgp {
     #undef IMAGE_PLUS_GEN_ENCODE_FUNC1
     #undef IMAGE_PLUS_GEN_ENCODE_FUNC2
     #undef IMAGE_PLUS_GEN_ENCODE_FUNC3
+    #undef IMAGE_PLUS_GEN_ENCODE_FUNC1_OPTS
+    #undef IMAGE_PLUS_GEN_ENCODE_FUNC2_OPTS
+    #undef IMAGE_PLUS_GEN_ENCODE_FUNC3_OPTS
+    #undef IMAGE_PLUS_GEN_ENCODE_FUNC2_TO
+    #undef IMAGE_PLUS_GEN_ENCODE_FUNC3_TO
 
     class AnimatedSprite : public cocos2d::CCSprite {
     public:
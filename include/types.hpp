@@ -2,9 +2,17 @@
 #ifndef IMAGE_PLUS_TYPES_HPP
 #define IMAGE_PLUS_TYPES_HPP
 
+#ifndef IMAGEPLUS_HEADLESS
 #include <Geode/cocos/platform/CCImage.h>
+#endif
+#include <Geode/Result.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <memory>
 #include <string_view>
 #include <variant>
@@ -28,6 +36,7 @@ namespace imgp {
         CgBI   = 9, ///< @note Only available on iOS
     };
 
+#ifndef IMAGEPLUS_HEADLESS
     /// @brief Helper converter to turn imgp::ImageFormat into cocos2d enum
     constexpr cocos2d::CCImage::EImageFormat operator+(ImageFormat val) {
         switch (val) {
@@ -40,6 +49,7 @@ namespace imgp {
             default: return cocos2d::CCImage::kFmtUnKnown;
         }
     }
+#endif
 
     /// @brief Container for decoded image data
     struct DecodedImage {
@@ -71,6 +81,146 @@ namespace imgp {
     /// @brief Result type that can hold either a decoded image or a decoded animation
     using DecodedResult = std::variant<DecodedImage, DecodedAnimation>;
 
+    /// @brief Image metadata read from the headers, without decoding any pixels
+    struct ImageInfo {
+        ImageFormat format = ImageFormat::Unknown;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint8_t bit_depth = 8;
+        bool hasAlpha = false; // matches the channel count of the decoded data
+        uint32_t frameCount = 1;
+        uint16_t loopCount = 0; // 0 means infinite
+        uint64_t totalDuration = 0; // sum of all frame delays in milliseconds, 0 for static images
+
+        bool isAnimated() const { return frameCount > 1; }
+    };
+
+    /// @brief User-provided allocator for pixel buffers (e.g. a pool, a slab or aligned/huge-page memory)
+    struct PixelAllocator {
+        /// @brief Returns a buffer of at least `size` bytes, or nullptr on failure
+        void* (*allocate)(size_t size, void* userdata) = nullptr;
+        /// @brief Releases a buffer returned by allocate, `size` is the same as requested
+        void (*deallocate)(void* data, size_t size, void* userdata) = nullptr;
+        void* userdata = nullptr;
+
+        explicit operator bool() const { return allocate && deallocate; }
+    };
+
+    /// @brief Image (or a single animation frame) decoded into a buffer from a PixelAllocator
+    /// @note Not released automatically, the caller has to pass it back to the allocator's deallocate
+    struct AllocatedImage {
+        void* data = nullptr;
+        size_t size = 0; // size of the buffer in bytes, as passed to allocate
+        ImageInfo info;
+
+        operator bool() const { return data != nullptr; }
+    };
+
+    /// @brief Speed/size trade-off for the encoders
+    enum class EncodePreset : uint8_t {
+        Fastest,  ///< Fast enough for encodes at runtime (screenshots, thumbnails), files are much bigger
+        Fast,
+        Balanced, ///< Same settings as the encode functions without EncodeOptions
+        Smallest, ///< Slowest, for exports where the file size matters most
+    };
+
+    /// @brief Settings for the encode functions. Per-format fields left at -1 are picked from the preset
+    struct EncodeOptions {
+        EncodePreset preset = EncodePreset::Balanced;
+        float quality = 75.f;  // 0-100, used by lossy WebP and JPEG XL
+        bool lossless = false; // WebP and JPEG XL only, PNG and QOI are always lossless
+        uint8_t threads = 0;   // maximum number of threads for this encode, 0 uses the global limit (see setMaxThreads)
+
+        struct {
+            int8_t method = -1;          // 0 (fastest) to 6 (smallest)
+            int8_t losslessQuality = -1; // lossless only: how hard the encoder tries, 0 (fastest) to 100 (smallest)
+            int8_t parallelFrames = -1;  // animations: 1 encodes frames in parallel (Fastest/Fast), 0 uses WebPAnimEncoder (smaller, slower)
+            int8_t minimizeSize = -1;    // WebPAnimEncoder: 1 tries more ways to encode every frame
+            int16_t keyframeMax = -1;    // WebPAnimEncoder: maximum distance between key frames
+        } webp;
+
+        struct {
+            int8_t effort = -1; // 1 (fastest) to 10 (smallest)
+        } jpegxl;
+
+        struct {
+            int8_t compressionLevel = -1; // zlib level, 0 (fastest) to 9 (smallest)
+        } png;
+    };
+
+    /// @brief Destination for the encode::*To functions, which write the encoded data as it's produced
+    /// instead of collecting it into a ByteVector first
+    struct OutputSink {
+        /// @brief Receives the next chunk of encoded data (chunks come in order), returning false aborts the encode
+        std::function<bool(void const* data, size_t size)> write;
+
+        /// @brief Writes into a caller-provided buffer. If it's too small, nothing is written past its end,
+        /// but the encode still finishes, and the returned size tells how big the buffer has to be
+        static OutputSink buffer(void* data, size_t capacity) {
+            return { [data = static_cast<uint8_t*>(data), capacity, offset = size_t(0)](void const* chunk, size_t size) mutable {
+                if (offset < capacity) std::memcpy(data + offset, chunk, std::min(size, capacity - offset));
+                offset += size;
+                return true;
+            } };
+        }
+
+        /// @brief Appends to a file opened in binary mode, the file is not closed afterwards
+        static OutputSink file(std::FILE* file) {
+            return { [file](void const* chunk, size_t size) {
+                return std::fwrite(chunk, 1, size, file) == size;
+            } };
+        }
+
+        /// @brief Passes every chunk to the callback
+        static OutputSink callback(std::function<bool(void const* data, size_t size)> callback) {
+            return { std::move(callback) };
+        }
+    };
+
+    /// @brief Encoded image passed to tryDecodeBatch, the data has to stay alive until the call returns
+    struct EncodedImage {
+        void const* data = nullptr;
+        size_t size = 0;
+        ImageFormat format = ImageFormat::Unknown; // format hint, Unknown to auto-detect
+    };
+
+    /// @brief Receives the result for the image at `index` of a batch
+    using BatchCallback = std::function<void(size_t index, geode::Result<DecodedResult> result)>;
+
+    /// @brief Counters for decoding or encoding a single format, see getCodecStats
+    struct CodecStats {
+        /// @brief Bucket i counts calls that took [2^(i-1), 2^i) microseconds, the last one has no upper bound
+        static constexpr size_t LATENCY_BUCKETS = 24;
+
+        uint64_t calls = 0;
+        uint64_t failures = 0;
+        uint64_t bytesIn = 0;  // encoded data for decodes, raw pixels for encodes
+        uint64_t bytesOut = 0; // decoded pixels for decodes, encoded data for encodes (successful calls only)
+        uint64_t pixels = 0;   // every frame counts (successful calls only)
+        uint64_t totalMicros = 0;
+        std::array<uint64_t, LATENCY_BUCKETS> latency{};
+
+        /// @brief Upper bound of the bucket that the given fraction of calls (e.g. 0.99) fits into, in microseconds
+        uint64_t latencyPercentile(double fraction) const {
+            uint64_t total = 0;
+            for (auto count : latency) total += count;
+            if (total == 0) return 0;
+
+            uint64_t seen = 0;
+            for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+                seen += latency[i];
+                if (seen >= total * fraction) return uint64_t(1) << i;
+            }
+            return uint64_t(1) << (LATENCY_BUCKETS - 1);
+        }
+    };
+
+    /// @brief Decode and encode counters of a single format
+    struct FormatStats {
+        CodecStats decode;
+        CodecStats encode;
+    };
+
     inline std::string_view format_as(ImageFormat fmt) {
         switch (fmt) {
             case ImageFormat::Jpg:     return "jpg";
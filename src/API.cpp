@@ -1,7 +1,18 @@
 #include <api.hpp>
+#include "ThreadPool.hpp"
 #include "hooks/CCSprite.hpp"
 
+#include <Geode/Geode.hpp>
+
 IMAGE_PLUS_BEGIN_NAMESPACE
+    void setMaxThreads(size_t count) {
+        ThreadPool::get().setMaxThreads(count);
+    }
+
+    size_t getMaxThreads() {
+        return ThreadPool::get().getMaxThreads();
+    }
+
     bool AnimatedSprite::isAnimated() {
         return ImagePlusSprite::from(this)->m_fields->animation != nullptr;
     }
@@ -50,3 +61,11 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         return ImagePlusSprite::from(this)->getFrameCount();
     }
 IMAGE_PLUS_END_NAMESPACE
+
+$on_mod(Loaded) {
+    using namespace geode::prelude;
+    imgp::setMaxThreads(getMod()->getSettingValue<int64_t>("max-threads"));
+    listenForSettingChanges<int64_t>("max-threads", [](int64_t val) {
+        imgp::setMaxThreads(val);
+    });
+}
@@ -0,0 +1,277 @@
+#include "AnimationSource.hpp"
+#include "BufferPool.hpp"
+
+#include "Headless.hpp"
+
+#ifndef IMAGEPLUS_HEADLESS
+#include <Geode/loader/Log.hpp>
+#endif
+
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <utility>
+
+using namespace geode;
+
+namespace imgp {
+    /// @brief Background thread that decodes frames ahead of the playhead
+    class PrefetchWorker {
+    public:
+        static PrefetchWorker& get() {
+            static PrefetchWorker instance;
+            return instance;
+        }
+
+        void push(std::weak_ptr<AnimationSource> source) {
+            {
+                std::lock_guard lock(m_mutex);
+                m_queue.push_back(std::move(source));
+            }
+            m_condition.notify_one();
+        }
+
+    private:
+        PrefetchWorker() : m_thread([this] { this->run(); }) {}
+
+        ~PrefetchWorker() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_one();
+            m_thread.join();
+        }
+
+        void run() {
+            while (true) {
+                std::weak_ptr<AnimationSource> next;
+                {
+                    std::unique_lock lock(m_mutex);
+                    m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                    if (m_stop) return;
+                    next = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+
+                if (auto source = next.lock()) {
+                    source->runPrefetch();
+                }
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<std::weak_ptr<AnimationSource>> m_queue;
+        bool m_stop = false;
+        std::thread m_thread; // has to be the last member, so it starts after everything else is initialized
+    };
+
+    /// @brief Source for animations that were already fully decoded
+    class DecodedAnimationSource : public AnimationSource {
+    public:
+        DecodedAnimationSource(DecodedAnimation&& animation, std::vector<uint32_t> delays)
+            : AnimationSource(animation.width, animation.height, animation.hasAlpha, animation.loopCount, std::move(delays)),
+              m_animation(std::move(animation)) {}
+
+        ~DecodedAnimationSource() override {
+            auto& pool = BufferPool::get();
+            for (auto& frame : m_animation.frames) {
+                pool.release(std::move(frame.data), this->getFrameSize());
+            }
+        }
+
+    protected:
+        Result<> decodeNext(uint8_t* out) override {
+            if (m_next >= m_animation.frames.size())
+                return Err("No more frames in animation");
+
+            std::memcpy(out, m_animation.frames[m_next++].data.get(), this->getFrameSize());
+            return Ok();
+        }
+
+        Result<> rewind() override {
+            m_next = 0;
+            return Ok();
+        }
+
+    private:
+        DecodedAnimation m_animation;
+        size_t m_next = 0;
+    };
+
+    AnimationSource::AnimationSource(
+        uint16_t width, uint16_t height, bool hasAlpha, uint16_t loopCount, std::vector<uint32_t> delays
+    ) : m_width(width), m_height(height), m_hasAlpha(hasAlpha), m_loopCount(loopCount), m_delays(std::move(delays)) {}
+
+    std::shared_ptr<AnimationSource> AnimationSource::fromDecoded(DecodedAnimation&& animation) {
+        std::vector<uint32_t> delays;
+        delays.reserve(animation.frames.size());
+        for (auto const& frame : animation.frames) {
+            delays.push_back(frame.delay);
+        }
+        return std::make_shared<DecodedAnimationSource>(std::move(animation), std::move(delays));
+    }
+
+    uint8_t* AnimationSource::getFirstFrame() {
+        return this->getFrame(0).get();
+    }
+
+    AnimationSource::Frame AnimationSource::getFrame(size_t index) {
+        if (index >= this->getFrameCount()) {
+            return nullptr;
+        }
+
+        if (auto frame = this->findCached(index)) {
+            return frame;
+        }
+
+        std::lock_guard lock(m_decodeMutex);
+        return this->decodeUntil(index);
+    }
+
+    void AnimationSource::prefetch(size_t index) {
+        if (this->getFrameCount() <= 2) return;
+
+        {
+            // nothing to do if the whole animation fits in memory and is already decoded
+            std::lock_guard lock(m_cacheMutex);
+            if (m_cache.size() + 1 >= this->getFrameCount()) return;
+        }
+
+        m_prefetchTarget = index;
+        if (m_prefetchQueued.exchange(true)) return;
+
+        PrefetchWorker::get().push(this->weak_from_this());
+    }
+
+    void AnimationSource::setCapacity(size_t capacity) {
+        std::lock_guard lock(m_cacheMutex);
+        m_capacity = std::max<size_t>(capacity, 1);
+        while (m_cache.size() > m_capacity) {
+            m_cache.pop_front();
+        }
+    }
+
+    void AnimationSource::setMemoryBudget(size_t bytes) {
+        std::lock_guard lock(m_decodeMutex);
+        m_frameBudget = this->framesForBudget(bytes);
+        this->applyMemoryBudget(bytes);
+    }
+
+    void AnimationSource::applyMemoryBudget(size_t bytes) {
+        this->setCapacity(this->framesForBudget(bytes));
+    }
+
+    size_t AnimationSource::framesForBudget(size_t bytes) const {
+        // first frame is always resident, so it's not counted here
+        size_t maxFrames = std::max<size_t>(this->getFrameCount(), 2) - 1;
+        size_t frameSize = std::max<size_t>(this->getFrameSize(), 1);
+        return std::min(std::max<size_t>(bytes / frameSize, 2), maxFrames);
+    }
+
+    AnimationSource::Frame AnimationSource::findCached(size_t index) {
+        std::lock_guard lock(m_cacheMutex);
+        if (index == 0) {
+            return m_firstFrame;
+        }
+
+        for (auto& [cachedIndex, frame] : m_cache) {
+            if (cachedIndex == index) return frame;
+        }
+
+        return nullptr;
+    }
+
+    AnimationSource::Frame AnimationSource::takeSpareBuffer() {
+        if (m_spare) {
+            return std::exchange(m_spare, nullptr);
+        }
+
+        // first frame, cached frames and the one being decoded (only attempted once)
+        if (!m_arena && !m_firstFrame) {
+            m_arena = FrameArena::create(this->getFrameSize(), m_capacity + 2);
+        }
+
+        if (m_arena) {
+            if (auto frame = m_arena->acquire()) return frame;
+        }
+
+        // every slot is in use (frames can be held by the texture uploader), or the arena didn't fit in memory
+        return Frame(allocatePixels(this->getFrameSize()));
+    }
+
+    AnimationSource::Frame AnimationSource::decodeUntil(size_t index) {
+        // could've been decoded while we were waiting for the lock
+        if (auto frame = this->findCached(index)) {
+            return frame;
+        }
+
+        if (index < m_nextIndex) {
+            if (auto res = this->rewind(); res.isErr()) {
+                log::warn("Failed to rewind animation: {}", res.unwrapErr());
+                return nullptr;
+            }
+            m_nextIndex = 0;
+        }
+
+        while (m_nextIndex <= index) {
+            auto buffer = this->takeSpareBuffer();
+            if (!buffer) {
+                log::warn("Failed to allocate memory for animation frame");
+                return nullptr;
+            }
+
+            if (auto res = this->decodeNext(buffer.get()); res.isErr()) {
+                log::warn("Failed to decode animation frame {}: {}", m_nextIndex, res.unwrapErr());
+                m_spare = std::move(buffer);
+                m_nextIndex = std::numeric_limits<size_t>::max(); // force a rewind on next request
+                return nullptr;
+            }
+
+            size_t decoded = m_nextIndex++;
+
+            std::lock_guard lock(m_cacheMutex);
+            if (decoded == 0) {
+                if (!m_firstFrame) m_firstFrame = std::move(buffer);
+                else m_spare = std::move(buffer);
+                continue;
+            }
+
+            // frames we only had to decode to get to the requested one are not kept
+            if (decoded != index) {
+                m_spare = std::move(buffer);
+                continue;
+            }
+
+            m_cache.emplace_back(decoded, buffer);
+            // evicted buffers go back to the arena (or the allocator) once the last holder lets go of them.
+            // Checking use_count() to reuse them right here would race with a reader on another thread,
+            // since it doesn't synchronize with that reader dropping its reference
+            while (m_cache.size() > m_capacity) {
+                m_cache.pop_front();
+            }
+
+            return buffer;
+        }
+
+        return this->findCached(index);
+    }
+
+    void AnimationSource::runPrefetch() {
+        m_prefetchQueued = false;
+
+        size_t target = m_prefetchTarget;
+        size_t count = this->getFrameCount();
+        size_t ahead = std::min(m_capacity.load() - 1, count - 1);
+
+        std::lock_guard lock(m_decodeMutex);
+        for (size_t i = 1; i <= ahead; ++i) {
+            // playhead has moved, so another prefetch was queued already
+            if (m_prefetchTarget != target) break;
+
+            if (!this->decodeUntil((target + i) % count)) break;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <api.hpp>
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace imgp {
+    /// @brief Region of an animation canvas, in pixels
+    struct FrameRect {
+        uint16_t x = 0;
+        uint16_t y = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+
+        bool empty() const { return width == 0 || height == 0; }
+        size_t area() const { return static_cast<size_t>(width) * height; }
+
+        /// @brief Returns the bounding box of both rects
+        FrameRect merge(FrameRect const& other) const {
+            if (this->empty()) return other;
+            if (other.empty()) return *this;
+
+            uint16_t left = std::min(x, other.x);
+            uint16_t top = std::min(y, other.y);
+            uint16_t right = std::max<uint16_t>(x + width, other.x + other.width);
+            uint16_t bottom = std::max<uint16_t>(y + height, other.y + other.height);
+            return { left, top, static_cast<uint16_t>(right - left), static_cast<uint16_t>(bottom - top) };
+        }
+    };
+
+    /// @brief Lazily decodes animation frames from encoded data.
+    /// Only a small window of composited frames is kept in memory, the rest is decoded
+    /// on demand (and ahead of the playhead on a background thread).
+    class AnimationSource : public std::enable_shared_from_this<AnimationSource> {
+    public:
+        using Frame = std::shared_ptr<uint8_t[]>;
+
+        virtual ~AnimationSource() = default;
+
+        AnimationSource(AnimationSource const&) = delete;
+        AnimationSource& operator=(AnimationSource const&) = delete;
+
+        uint16_t getWidth() const { return m_width; }
+        uint16_t getHeight() const { return m_height; }
+        bool hasAlpha() const { return m_hasAlpha; }
+        uint16_t getLoopCount() const { return m_loopCount; }
+        size_t getFrameCount() const { return m_delays.size(); }
+        uint32_t getDelay(size_t index) const { return m_delays[index]; }
+
+        /// @brief Size of a single composited frame in bytes
+        size_t getFrameSize() const {
+            return static_cast<size_t>(m_width) * m_height * (m_hasAlpha ? 4 : 3);
+        }
+
+        /// @brief Region that can differ between the previous frame and the given one
+        /// @note The first frame is always reported as fully changed
+        virtual FrameRect getDirtyRect(size_t index) const {
+            return { 0, 0, m_width, m_height };
+        }
+
+        /// @brief Returns the first frame, which stays in memory for the whole lifetime of the source
+        /// @note This pointer is used as CCImage data, so it must not be freed by anyone else
+        uint8_t* getFirstFrame();
+
+        /// @brief Returns the composited canvas of the given frame, decoding it if needed
+        /// @return nullptr if the frame could not be decoded
+        Frame getFrame(size_t index);
+
+        /// @brief Queues decoding of the frames following the given index on the background worker
+        void prefetch(size_t index);
+
+        /// @brief Sets the maximum amount of frames kept in memory (not counting the first frame)
+        /// @note Frame buffers are carved out of one allocation sized on the first decode,
+        /// buffers needed past that point are allocated separately
+        void setCapacity(size_t capacity);
+        size_t getCapacity() const { return m_capacity; }
+
+        /// @brief Picks the frame capacity for the given memory budget
+        /// @note Waits for any decode in progress, since it can replace buffers the decoder is using
+        void setMemoryBudget(size_t bytes);
+
+        /// @brief How many full frames (not counting the first one) fit the memory budget.
+        /// Sources can cache fewer composited frames than this (see getCapacity), so texture caches use this instead
+        size_t getFrameBudget() const { return m_frameBudget; }
+
+        /// @brief Whether every frame stays in memory once decoded, so seeking around doesn't decode anything again.
+        /// Each sprite has its own playhead, so only sources like this are worth sharing between images
+        bool isFullyResident() const {
+            return m_capacity + 1 >= this->getFrameCount();
+        }
+
+        /// @brief Wraps an already decoded animation
+        static std::shared_ptr<AnimationSource> fromDecoded(DecodedAnimation&& animation);
+
+    protected:
+        AnimationSource(uint16_t width, uint16_t height, bool hasAlpha, uint16_t loopCount, std::vector<uint32_t> delays);
+
+        /// @brief Decodes the next frame in sequence into the output buffer (getFrameSize() bytes)
+        virtual geode::Result<> decodeNext(uint8_t* out) = 0;
+
+        /// @brief Resets the decoder, so that the next decodeNext() call returns the first frame
+        virtual geode::Result<> rewind() = 0;
+
+        /// @brief Called by setMemoryBudget() with the decode lock held
+        virtual void applyMemoryBudget(size_t bytes);
+
+        /// @brief Amount of full frames that fit in the given amount of bytes, between 2 and the frame count - 1
+        size_t framesForBudget(size_t bytes) const;
+
+    private:
+        friend class PrefetchWorker;
+
+        Frame findCached(size_t index);
+        Frame decodeUntil(size_t index);
+        Frame takeSpareBuffer();
+        void runPrefetch();
+
+        uint16_t m_width = 0;
+        uint16_t m_height = 0;
+        bool m_hasAlpha = false;
+        uint16_t m_loopCount = 0;
+        std::vector<uint32_t> m_delays;
+
+        std::shared_ptr<FrameArena> m_arena;
+        Frame m_firstFrame;
+        Frame m_spare;
+        std::deque<std::pair<size_t, Frame>> m_cache;
+        std::atomic<size_t> m_capacity = 2; // written under m_cacheMutex, but read without it by the prefetch worker and getCapacity()
+        std::atomic<size_t> m_frameBudget = 2;
+        size_t m_nextIndex = 0; // index of the frame that decodeNext() will produce
+
+        std::mutex m_cacheMutex;
+        std::mutex m_decodeMutex;
+        std::atomic<size_t> m_prefetchTarget = 0;
+        std::atomic_bool m_prefetchQueued = false;
+    };
+}
+
+IMAGE_PLUS_BEGIN_NAMESPACE
+    namespace decode {
+        /// @brief Creates a lazy animation source for a WebP animation
+        /// @return nullptr if the image is not animated
+        geode::Result<std::shared_ptr<AnimationSource>> webpSource(void const* data, size_t size);
+
+        /// @brief Creates a lazy animation source for a GIF animation
+        /// @return nullptr if the image is not animated
+        geode::Result<std::shared_ptr<AnimationSource>> gifSource(void const* data, size_t size);
+
+        /// @brief Creates a lazy animation source for a JPEG XL animation
+        /// @return nullptr if the image is not animated
+        geode::Result<std::shared_ptr<AnimationSource>> jpegxlSource(void const* data, size_t size);
+    }
+IMAGE_PLUS_END_NAMESPACE
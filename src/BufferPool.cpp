@@ -0,0 +1,93 @@
+#include "BufferPool.hpp"
+#include "Utils.hpp"
+
+#ifndef IMAGEPLUS_HEADLESS
+#include <Geode/Geode.hpp>
+
+using namespace geode::prelude;
+#endif
+
+namespace imgp {
+    BufferPool& BufferPool::get() {
+        static BufferPool instance;
+        return instance;
+    }
+
+    std::unique_ptr<uint8_t[]> BufferPool::acquire(size_t size) {
+        {
+            std::lock_guard lock(m_mutex);
+            auto it = m_sizes.find(size);
+            if (it != m_sizes.end()) {
+                // most recently released buffer is the most likely one to still be in cache
+                auto& list = it->second;
+                auto buffer = std::move(list.back()->data);
+                m_buffers.erase(list.back());
+                list.pop_back();
+                if (list.empty()) m_sizes.erase(it);
+
+                m_bytes -= size;
+                ++m_hits;
+                return buffer;
+            }
+            ++m_misses;
+        }
+
+        return util::make_unique(size);
+    }
+
+    void BufferPool::release(std::unique_ptr<uint8_t[]> buffer, size_t size) {
+        if (!buffer) return;
+
+        std::lock_guard lock(m_mutex);
+        if (size == 0 || size > m_maxSize) {
+            ++m_evictions;
+            return;
+        }
+
+        m_buffers.push_back({ size, std::move(buffer) });
+        m_sizes[size].push_back(std::prev(m_buffers.end()));
+        m_bytes += size;
+        this->evict();
+    }
+
+    void BufferPool::evict() {
+        while (m_bytes > m_maxSize && !m_buffers.empty()) {
+            // the oldest buffer overall is also the oldest one of its size
+            auto& oldest = m_buffers.front();
+            auto it = m_sizes.find(oldest.size);
+            it->second.erase(it->second.begin());
+            if (it->second.empty()) m_sizes.erase(it);
+
+            m_bytes -= oldest.size;
+            m_buffers.pop_front();
+            ++m_evictions;
+        }
+    }
+
+    void BufferPool::setMaxSize(size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        m_maxSize = bytes;
+        this->evict();
+    }
+
+    void BufferPool::clear() {
+        std::lock_guard lock(m_mutex);
+        m_buffers.clear();
+        m_sizes.clear();
+        m_bytes = 0;
+    }
+
+    BufferPool::Stats BufferPool::getStats() const {
+        std::lock_guard lock(m_mutex);
+        return { m_hits, m_misses, m_evictions, m_buffers.size(), m_bytes };
+    }
+}
+
+#ifndef IMAGEPLUS_HEADLESS
+$on_mod(Loaded) {
+    imgp::BufferPool::get().setMaxSize(getMod()->getSettingValue<int64_t>("buffer-pool-size") << 20);
+    listenForSettingChanges<int64_t>("buffer-pool-size", [](int64_t val) {
+        imgp::BufferPool::get().setMaxSize(val << 20);
+    });
+}
+#endif
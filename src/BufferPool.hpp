@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace imgp {
+    /// @brief Keeps released pixel buffers around, so that loading an image of the same size
+    /// (icons, thumbnails, frames of the same animation) reuses memory that is already paged in.
+    /// Buffers are grouped by their exact byte size, and the oldest ones are freed once the pool is full.
+    class BufferPool {
+    public:
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0; ///< Buffers freed because the pool was full (or they didn't fit at all)
+            size_t buffers = 0;
+            size_t bytes = 0;
+        };
+
+        static BufferPool& get();
+
+        BufferPool(BufferPool const&) = delete;
+        BufferPool& operator=(BufferPool const&) = delete;
+
+        /// @brief Returns a pooled buffer of the given size, or allocates a new one
+        /// @return nullptr if the allocation failed
+        std::unique_ptr<uint8_t[]> acquire(size_t size);
+
+        /// @brief Gives the buffer back to the pool, freeing it if it doesn't fit
+        /// @note The buffer has to be allocated with new[] and hold at least `size` bytes
+        void release(std::unique_ptr<uint8_t[]> buffer, size_t size);
+
+        /// @brief Sets the maximum amount of bytes retained by the pool, freeing the oldest buffers.
+        /// Setting it to 0 disables the pool
+        void setMaxSize(size_t bytes);
+        size_t getMaxSize() const { return m_maxSize; }
+
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        BufferPool() = default;
+
+        struct Buffer {
+            size_t size;
+            std::unique_ptr<uint8_t[]> data;
+        };
+
+        using BufferList = std::list<Buffer>;
+
+        void evict();
+
+        mutable std::mutex m_mutex;
+        BufferList m_buffers; // oldest first
+        std::unordered_map<size_t, std::vector<BufferList::iterator>> m_sizes; // per size, oldest first
+        size_t m_bytes = 0;
+        std::atomic<size_t> m_maxSize = 0;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+        size_t m_evictions = 0;
+    };
+}
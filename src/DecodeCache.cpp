@@ -0,0 +1,130 @@
+#include "DecodeCache.hpp"
+#include "BufferPool.hpp"
+
+#ifndef IMAGEPLUS_HEADLESS
+#include <Geode/Geode.hpp>
+#endif
+
+#include <cstring>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+using namespace geode;
+
+namespace imgp {
+    DecodeCache& DecodeCache::get() {
+        static DecodeCache instance;
+        return instance;
+    }
+
+    DecodeCache::Key DecodeCache::makeKey(void const* data, size_t size, Kind kind) {
+        return { XXH3_64bits(data, size), size, kind };
+    }
+
+    /// @brief Size of the pixel buffer, high bit depth images (JPEG XL) have 16-bit samples
+    static size_t imageBytes(DecodedImage const& image) {
+        size_t bytesPerPixel = (image.hasAlpha ? 4 : 3) * (image.bit_depth > 8 ? 2 : 1);
+        return static_cast<size_t>(image.width) * image.height * bytesPerPixel;
+    }
+
+    Result<DecodedImage> DecodeCache::copyImage(DecodedImage const& image) {
+        size_t size = imageBytes(image);
+        DecodedImage copy;
+        copy.data = BufferPool::get().acquire(size);
+        if (!copy.data)
+            return Err("Failed to allocate memory for cached image");
+
+        std::memcpy(copy.data.get(), image.data.get(), size);
+        copy.width = image.width;
+        copy.height = image.height;
+        copy.bit_depth = image.bit_depth;
+        copy.hasAlpha = image.hasAlpha;
+        copy.isPreMultiplied = image.isPreMultiplied;
+        return Ok(std::move(copy));
+    }
+
+    void DecodeCache::setBudget(size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        m_budget = bytes;
+        this->evict();
+    }
+
+    DecodeCache::EntryPtr DecodeCache::find(Key const& key) {
+        std::lock_guard lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            ++m_misses;
+            return nullptr;
+        }
+
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    DecodeCache::EntryPtr DecodeCache::insert(Key const& key, DecodedImage&& image) {
+        auto entry = std::make_shared<Entry>();
+        entry->byteSize = imageBytes(image);
+        entry->image = std::move(image);
+        return this->insert(key, std::move(entry));
+    }
+
+    DecodeCache::EntryPtr DecodeCache::insert(Key const& key, std::shared_ptr<AnimationSource> animation) {
+        auto entry = std::make_shared<Entry>();
+        // first frame and the frame cache, which is what stays in memory while the animation is used
+        entry->byteSize = animation->getFrameSize() * (animation->getCapacity() + 1);
+        entry->animation = std::move(animation);
+        return this->insert(key, std::move(entry));
+    }
+
+    DecodeCache::EntryPtr DecodeCache::insert(Key const& key, std::shared_ptr<Entry> entry) {
+        std::lock_guard lock(m_mutex);
+
+        // someone else decoded the same data in the meantime, so keep sharing the older entry
+        if (auto it = m_entries.find(key); it != m_entries.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->second;
+        }
+
+        if (entry->byteSize > m_budget) return entry;
+
+        m_lru.emplace_front(key, entry);
+        m_entries[key] = m_lru.begin();
+        m_bytes += entry->byteSize;
+        this->evict();
+
+        return entry;
+    }
+
+    void DecodeCache::evict() {
+        while (m_bytes > m_budget && !m_lru.empty()) {
+            auto& [key, entry] = m_lru.back();
+            m_bytes -= entry->byteSize;
+            m_entries.erase(key);
+            m_lru.pop_back();
+        }
+    }
+
+    void DecodeCache::clear() {
+        std::lock_guard lock(m_mutex);
+        m_lru.clear();
+        m_entries.clear();
+        m_bytes = 0;
+    }
+
+    DecodeCache::Stats DecodeCache::getStats() const {
+        std::lock_guard lock(m_mutex);
+        return { m_hits, m_misses, m_entries.size(), m_bytes };
+    }
+}
+
+#ifndef IMAGEPLUS_HEADLESS
+$on_mod(Loaded) {
+    auto& cache = imgp::DecodeCache::get();
+    cache.setBudget(getMod()->getSettingValue<int64_t>("decode-cache-size") << 20);
+    listenForSettingChanges<int64_t>("decode-cache-size", [](int64_t val) {
+        imgp::DecodeCache::get().setBudget(val << 20);
+    });
+}
+#endif
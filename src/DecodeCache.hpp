@@ -0,0 +1,98 @@
+#pragma once
+#include <api.hpp>
+#include "AnimationSource.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace imgp {
+    /// @brief Keeps recently decoded images around, keyed by a hash of the encoded bytes,
+    /// so that identical files (e.g. the same texture shipped under many names) are only decoded once.
+    /// Entries are shared, so an evicted entry stays alive for as long as someone is still using it.
+    class DecodeCache {
+    public:
+        /// @brief What the entry was decoded for, since the same bytes are stored differently for each
+        enum class Kind : uint8_t {
+            Decoded, ///< Straight alpha image, as returned by tryDecode
+            Texture, ///< Premultiplied image or animation source, ready to be used by CCImage
+        };
+
+        struct Key {
+            uint64_t hash = 0;
+            size_t size = 0;
+            Kind kind = Kind::Decoded;
+
+            bool operator==(Key const&) const = default;
+        };
+
+        struct Entry {
+            DecodedImage image; ///< Empty for animations
+            std::shared_ptr<AnimationSource> animation;
+            size_t byteSize = 0;
+        };
+
+        using EntryPtr = std::shared_ptr<Entry const>;
+
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t entries = 0;
+            size_t bytes = 0;
+        };
+
+        static DecodeCache& get();
+
+        DecodeCache(DecodeCache const&) = delete;
+        DecodeCache& operator=(DecodeCache const&) = delete;
+
+        static Key makeKey(void const* data, size_t size, Kind kind);
+
+        /// @brief Copies the pixels of a cached image, for callers that need to own the result
+        static geode::Result<DecodedImage> copyImage(DecodedImage const& image);
+
+        /// @brief Cache is disabled when the byte budget is 0
+        bool isEnabled() const { return m_budget != 0; }
+
+        /// @brief Sets the maximum amount of decoded bytes kept in the cache, evicting the least recently used entries
+        void setBudget(size_t bytes);
+        size_t getBudget() const { return m_budget; }
+
+        /// @return nullptr if there is no entry for the key
+        EntryPtr find(Key const& key);
+
+        /// @brief Stores the image in the cache
+        /// @return The stored entry (or the one that was already there). It's returned even
+        /// if the image doesn't fit the budget, so the caller can always use it in place of the image
+        EntryPtr insert(Key const& key, DecodedImage&& image);
+        EntryPtr insert(Key const& key, std::shared_ptr<AnimationSource> animation);
+
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        DecodeCache() = default;
+
+        struct KeyHash {
+            size_t operator()(Key const& key) const {
+                return static_cast<size_t>(key.hash ^ (static_cast<uint64_t>(key.kind) << 63));
+            }
+        };
+
+        using LruList = std::list<std::pair<Key, EntryPtr>>;
+
+        EntryPtr insert(Key const& key, std::shared_ptr<Entry> entry);
+        void evict();
+
+        mutable std::mutex m_mutex;
+        LruList m_lru; // most recently used first
+        std::unordered_map<Key, LruList::iterator, KeyHash> m_entries;
+        size_t m_bytes = 0;
+        std::atomic<size_t> m_budget = 0;
+        std::atomic<size_t> m_hits = 0;
+        std::atomic<size_t> m_misses = 0;
+    };
+}
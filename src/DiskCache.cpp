@@ -0,0 +1,222 @@
+#include "DiskCache.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+using namespace geode::prelude;
+
+namespace imgp {
+    // bump whenever the layout or the pixel format of entries changes, old entries are then treated as stale
+    constexpr uint32_t ENTRY_VERSION = 1;
+    constexpr std::array<char, 4> ENTRY_MAGIC = {'I', 'P', 'D', 'C'};
+
+    /// @brief Entry file header, pixels follow right after it (so they stay 64-byte aligned in the mapping)
+    struct EntryHeader {
+        std::array<char, 4> magic = ENTRY_MAGIC;
+        uint32_t version = ENTRY_VERSION;
+        uint64_t sourceSize = 0;
+        int64_t sourceMtime = 0;
+        uint64_t contentHash = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint8_t bitDepth = 8;
+        uint8_t hasAlpha = 0;
+        uint8_t reserved[26]{};
+    };
+    static_assert(sizeof(EntryHeader) == 64);
+
+    /// @note High bit depth images (JPEG XL) have 16-bit samples
+    static size_t pixelBytes(uint16_t width, uint16_t height, uint8_t bitDepth, bool hasAlpha) {
+        return static_cast<size_t>(width) * height * (hasAlpha ? 4 : 3) * (bitDepth > 8 ? 2 : 1);
+    }
+
+    DiskCache& DiskCache::get() {
+        static DiskCache instance;
+        return instance;
+    }
+
+    std::optional<DiskCache::Source> DiskCache::describe(std::filesystem::path const& path) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path, ec);
+        if (ec) return std::nullopt;
+
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) return std::nullopt;
+
+        return Source{ path, size, static_cast<int64_t>(mtime.time_since_epoch().count()) };
+    }
+
+    std::filesystem::path DiskCache::getDirectory() const {
+        static auto directory = getMod()->getSaveDir() / "decode-cache";
+        return directory;
+    }
+
+    std::filesystem::path DiskCache::getEntryPath(Source const& source) const {
+        auto const& name = source.path.native();
+        auto hash = XXH3_64bits(name.data(), name.size() * sizeof(name[0]));
+        return this->getDirectory() / fmt::format("{:016x}.bin", hash);
+    }
+
+    void DiskCache::setMaxSize(size_t bytes) {
+        m_maxSize = bytes;
+
+        std::error_code ec;
+        if (!std::filesystem::exists(this->getDirectory(), ec)) return;
+
+        std::lock_guard lock(m_mutex);
+        this->trim();
+    }
+
+    std::shared_ptr<DiskCache::Entry> DiskCache::find(Source const& source) {
+        auto path = this->getEntryPath(source);
+
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) return nullptr;
+
+        auto mapped = MappedFile::open(path, MappedFile::Mode::CopyOnWrite);
+        if (mapped.isErr()) return nullptr;
+        auto file = std::move(mapped).unwrap();
+
+        EntryHeader header;
+        bool valid = file->size() >= sizeof(header);
+        if (valid) {
+            std::memcpy(&header, file->data(), sizeof(header));
+            valid = header.magic == ENTRY_MAGIC && header.version == ENTRY_VERSION
+                 && header.sourceSize == source.size && header.sourceMtime == source.mtime
+                 && header.contentHash == source.hash
+                 && file->size() == sizeof(header) + pixelBytes(header.width, header.height, header.bitDepth, header.hasAlpha);
+        }
+
+        if (!valid) {
+            // source file was changed (or the entry is from an older version), so it's useless now
+            file.reset();
+
+            std::lock_guard lock(m_mutex);
+            auto size = std::filesystem::file_size(path, ec);
+            if (std::filesystem::remove(path, ec) && m_totalSize && !ec) {
+                *m_totalSize -= std::min(*m_totalSize, static_cast<size_t>(size));
+            }
+            return nullptr;
+        }
+
+        // modification time of entries doubles as their last use time for eviction
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        auto entry = std::make_shared<Entry>();
+        entry->pixels = file->data() + sizeof(header);
+        entry->file = std::move(file);
+        entry->width = header.width;
+        entry->height = header.height;
+        entry->bitDepth = header.bitDepth;
+        entry->hasAlpha = header.hasAlpha;
+        return entry;
+    }
+
+    void DiskCache::store(Source const& source, DecodedImage const& image) {
+        if (!this->isEnabled() || !image) return;
+
+        size_t entrySize = sizeof(EntryHeader) + pixelBytes(image.width, image.height, image.bit_depth, image.hasAlpha);
+        if (entrySize > m_maxSize) return;
+
+        std::error_code ec;
+        std::filesystem::create_directories(this->getDirectory(), ec);
+        if (ec) return;
+
+        EntryHeader header;
+        header.sourceSize = source.size;
+        header.sourceMtime = source.mtime;
+        header.contentHash = source.hash;
+        header.width = image.width;
+        header.height = image.height;
+        header.bitDepth = image.bit_depth;
+        header.hasAlpha = image.hasAlpha;
+
+        // written to a temporary file first, so a crash never leaves a truncated entry behind
+        auto path = this->getEntryPath(source);
+        auto temp = path;
+        temp += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+            out.write(reinterpret_cast<char const*>(image.data.get()), entrySize - sizeof(header));
+            if (!out) {
+                out.close();
+                std::filesystem::remove(temp, ec);
+                log::warn("Failed to write decode cache entry");
+                return;
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        auto oldSize = std::filesystem::file_size(path, ec);
+        bool replaced = !ec;
+
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            // entry is probably mapped by another image right now
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+
+        if (!m_totalSize) {
+            this->trim();
+            return;
+        }
+
+        *m_totalSize += entrySize;
+        if (replaced) *m_totalSize -= std::min(*m_totalSize, static_cast<size_t>(oldSize));
+        if (*m_totalSize > m_maxSize) this->trim();
+    }
+
+    void DiskCache::trim() {
+        struct File {
+            std::filesystem::path path;
+            size_t size;
+            std::filesystem::file_time_type lastUse;
+        };
+
+        std::vector<File> files;
+        size_t total = 0;
+
+        std::error_code ec;
+        for (auto const& item : std::filesystem::directory_iterator(this->getDirectory(), ec)) {
+            if (!item.is_regular_file(ec) || item.path().extension() != ".bin") continue;
+
+            File file{ item.path(), static_cast<size_t>(item.file_size(ec)), item.last_write_time(ec) };
+            if (ec) continue;
+
+            total += file.size;
+            files.push_back(std::move(file));
+        }
+
+        std::sort(files.begin(), files.end(), [](File const& a, File const& b) {
+            return a.lastUse < b.lastUse;
+        });
+
+        size_t maxSize = m_maxSize;
+        for (auto const& file : files) {
+            if (total <= maxSize) break;
+            if (std::filesystem::remove(file.path, ec)) {
+                total -= file.size;
+            }
+        }
+
+        m_totalSize = total;
+    }
+}
+
+$on_mod(Loaded) {
+    imgp::DiskCache::get().setMaxSize(getMod()->getSettingValue<int64_t>("disk-cache-size") << 20);
+    listenForSettingChanges<int64_t>("disk-cache-size", [](int64_t val) {
+        imgp::DiskCache::get().setMaxSize(val << 20);
+    });
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <api.hpp>
+#include "MappedFile.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace imgp {
+    /// @brief Stores decoded (and premultiplied) pixels of image files on disk, so that the next launch
+    /// can map them straight into memory instead of decoding the files again.
+    /// Entries are keyed by the source path and validated against its size, modification time and content hash.
+    class DiskCache {
+    public:
+        /// @brief Identity of the file an image was loaded from
+        struct Source {
+            std::filesystem::path path;
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            uint64_t hash = 0; ///< Hash of the file contents, filled in once the data is read
+        };
+
+        /// @brief Decoded image mapped from the cache
+        struct Entry {
+            std::unique_ptr<MappedFile> file;
+            uint8_t* pixels = nullptr; ///< Points into the (copy-on-write) mapping
+            uint16_t width = 0;
+            uint16_t height = 0;
+            uint8_t bitDepth = 8;
+            bool hasAlpha = false;
+        };
+
+        static DiskCache& get();
+
+        DiskCache(DiskCache const&) = delete;
+        DiskCache& operator=(DiskCache const&) = delete;
+
+        /// @brief Looks up the size and modification time of a file
+        /// @return std::nullopt if the file is not on the regular filesystem (e.g. packed into the APK)
+        static std::optional<Source> describe(std::filesystem::path const& path);
+
+        /// @brief Cache is disabled when the size limit is 0
+        bool isEnabled() const { return m_maxSize != 0; }
+
+        /// @brief Sets the maximum size of the cache directory, removing the least recently used entries.
+        /// Setting it to 0 disables the cache and removes everything
+        void setMaxSize(size_t bytes);
+
+        /// @brief Returns the cached image, removing the entry if it's stale
+        /// @return nullptr on a miss
+        std::shared_ptr<Entry> find(Source const& source);
+
+        /// @brief Writes the premultiplied image to the cache
+        void store(Source const& source, DecodedImage const& image);
+
+    private:
+        DiskCache() = default;
+
+        std::filesystem::path getDirectory() const;
+        std::filesystem::path getEntryPath(Source const& source) const;
+
+        /// @brief Removes the least recently used entries until the cache fits the limit
+        void trim();
+
+        std::mutex m_mutex;
+        std::atomic<size_t> m_maxSize = 0;
+        std::optional<size_t> m_totalSize; // computed on first use
+    };
+}
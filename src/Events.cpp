@@ -6,7 +6,7 @@ using namespace imgp::v1;
 using namespace imgp::__detail;
 
 static FunctionTable functionTable = {
-    .version = 2,
+    .version = 10,
     .guessFormat = &guessFormat,
     .tryDecode = &tryDecode,
 
@@ -55,16 +55,54 @@ static FunctionTable functionTable = {
 
     // == Static Image Decoding (header only) == //
     .decodePngHeader = &decode::pngHeader,
-    .decodeQoiHeader = nullptr, // not implemented
+    .decodeQoiHeader = &decode::qoiHeader,
 
     // == Animated Image Decoding (header only) == //
-    .decodeJpegXLHeader = nullptr, // not implemented
+    .decodeJpegXLHeader = &decode::jpegxlHeader,
     .decodeWebpHeader = &decode::webpHeader,
-    .decodeGifHeader = nullptr, // not implemented
+    .decodeGifHeader = &decode::gifHeader,
 
     // == Static Image Decoding (into a user-provided buffer) == //
     .decodePngInto = &decode::pngInto,
-    .decodeQoiInto = nullptr, // not implemented
+    .decodeQoiInto = &decode::qoiInto,
+
+    // == Threading == //
+    .setMaxThreads = &setMaxThreads,
+    .getMaxThreads = &getMaxThreads,
+
+    // == Metadata == //
+    .getImageInfo = &getImageInfo,
+
+    // == Animated Image Decoding (into a user-provided buffer) == //
+    .decodeJpegXLInto = &decode::jpegxlInto,
+    .decodeWebpInto = &decode::webpInto,
+    .decodeGifInto = &decode::gifInto,
+
+    // == Memory == //
+    .tryDecodeWith = &tryDecodeWith,
+    .setPixelAllocator = &setPixelAllocator,
+
+    // == Batch Decoding == //
+    .tryDecodeBatch = &tryDecodeBatch,
+
+    // == Encoding with options == //
+    .encodePngWith = &encode::png,
+    .encodeWebpWith = &encode::webp,
+    .encodeJpegXLWith = &encode::jpegxl,
+    .encodeWebpAnimWith = &encode::webp,
+    .encodeJpegXLAnimWith = &encode::jpegxl,
+
+    // == Encoding into an OutputSink == //
+    .encodePngTo = &encode::pngTo,
+    .encodeQoiTo = &encode::qoiTo,
+    .encodeWebpTo = &encode::webpTo,
+    .encodeJpegXLTo = &encode::jpegxlTo,
+    .encodeWebpAnimTo = &encode::webpTo,
+    .encodeJpegXLAnimTo = &encode::jpegxlTo,
+
+    // == Statistics == //
+    .getCodecStats = &getCodecStats,
+    .resetCodecStats = &resetCodecStats,
 };
 
 $on_mod(Loaded) {
@@ -0,0 +1,61 @@
+#include "FrameArena.hpp"
+
+namespace imgp {
+    // keeps every slot aligned for the SIMD pixel kernels
+    constexpr size_t SLOT_ALIGNMENT = 64;
+
+    std::shared_ptr<FrameArena> FrameArena::create(std::span<size_t const> sizes) {
+        std::shared_ptr<FrameArena> arena(new FrameArena());
+        arena->m_sizes.assign(sizes.begin(), sizes.end());
+        arena->m_offsets.reserve(sizes.size() + 1);
+
+        size_t offset = 0;
+        for (auto size : sizes) {
+            arena->m_offsets.push_back(offset);
+            offset += (size + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+        }
+        arena->m_offsets.push_back(offset);
+
+        // allocators only have to guarantee fundamental alignment, so the block is padded to align it manually
+        arena->m_data = allocatePixels(offset + SLOT_ALIGNMENT);
+        if (!arena->m_data) return nullptr;
+
+        auto address = reinterpret_cast<uintptr_t>(arena->m_data.get());
+        size_t shift = (SLOT_ALIGNMENT - address % SLOT_ALIGNMENT) % SLOT_ALIGNMENT;
+        for (auto& slotOffset : arena->m_offsets) {
+            slotOffset += shift;
+        }
+
+        // slots are handed out from the front
+        arena->m_free.reserve(sizes.size());
+        for (size_t i = sizes.size(); i > 0; --i) {
+            arena->m_free.push_back(i - 1);
+        }
+
+        return arena;
+    }
+
+    std::shared_ptr<FrameArena> FrameArena::create(size_t slotSize, size_t count) {
+        std::vector<size_t> sizes(count, slotSize);
+        return create(sizes);
+    }
+
+    FrameArena::Frame FrameArena::acquire() {
+        size_t index;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_free.empty()) return nullptr;
+            index = m_free.back();
+            m_free.pop_back();
+        }
+
+        return Frame(this->getSlot(index), [self = this->shared_from_this(), index](uint8_t*) {
+            self->release(index);
+        });
+    }
+
+    void FrameArena::release(size_t index) {
+        std::lock_guard lock(m_mutex);
+        m_free.push_back(index);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "PixelMemory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace imgp {
+    /// @brief Single allocation split into frame slots, so that an animation doesn't need
+    /// a separate heap block for every frame (which fragments the heap badly on 32-bit devices).
+    /// Frames handed out by acquire() are views that keep the arena alive, the whole block is freed at once
+    /// when the arena and all of its frames are gone.
+    class FrameArena : public std::enable_shared_from_this<FrameArena> {
+    public:
+        using Frame = std::shared_ptr<uint8_t[]>;
+
+        /// @brief Allocates slots with the given sizes back to back
+        /// @return nullptr if the allocation failed
+        static std::shared_ptr<FrameArena> create(std::span<size_t const> sizes);
+
+        /// @brief Allocates the given amount of equally sized slots
+        /// @return nullptr if the allocation failed
+        static std::shared_ptr<FrameArena> create(size_t slotSize, size_t count);
+
+        FrameArena(FrameArena const&) = delete;
+        FrameArena& operator=(FrameArena const&) = delete;
+
+        size_t getSlotCount() const { return m_offsets.size() - 1; }
+        size_t getSlotSize(size_t index) const { return m_sizes[index]; }
+        size_t getByteSize() const { return m_offsets.back(); }
+
+        /// @brief Direct pointer to the slot, valid for as long as the arena is alive
+        uint8_t* getSlot(size_t index) const { return m_data.get() + m_offsets[index]; }
+
+        /// @brief Takes a free slot, which is given back once the returned frame (and all of its copies) is released
+        /// @return nullptr if every slot is in use
+        Frame acquire();
+
+    private:
+        FrameArena() = default;
+
+        void release(size_t index);
+
+        PixelBuffer m_data;
+        std::vector<size_t> m_offsets; // one extra entry at the end, holding the total size
+        std::vector<size_t> m_sizes;
+
+        std::mutex m_mutex;
+        std::vector<size_t> m_free;
+    };
+}
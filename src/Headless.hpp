@@ -0,0 +1,18 @@
+#pragma once
+#ifdef IMAGEPLUS_HEADLESS
+#include <fmt/format.h>
+
+#include <cstdio>
+#include <utility>
+
+// Stand-ins for the few Geode pieces the codecs use, for builds without the Geode SDK (see IMAGEPLUS_HEADLESS)
+
+#define GEODE_IOS(...)
+
+namespace geode::log {
+    template <typename... Args>
+    void warn(fmt::format_string<Args...> format, Args&&... args) {
+        fmt::print(stderr, "[ImagePlus] {}\n", fmt::format(format, std::forward<Args>(args)...));
+    }
+}
+#endif
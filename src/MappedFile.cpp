@@ -0,0 +1,83 @@
+#include "MappedFile.hpp"
+
+#include <Geode/platform/cplatform.h>
+#include <fmt/format.h>
+
+#ifdef GEODE_IS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace geode;
+
+namespace imgp {
+#ifdef GEODE_IS_WINDOWS
+    Result<std::unique_ptr<MappedFile>> MappedFile::open(std::filesystem::path const& path, Mode mode) {
+        HANDLE file = CreateFileW(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE)
+            return Err(fmt::format("Failed to open file (error {})", GetLastError()));
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return Err("Failed to map file: file is empty");
+        }
+
+        bool copy = mode == Mode::CopyOnWrite;
+        HANDLE mapping = CreateFileMappingW(file, nullptr, copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file); // the mapping keeps its own reference
+        if (!mapping)
+            return Err(fmt::format("Failed to map file (error {})", GetLastError()));
+
+        void* view = MapViewOfFile(mapping, copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping); // same for the view
+        if (!view)
+            return Err(fmt::format("Failed to map file (error {})", GetLastError()));
+
+        std::unique_ptr<MappedFile> mapped(new MappedFile());
+        mapped->m_data = static_cast<uint8_t*>(view);
+        mapped->m_size = static_cast<size_t>(size.QuadPart);
+        return Ok(std::move(mapped));
+    }
+
+    MappedFile::~MappedFile() {
+        if (m_data) UnmapViewOfFile(m_data);
+    }
+#else
+    Result<std::unique_ptr<MappedFile>> MappedFile::open(std::filesystem::path const& path, Mode mode) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return Err(fmt::format("Failed to open file (errno {})", errno));
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return Err("Failed to map file: file is empty");
+        }
+
+        size_t size = static_cast<size_t>(info.st_size);
+        bool copy = mode == Mode::CopyOnWrite;
+        void* view = mmap(nullptr, size, copy ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference
+        if (view == MAP_FAILED)
+            return Err(fmt::format("Failed to map file (errno {})", errno));
+
+        std::unique_ptr<MappedFile> mapped(new MappedFile());
+        mapped->m_data = static_cast<uint8_t*>(view);
+        mapped->m_size = size;
+        return Ok(std::move(mapped));
+    }
+
+    MappedFile::~MappedFile() {
+        if (m_data) munmap(m_data, m_size);
+    }
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <Geode/Result.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace imgp {
+    /// @brief File mapped into memory, unmapped when the object is destroyed
+    class MappedFile {
+    public:
+        enum class Mode {
+            ReadOnly,    ///< Writing to the mapping crashes
+            CopyOnWrite, ///< Writes go to private copies of the touched pages, the file is never modified
+        };
+
+        /// @brief Maps the whole file
+        /// @note Empty files can't be mapped and return an error
+        static geode::Result<std::unique_ptr<MappedFile>> open(std::filesystem::path const& path, Mode mode = Mode::ReadOnly);
+
+        ~MappedFile();
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        uint8_t* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+    private:
+        MappedFile() = default;
+
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -0,0 +1,150 @@
+#include "Metrics.hpp"
+
+#ifndef IMAGEPLUS_HEADLESS
+#include "BufferPool.hpp"
+#include "DecodeCache.hpp"
+
+#include <Geode/Geode.hpp>
+#endif
+
+#include <bit>
+
+namespace imgp {
+    Metrics::Scope::~Scope() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        Metrics::get().record(m_format, m_op, m_succeeded, m_bytesIn, m_bytesOut, m_pixels, static_cast<uint64_t>(micros));
+    }
+
+    Metrics& Metrics::get() {
+        static Metrics instance;
+        return instance;
+    }
+
+    Metrics::Counters& Metrics::counters(ImageFormat format, Op op) {
+        auto index = static_cast<size_t>(format);
+        if (index >= FORMAT_COUNT) index = static_cast<size_t>(ImageFormat::Unknown);
+        return m_counters[index * 2 + static_cast<size_t>(op)];
+    }
+
+    Metrics::Counters const& Metrics::counters(ImageFormat format, Op op) const {
+        return const_cast<Metrics*>(this)->counters(format, op);
+    }
+
+    void Metrics::record(
+        ImageFormat format, Op op, bool succeeded, size_t bytesIn, size_t bytesOut, uint64_t pixels, uint64_t micros
+    ) {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        auto& counters = this->counters(format, op);
+        counters.calls.fetch_add(1, relaxed);
+        counters.bytesIn.fetch_add(bytesIn, relaxed);
+        counters.totalMicros.fetch_add(micros, relaxed);
+        counters.latency[std::min<size_t>(std::bit_width(micros), CodecStats::LATENCY_BUCKETS - 1)].fetch_add(1, relaxed);
+
+        if (succeeded) {
+            counters.bytesOut.fetch_add(bytesOut, relaxed);
+            counters.pixels.fetch_add(pixels, relaxed);
+        } else {
+            counters.failures.fetch_add(1, relaxed);
+        }
+    }
+
+    CodecStats Metrics::Counters::snapshot() const {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        CodecStats stats;
+        stats.calls = calls.load(relaxed);
+        stats.failures = failures.load(relaxed);
+        stats.bytesIn = bytesIn.load(relaxed);
+        stats.bytesOut = bytesOut.load(relaxed);
+        stats.pixels = pixels.load(relaxed);
+        stats.totalMicros = totalMicros.load(relaxed);
+        for (size_t i = 0; i < CodecStats::LATENCY_BUCKETS; ++i) {
+            stats.latency[i] = latency[i].load(relaxed);
+        }
+        return stats;
+    }
+
+    void Metrics::Counters::reset() {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        for (auto* counter : { &calls, &failures, &bytesIn, &bytesOut, &pixels, &totalMicros }) {
+            counter->store(0, relaxed);
+        }
+        for (auto& bucket : latency) {
+            bucket.store(0, relaxed);
+        }
+    }
+
+    FormatStats Metrics::getStats(ImageFormat format) const {
+        return { this->counters(format, Op::Decode).snapshot(), this->counters(format, Op::Encode).snapshot() };
+    }
+
+    void Metrics::reset() {
+        for (auto& counters : m_counters) {
+            counters.reset();
+        }
+    }
+
+    std::pair<size_t, uint64_t> Metrics::measure(DecodedResult const& result) {
+        if (auto image = std::get_if<DecodedImage>(&result)) {
+            uint64_t pixels = static_cast<uint64_t>(image->width) * image->height;
+            size_t bytesPerPixel = (image->hasAlpha ? 4 : 3) * (image->bit_depth > 8 ? 2 : 1);
+            return { pixels * bytesPerPixel, pixels };
+        }
+
+        auto& anim = std::get<DecodedAnimation>(result);
+        uint64_t pixels = static_cast<uint64_t>(anim.width) * anim.height * anim.frames.size();
+        return { pixels * (anim.hasAlpha ? 4 : 3), pixels };
+    }
+}
+
+IMAGE_PLUS_BEGIN_NAMESPACE
+    FormatStats getCodecStats(ImageFormat format) {
+        return Metrics::get().getStats(format);
+    }
+
+    void resetCodecStats() {
+        Metrics::get().reset();
+    }
+IMAGE_PLUS_END_NAMESPACE
+
+#ifndef IMAGEPLUS_HEADLESS
+static void logCodecStats() {
+    using namespace imgp;
+    constexpr double MiB = 1024.0 * 1024.0;
+
+    geode::log::info("Codec stats:");
+    for (auto format : { ImageFormat::Png, ImageFormat::Qoi, ImageFormat::Webp, ImageFormat::JpegXL,
+                         ImageFormat::Gif, ImageFormat::CgBI, ImageFormat::Unknown }) {
+        auto stats = getCodecStats(format);
+        for (auto [name, op] : { std::pair{"decode", &stats.decode}, std::pair{"encode", &stats.encode} }) {
+            if (op->calls == 0) continue;
+            geode::log::info(
+                "{} {}: {} calls, {} failed, {:.2f} MiB in, {:.2f} MiB out, {:.2f} Mpx, "
+                "{:.2f} ms avg, p50 < {:.2f} ms, p99 < {:.2f} ms",
+                format, name, op->calls, op->failures, op->bytesIn / MiB, op->bytesOut / MiB, op->pixels / 1e6,
+                op->totalMicros / 1000.0 / op->calls, op->latencyPercentile(0.5) / 1000.0,
+                op->latencyPercentile(0.99) / 1000.0
+            );
+        }
+    }
+
+    auto cache = DecodeCache::get().getStats();
+    geode::log::info(
+        "Decode cache: {} hits, {} misses, {} entries, {:.2f} MiB",
+        cache.hits, cache.misses, cache.entries, cache.bytes / MiB
+    );
+
+    auto pool = BufferPool::get().getStats();
+    geode::log::info(
+        "Buffer pool: {} hits, {} misses, {} evictions, {} buffers, {:.2f} MiB",
+        pool.hits, pool.misses, pool.evictions, pool.buffers, pool.bytes / MiB
+    );
+}
+
+$on_mod(Loaded) {
+    // works like a button: every time the setting is turned on, the current numbers are logged
+    listenForSettingChanges<bool>("log-codec-stats", [](bool val) {
+        if (val) logCodecStats();
+    });
+}
+#endif
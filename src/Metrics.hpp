@@ -0,0 +1,82 @@
+#pragma once
+#include <api.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+namespace imgp {
+    /// @brief Always-on per-format counters for decodes and encodes, read through getCodecStats.
+    /// Recording is a handful of relaxed atomic adds, so it's cheap enough to leave on for every call.
+    class Metrics {
+    public:
+        enum class Op : uint8_t {
+            Decode,
+            Encode,
+        };
+
+        /// @brief Times a single codec call. It's recorded as failed when the scope ends, unless succeed was called
+        class Scope {
+        public:
+            Scope(ImageFormat format, Op op, size_t bytesIn)
+                : m_start(std::chrono::steady_clock::now()), m_bytesIn(bytesIn), m_format(format), m_op(op) {}
+            ~Scope();
+
+            Scope(Scope const&) = delete;
+            Scope& operator=(Scope const&) = delete;
+
+            void succeed(size_t bytesOut, uint64_t pixels) {
+                m_bytesOut = bytesOut;
+                m_pixels = pixels;
+                m_succeeded = true;
+            }
+
+        private:
+            std::chrono::steady_clock::time_point m_start;
+            size_t m_bytesIn;
+            size_t m_bytesOut = 0;
+            uint64_t m_pixels = 0;
+            ImageFormat m_format;
+            Op m_op;
+            bool m_succeeded = false;
+        };
+
+        static Metrics& get();
+
+        Metrics(Metrics const&) = delete;
+        Metrics& operator=(Metrics const&) = delete;
+
+        void record(ImageFormat format, Op op, bool succeeded, size_t bytesIn, size_t bytesOut, uint64_t pixels, uint64_t micros);
+
+        FormatStats getStats(ImageFormat format) const;
+        void reset();
+
+        /// @brief Size of the pixels in a decode result, and how many there are (every frame counts)
+        static std::pair<size_t, uint64_t> measure(DecodedResult const& result);
+
+    private:
+        Metrics() = default;
+
+        struct Counters {
+            std::atomic<uint64_t> calls = 0;
+            std::atomic<uint64_t> failures = 0;
+            std::atomic<uint64_t> bytesIn = 0;
+            std::atomic<uint64_t> bytesOut = 0;
+            std::atomic<uint64_t> pixels = 0;
+            std::atomic<uint64_t> totalMicros = 0;
+            std::array<std::atomic<uint64_t>, CodecStats::LATENCY_BUCKETS> latency{};
+
+            CodecStats snapshot() const;
+            void reset();
+        };
+
+        // indexed by ImageFormat, anything out of range is counted as Unknown
+        static constexpr size_t FORMAT_COUNT = static_cast<size_t>(ImageFormat::CgBI) + 1;
+
+        Counters& counters(ImageFormat format, Op op);
+        Counters const& counters(ImageFormat format, Op op) const;
+
+        std::array<Counters, FORMAT_COUNT * 2> m_counters;
+    };
+}
@@ -0,0 +1,687 @@
+#include "PixelKernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define IMGP_PIXELS_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define IMGP_TARGET_AVX2
+    #else
+        #include <cpuid.h>
+        #define IMGP_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define IMGP_PIXELS_NEON 1
+    #include <arm_neon.h>
+#endif
+
+namespace imgp::pixels {
+    // == Scalar == //
+
+    namespace scalar {
+        static void premultiply(uint8_t* rgba, size_t count) {
+            for (size_t i = 0; i < count; ++i, rgba += 4) {
+                uint32_t a = rgba[3];
+                rgba[0] = static_cast<uint8_t>(rgba[0] * a / 255);
+                rgba[1] = static_cast<uint8_t>(rgba[1] * a / 255);
+                rgba[2] = static_cast<uint8_t>(rgba[2] * a / 255);
+            }
+        }
+
+        static void unpremultiply(uint8_t* rgba, size_t count) {
+            for (size_t i = 0; i < count; ++i, rgba += 4) {
+                uint32_t a = rgba[3];
+                if (a == 255) continue;
+                if (a == 0) {
+                    rgba[0] = rgba[1] = rgba[2] = 0;
+                    continue;
+                }
+
+                for (size_t c = 0; c < 3; ++c) {
+                    rgba[c] = static_cast<uint8_t>(std::min<uint32_t>((rgba[c] * 255 + a / 2) / a, 255));
+                }
+            }
+        }
+
+        static void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) {
+            for (size_t i = 0; i < count; ++i, rgb += 3, rgba += 4) {
+                rgba[0] = rgb[0];
+                rgba[1] = rgb[1];
+                rgba[2] = rgb[2];
+                rgba[3] = 255;
+            }
+        }
+
+        static void swapRedBlue(uint8_t const* src, uint8_t* dst, size_t count) {
+            for (size_t i = 0; i < count; ++i, src += 4, dst += 4) {
+                uint8_t r = src[0];
+                uint8_t b = src[2];
+                dst[0] = b;
+                dst[1] = src[1];
+                dst[2] = r;
+                dst[3] = src[3];
+            }
+        }
+
+        static bool isOpaque(uint8_t const* rgba, size_t count) {
+            uint8_t acc = 255;
+            for (size_t i = 0; i < count; ++i) {
+                acc &= rgba[i * 4 + 3];
+            }
+            return acc == 255;
+        }
+
+        /// @brief Reference blend, every other implementation has to match it bit for bit
+        static void blendPixel(uint8_t* dst, uint8_t const* src) {
+            uint8_t rs = src[0], gs = src[1], bs = src[2], as = src[3];
+            if (as == 255) {
+                dst[0] = rs; dst[1] = gs; dst[2] = bs; dst[3] = 255;
+            } else if (as > 0) {
+                // products are kept in separate statements, so that they are never fused into an FMA
+                float alpha = as / 255.0f;
+                float inverse = 1 - alpha;
+                uint8_t const colors[3] = { rs, gs, bs };
+                for (size_t c = 0; c < 3; ++c) {
+                    float d = dst[c] * inverse;
+                    float s = colors[c] * alpha;
+                    dst[c] = static_cast<uint8_t>(d + s);
+                }
+                dst[3] = dst[3] < as ? as : dst[3];
+            }
+        }
+
+        static void blendAlpha(uint8_t* dst, uint8_t const* src, size_t count) {
+            for (size_t i = 0; i < count; ++i, dst += 4, src += 4) {
+                blendPixel(dst, src);
+            }
+        }
+
+        static constexpr Kernels kernels {
+            .name = "scalar",
+            .premultiply = &premultiply,
+            .unpremultiply = &unpremultiply,
+            .rgbToRgba = &rgbToRgba,
+            .swapRedBlue = &swapRedBlue,
+            .isOpaque = &isOpaque,
+            .blendAlpha = &blendAlpha,
+        };
+    }
+
+    // Fixed-point blending computes floor((d * (255 - a) + s * a) / 255), which is what the float
+    // reference produces whenever the exact result is not a whole number (it's always at least 1/255 away,
+    // far more than the float rounding error). When it is a whole number, the float sum can land just below it,
+    // so such channels (rare outside of d == s) are redone with the reference blend.
+
+#ifdef IMGP_PIXELS_X86
+    // == SSE2 == //
+
+    namespace sse2 {
+        /// @brief floor(x / 255) for every 16-bit lane, exact for x <= 65025
+        static __m128i div255(__m128i x) {
+            x = _mm_add_epi16(x, _mm_add_epi16(_mm_set1_epi16(1), _mm_srli_epi16(x, 8)));
+            return _mm_srli_epi16(x, 8);
+        }
+
+        /// @brief Premultiplies two pixels widened to 16 bits
+        static __m128i premultiplyWide(__m128i px) {
+            // broadcast alpha to every channel, and multiply alpha itself by 255
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xFF), 0xFF);
+            __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+            alpha = _mm_or_si128(_mm_andnot_si128(alphaMask, alpha), _mm_and_si128(alphaMask, _mm_set1_epi16(255)));
+            return div255(_mm_mullo_epi16(px, alpha));
+        }
+
+        static void premultiply(uint8_t* rgba, size_t count) {
+            __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4, rgba += 16) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<__m128i const*>(rgba));
+                __m128i lo = premultiplyWide(_mm_unpacklo_epi8(px, zero));
+                __m128i hi = premultiplyWide(_mm_unpackhi_epi8(px, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), _mm_packus_epi16(lo, hi));
+            }
+            scalar::premultiply(rgba, count - i);
+        }
+
+        /// @brief Unpremultiplies a single pixel widened to 32 bits
+        static __m128i unpremultiplyPixel(__m128i px) {
+            __m128 value = _mm_cvtepi32_ps(px);
+            __m128 alpha = _mm_cvtepi32_ps(_mm_shuffle_epi32(px, 0xFF));
+            __m128 half = _mm_cvtepi32_ps(_mm_srli_epi32(_mm_shuffle_epi32(px, 0xFF), 1));
+
+            // (c * 255 + a / 2) / a, every intermediate is exactly representable,
+            // and the quotient is never close enough to an integer to be rounded across it
+            __m128 result = _mm_div_ps(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.f)), half), alpha);
+            result = _mm_min_ps(result, _mm_set1_ps(255.f));
+            __m128i out = _mm_cvttps_epi32(result);
+
+            // keep alpha as is, and zero out fully transparent pixels
+            __m128i alphaMask = _mm_set_epi32(-1, 0, 0, 0);
+            out = _mm_or_si128(_mm_andnot_si128(alphaMask, out), _mm_and_si128(alphaMask, px));
+            __m128i transparent = _mm_cmpeq_epi32(_mm_shuffle_epi32(px, 0xFF), _mm_setzero_si128());
+            return _mm_andnot_si128(transparent, out);
+        }
+
+        static void unpremultiply(uint8_t* rgba, size_t count) {
+            __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4, rgba += 16) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<__m128i const*>(rgba));
+                __m128i lo = _mm_unpacklo_epi8(px, zero);
+                __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+                __m128i p0 = unpremultiplyPixel(_mm_unpacklo_epi16(lo, zero));
+                __m128i p1 = unpremultiplyPixel(_mm_unpackhi_epi16(lo, zero));
+                __m128i p2 = unpremultiplyPixel(_mm_unpacklo_epi16(hi, zero));
+                __m128i p3 = unpremultiplyPixel(_mm_unpackhi_epi16(hi, zero));
+
+                __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), packed);
+            }
+            scalar::unpremultiply(rgba, count - i);
+        }
+
+        static void swapRedBlue(uint8_t const* src, uint8_t* dst, size_t count) {
+            __m128i greenAlpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+            __m128i low = _mm_set1_epi32(0xFF);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4, src += 16, dst += 16) {
+                __m128i px = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src));
+                __m128i r = _mm_slli_epi32(_mm_and_si128(px, low), 16);
+                __m128i b = _mm_and_si128(_mm_srli_epi32(px, 16), low);
+                __m128i out = _mm_or_si128(_mm_and_si128(px, greenAlpha), _mm_or_si128(r, b));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+            }
+            scalar::swapRedBlue(src, dst, count - i);
+        }
+
+        static bool isOpaque(uint8_t const* rgba, size_t count) {
+            __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+            __m128i ones = _mm_set1_epi32(-1);
+            size_t i = 0;
+            while (i + 16 <= count) {
+                // check in blocks, so that we can bail out early without testing every vector
+                __m128i acc = ones;
+                for (size_t j = 0; j < 4; ++j, i += 4, rgba += 16) {
+                    acc = _mm_and_si128(acc, _mm_loadu_si128(reinterpret_cast<__m128i const*>(rgba)));
+                }
+                acc = _mm_or_si128(acc, colorMask);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, ones)) != 0xFFFF) return false;
+            }
+            return scalar::isOpaque(rgba, count - i);
+        }
+
+        /// @brief Blends a single pixel widened to 32 bits with the same float operations as the reference
+        static __m128i blendFloatPixel(__m128i dst, __m128i src, __m128 alpha) {
+            __m128 inverse = _mm_sub_ps(_mm_set1_ps(1.f), alpha);
+            __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(dst), inverse);
+            __m128 s = _mm_mul_ps(_mm_cvtepi32_ps(src), alpha);
+            return _mm_cvttps_epi32(_mm_add_ps(d, s));
+        }
+
+        /// @brief Reference blend of 4 pixels, only the color channels of the result are meaningful
+        static __m128i blendFloat(__m128i dst, __m128i src) {
+            __m128i zero = _mm_setzero_si128();
+            __m128 alpha = _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(src, 24)), _mm_set1_ps(255.f));
+
+            __m128i dstLo = _mm_unpacklo_epi8(dst, zero), dstHi = _mm_unpackhi_epi8(dst, zero);
+            __m128i srcLo = _mm_unpacklo_epi8(src, zero), srcHi = _mm_unpackhi_epi8(src, zero);
+            __m128i p0 = blendFloatPixel(_mm_unpacklo_epi16(dstLo, zero), _mm_unpacklo_epi16(srcLo, zero), _mm_shuffle_ps(alpha, alpha, 0x00));
+            __m128i p1 = blendFloatPixel(_mm_unpackhi_epi16(dstLo, zero), _mm_unpackhi_epi16(srcLo, zero), _mm_shuffle_ps(alpha, alpha, 0x55));
+            __m128i p2 = blendFloatPixel(_mm_unpacklo_epi16(dstHi, zero), _mm_unpacklo_epi16(srcHi, zero), _mm_shuffle_ps(alpha, alpha, 0xAA));
+            __m128i p3 = blendFloatPixel(_mm_unpackhi_epi16(dstHi, zero), _mm_unpackhi_epi16(srcHi, zero), _mm_shuffle_ps(alpha, alpha, 0xFF));
+            return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        }
+
+        /// @brief Blends two pixels widened to 16 bits, returns the blended color
+        /// and sets `inexact` lanes that have to be redone with the reference blend
+        static __m128i blendWide(__m128i dst, __m128i src, __m128i& inexact) {
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+            __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(dst, inverse), _mm_mullo_epi16(src, alpha));
+            __m128i result = div255(sum);
+
+            // alpha of 0 and 255 gives exactly dst and src
+            __m128i partial = _mm_andnot_si128(
+                _mm_or_si128(_mm_cmpeq_epi16(alpha, _mm_setzero_si128()), _mm_cmpeq_epi16(alpha, _mm_set1_epi16(255))),
+                _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)
+            );
+            __m128i whole = _mm_cmpeq_epi16(_mm_mullo_epi16(result, _mm_set1_epi16(255)), sum);
+            inexact = _mm_and_si128(whole, partial);
+            return result;
+        }
+
+        static void blendAlpha(uint8_t* dst, uint8_t const* src, size_t count) {
+            __m128i zero = _mm_setzero_si128();
+            __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4, dst += 16, src += 16) {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst));
+                __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src));
+
+                __m128i inexactLo, inexactHi;
+                __m128i lo = blendWide(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), inexactLo);
+                __m128i hi = blendWide(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), inexactHi);
+                __m128i color = _mm_packus_epi16(lo, hi);
+                __m128i alpha = _mm_max_epu8(d, s);
+                __m128i out = _mm_or_si128(_mm_andnot_si128(alphaMask, color), _mm_and_si128(alphaMask, alpha));
+
+                __m128i inexact = _mm_packs_epi16(inexactLo, inexactHi);
+                if (_mm_movemask_epi8(inexact) != 0) {
+                    out = _mm_or_si128(_mm_andnot_si128(inexact, out), _mm_and_si128(inexact, blendFloat(d, s)));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+            }
+            scalar::blendAlpha(dst, src, count - i);
+        }
+
+        static constexpr Kernels kernels {
+            .name = "sse2",
+            .premultiply = &premultiply,
+            .unpremultiply = &unpremultiply,
+            .rgbToRgba = &scalar::rgbToRgba, // needs a byte shuffle, SSSE3 at least
+            .swapRedBlue = &swapRedBlue,
+            .isOpaque = &isOpaque,
+            .blendAlpha = &blendAlpha,
+        };
+    }
+
+    // == AVX2 == //
+
+    namespace avx2 {
+        IMGP_TARGET_AVX2 static __m256i div255(__m256i x) {
+            x = _mm256_add_epi16(x, _mm256_add_epi16(_mm256_set1_epi16(1), _mm256_srli_epi16(x, 8)));
+            return _mm256_srli_epi16(x, 8);
+        }
+
+        IMGP_TARGET_AVX2 static __m256i premultiplyWide(__m256i px) {
+            __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xFF), 0xFF);
+            __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+            alpha = _mm256_blendv_epi8(alpha, _mm256_set1_epi16(255), alphaMask);
+            return div255(_mm256_mullo_epi16(px, alpha));
+        }
+
+        IMGP_TARGET_AVX2 static void premultiply(uint8_t* rgba, size_t count) {
+            __m256i zero = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, rgba += 32) {
+                __m256i px = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rgba));
+                // unpack and pack both work within 128-bit lanes, so the pixel order is preserved
+                __m256i lo = premultiplyWide(_mm256_unpacklo_epi8(px, zero));
+                __m256i hi = premultiplyWide(_mm256_unpackhi_epi8(px, zero));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba), _mm256_packus_epi16(lo, hi));
+            }
+            sse2::premultiply(rgba, count - i);
+        }
+
+        IMGP_TARGET_AVX2 static void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) {
+            // move 12 bytes (4 pixels) into each 128-bit lane, then spread them out
+            __m256i permute = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+            __m256i shuffle = _mm256_setr_epi8(
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+            );
+            __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+
+            size_t i = 0;
+            // loads are 32 bytes wide, but only 24 of them are used
+            for (; i + 11 <= count; i += 8, rgb += 24, rgba += 32) {
+                __m256i px = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rgb));
+                px = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(px, permute), shuffle);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba), _mm256_or_si256(px, alpha));
+            }
+            scalar::rgbToRgba(rgb, rgba, count - i);
+        }
+
+        IMGP_TARGET_AVX2 static void swapRedBlue(uint8_t const* src, uint8_t* dst, size_t count) {
+            __m256i shuffle = _mm256_setr_epi8(
+                2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+            );
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, src += 32, dst += 32) {
+                __m256i px = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_shuffle_epi8(px, shuffle));
+            }
+            sse2::swapRedBlue(src, dst, count - i);
+        }
+
+        IMGP_TARGET_AVX2 static bool isOpaque(uint8_t const* rgba, size_t count) {
+            __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+            __m256i ones = _mm256_set1_epi32(-1);
+            size_t i = 0;
+            while (i + 32 <= count) {
+                __m256i acc = ones;
+                for (size_t j = 0; j < 4; ++j, i += 8, rgba += 32) {
+                    acc = _mm256_and_si256(acc, _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rgba)));
+                }
+                acc = _mm256_or_si256(acc, colorMask);
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, ones)) != -1) return false;
+            }
+            return sse2::isOpaque(rgba, count - i);
+        }
+
+        /// @brief Reference blend of 8 pixels, only the color channels of the result are meaningful
+        IMGP_TARGET_AVX2 static __m256i blendFloat(__m256i dst, __m256i src) {
+            __m256 alpha = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(src, 24)), _mm256_set1_ps(255.f));
+            __m256 inverse = _mm256_sub_ps(_mm256_set1_ps(1.f), alpha);
+
+            // one 32-bit lane per channel, two pixels per vector
+            __m256i result[4];
+            for (int half = 0; half < 4; ++half) {
+                __m256i pick = _mm256_setr_epi32(
+                    half * 2, half * 2, half * 2, half * 2, half * 2 + 1, half * 2 + 1, half * 2 + 1, half * 2 + 1
+                );
+                __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(
+                    reinterpret_cast<uint8_t const*>(&dst) + half * 8
+                )));
+                __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(
+                    reinterpret_cast<uint8_t const*>(&src) + half * 8
+                )));
+                __m256 a = _mm256_permutevar8x32_ps(alpha, pick);
+                __m256 i = _mm256_permutevar8x32_ps(inverse, pick);
+                __m256 blended = _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_cvtepi32_ps(d), i),
+                    _mm256_mul_ps(_mm256_cvtepi32_ps(s), a)
+                );
+                result[half] = _mm256_cvttps_epi32(blended);
+            }
+
+            // packs work within 128-bit lanes, so fix up the order afterwards
+            __m256i packed = _mm256_packus_epi16(
+                _mm256_packs_epi32(result[0], result[1]),
+                _mm256_packs_epi32(result[2], result[3])
+            );
+            return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        }
+
+        IMGP_TARGET_AVX2 static __m256i blendWide(__m256i dst, __m256i src, __m256i& inexact) {
+            __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+            __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+            __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(dst, inverse), _mm256_mullo_epi16(src, alpha));
+            __m256i result = div255(sum);
+
+            __m256i partial = _mm256_andnot_si256(
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi16(alpha, _mm256_setzero_si256()),
+                    _mm256_cmpeq_epi16(alpha, _mm256_set1_epi16(255))
+                ),
+                _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1)
+            );
+            __m256i whole = _mm256_cmpeq_epi16(_mm256_mullo_epi16(result, _mm256_set1_epi16(255)), sum);
+            inexact = _mm256_and_si256(whole, partial);
+            return result;
+        }
+
+        IMGP_TARGET_AVX2 static void blendAlpha(uint8_t* dst, uint8_t const* src, size_t count) {
+            __m256i zero = _mm256_setzero_si256();
+            __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8, dst += 32, src += 32) {
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst));
+                __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src));
+
+                __m256i inexactLo, inexactHi;
+                __m256i lo = blendWide(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), inexactLo);
+                __m256i hi = blendWide(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), inexactHi);
+                __m256i color = _mm256_packus_epi16(lo, hi);
+                __m256i alpha = _mm256_max_epu8(d, s);
+                __m256i out = _mm256_blendv_epi8(color, alpha, alphaMask);
+
+                __m256i inexact = _mm256_packs_epi16(inexactLo, inexactHi);
+                if (!_mm256_testz_si256(inexact, inexact)) {
+                    out = _mm256_blendv_epi8(out, blendFloat(d, s), inexact);
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), out);
+            }
+            sse2::blendAlpha(dst, src, count - i);
+        }
+
+        static constexpr Kernels kernels {
+            .name = "avx2",
+            .premultiply = &premultiply,
+            .unpremultiply = &sse2::unpremultiply, // bound by the division, wider vectors don't help
+            .rgbToRgba = &rgbToRgba,
+            .swapRedBlue = &swapRedBlue,
+            .isOpaque = &isOpaque,
+            .blendAlpha = &blendAlpha,
+        };
+
+        static bool isSupported() {
+            uint32_t regs[4]{};
+        #if defined(_MSC_VER) && !defined(__clang__)
+            __cpuid(reinterpret_cast<int*>(regs), 1);
+        #else
+            __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+        #endif
+
+            // the OS has to save YMM registers on context switches
+            bool osxsave = (regs[2] & (1u << 27)) != 0;
+            bool avx = (regs[2] & (1u << 28)) != 0;
+            if (!osxsave || !avx) return false;
+
+        #if defined(_MSC_VER) && !defined(__clang__)
+            uint64_t xcr0 = _xgetbv(0);
+        #else
+            uint32_t xcrLow, xcrHigh;
+            __asm__ volatile("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+            uint64_t xcr0 = (static_cast<uint64_t>(xcrHigh) << 32) | xcrLow;
+        #endif
+            if ((xcr0 & 6) != 6) return false;
+
+        #if defined(_MSC_VER) && !defined(__clang__)
+            __cpuidex(reinterpret_cast<int*>(regs), 7, 0);
+        #else
+            __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+        #endif
+            return (regs[1] & (1u << 5)) != 0;
+        }
+    }
+#endif
+
+#ifdef IMGP_PIXELS_NEON
+    // == NEON == //
+
+    namespace neon {
+        /// @brief floor(c * a / 255) for 16 channel values
+        static uint8x16_t multiplyDiv255(uint8x16_t c, uint8x16_t a) {
+            uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+            uint16x8_t hi = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+            lo = vaddq_u16(lo, vaddq_u16(vdupq_n_u16(1), vshrq_n_u16(lo, 8)));
+            hi = vaddq_u16(hi, vaddq_u16(vdupq_n_u16(1), vshrq_n_u16(hi, 8)));
+            return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+        }
+
+        static void premultiply(uint8_t* rgba, size_t count) {
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, rgba += 64) {
+                uint8x16x4_t px = vld4q_u8(rgba);
+                px.val[0] = multiplyDiv255(px.val[0], px.val[3]);
+                px.val[1] = multiplyDiv255(px.val[1], px.val[3]);
+                px.val[2] = multiplyDiv255(px.val[2], px.val[3]);
+                vst4q_u8(rgba, px);
+            }
+            scalar::premultiply(rgba, count - i);
+        }
+
+        /// @brief Unpremultiplies 4 channel values of the same color
+        static uint32x4_t unpremultiplyQuad(uint32x4_t c, float32x4_t alpha, float32x4_t half) {
+            float32x4_t value = vcvtq_f32_u32(c);
+            float32x4_t result = vdivq_f32(vmlaq_n_f32(half, value, 255.f), alpha);
+            return vcvtq_u32_f32(vminq_f32(result, vdupq_n_f32(255.f)));
+        }
+
+        static uint8x8_t unpremultiplyHalf(uint8x8_t c, uint8x8_t a) {
+            uint16x8_t c16 = vmovl_u8(c);
+            uint16x8_t a16 = vmovl_u8(a);
+            uint32x4_t aLo = vmovl_u16(vget_low_u16(a16));
+            uint32x4_t aHi = vmovl_u16(vget_high_u16(a16));
+
+            uint32x4_t lo = unpremultiplyQuad(
+                vmovl_u16(vget_low_u16(c16)), vcvtq_f32_u32(aLo), vcvtq_f32_u32(vshrq_n_u32(aLo, 1))
+            );
+            uint32x4_t hi = unpremultiplyQuad(
+                vmovl_u16(vget_high_u16(c16)), vcvtq_f32_u32(aHi), vcvtq_f32_u32(vshrq_n_u32(aHi, 1))
+            );
+            return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+        }
+
+        static void unpremultiply(uint8_t* rgba, size_t count) {
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, rgba += 64) {
+                uint8x16x4_t px = vld4q_u8(rgba);
+                uint8x16_t a = px.val[3];
+                uint8x16_t visible = vtstq_u8(a, a);
+                for (size_t c = 0; c < 3; ++c) {
+                    uint8x16_t out = vcombine_u8(
+                        unpremultiplyHalf(vget_low_u8(px.val[c]), vget_low_u8(a)),
+                        unpremultiplyHalf(vget_high_u8(px.val[c]), vget_high_u8(a))
+                    );
+                    px.val[c] = vandq_u8(out, visible);
+                }
+                vst4q_u8(rgba, px);
+            }
+            scalar::unpremultiply(rgba, count - i);
+        }
+
+        static void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) {
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, rgb += 48, rgba += 64) {
+                uint8x16x3_t px = vld3q_u8(rgb);
+                uint8x16x4_t out = { px.val[0], px.val[1], px.val[2], vdupq_n_u8(255) };
+                vst4q_u8(rgba, out);
+            }
+            scalar::rgbToRgba(rgb, rgba, count - i);
+        }
+
+        static void swapRedBlue(uint8_t const* src, uint8_t* dst, size_t count) {
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, src += 64, dst += 64) {
+                uint8x16x4_t px = vld4q_u8(src);
+                std::swap(px.val[0], px.val[2]);
+                vst4q_u8(dst, px);
+            }
+            scalar::swapRedBlue(src, dst, count - i);
+        }
+
+        static bool isOpaque(uint8_t const* rgba, size_t count) {
+            size_t i = 0;
+            while (i + 64 <= count) {
+                uint8x16_t acc = vdupq_n_u8(255);
+                for (size_t j = 0; j < 4; ++j, i += 16, rgba += 64) {
+                    acc = vandq_u8(acc, vld4q_u8(rgba).val[3]);
+                }
+                if (vminvq_u8(acc) != 255) return false;
+            }
+            return scalar::isOpaque(rgba, count - i);
+        }
+
+        /// @brief Blends 8 channel values, sets `inexact` lanes that have to be redone with the reference blend
+        static uint8x8_t blendHalf(uint8x8_t d, uint8x8_t s, uint8x8_t a, uint8x8_t partial, uint8x8_t& inexact) {
+            uint16x8_t sum = vmlal_u8(vmull_u8(d, vsub_u8(vdup_n_u8(255), a)), s, a);
+            uint16x8_t result = vshrq_n_u16(vaddq_u16(sum, vaddq_u16(vdupq_n_u16(1), vshrq_n_u16(sum, 8))), 8);
+            inexact = vand_u8(vmovn_u16(vceqq_u16(vmulq_n_u16(result, 255), sum)), partial);
+            return vmovn_u16(result);
+        }
+
+        /// @brief Reference blend of 4 channel values, with the same float operations as the scalar version
+        static uint32x4_t blendFloatQuad(uint16x4_t d, uint16x4_t s, float32x4_t alpha, float32x4_t inverse) {
+            float32x4_t df = vmulq_f32(vcvtq_f32_u32(vmovl_u16(d)), inverse);
+            float32x4_t sf = vmulq_f32(vcvtq_f32_u32(vmovl_u16(s)), alpha);
+            return vcvtq_u32_f32(vaddq_f32(df, sf));
+        }
+
+        static uint8x16_t blendFloat(uint8x16_t d, uint8x16_t s, float32x4_t const alpha[4], float32x4_t const inverse[4]) {
+            uint16x8_t dLo = vmovl_u8(vget_low_u8(d)), dHi = vmovl_u8(vget_high_u8(d));
+            uint16x8_t sLo = vmovl_u8(vget_low_u8(s)), sHi = vmovl_u8(vget_high_u8(s));
+            uint16x8_t lo = vcombine_u16(
+                vmovn_u32(blendFloatQuad(vget_low_u16(dLo), vget_low_u16(sLo), alpha[0], inverse[0])),
+                vmovn_u32(blendFloatQuad(vget_high_u16(dLo), vget_high_u16(sLo), alpha[1], inverse[1]))
+            );
+            uint16x8_t hi = vcombine_u16(
+                vmovn_u32(blendFloatQuad(vget_low_u16(dHi), vget_low_u16(sHi), alpha[2], inverse[2])),
+                vmovn_u32(blendFloatQuad(vget_high_u16(dHi), vget_high_u16(sHi), alpha[3], inverse[3]))
+            );
+            return vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+        }
+
+        static void blendAlpha(uint8_t* dst, uint8_t const* src, size_t count) {
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16, dst += 64, src += 64) {
+                uint8x16x4_t d = vld4q_u8(dst);
+                uint8x16x4_t s = vld4q_u8(src);
+                uint8x16_t a = s.val[3];
+
+                // alpha of 0 and 255 gives exactly dst and src
+                uint8x16_t partial = vandq_u8(vtstq_u8(a, a), vmvnq_u8(vceqq_u8(a, vdupq_n_u8(255))));
+
+                uint8x16x4_t out;
+                uint8x16_t inexact[3];
+                for (size_t c = 0; c < 3; ++c) {
+                    uint8x8_t inexactLo, inexactHi;
+                    out.val[c] = vcombine_u8(
+                        blendHalf(vget_low_u8(d.val[c]), vget_low_u8(s.val[c]), vget_low_u8(a), vget_low_u8(partial), inexactLo),
+                        blendHalf(vget_high_u8(d.val[c]), vget_high_u8(s.val[c]), vget_high_u8(a), vget_high_u8(partial), inexactHi)
+                    );
+                    inexact[c] = vcombine_u8(inexactLo, inexactHi);
+                }
+                out.val[3] = vmaxq_u8(d.val[3], a);
+
+                if (vmaxvq_u8(vorrq_u8(inexact[0], vorrq_u8(inexact[1], inexact[2]))) != 0) {
+                    uint16x8_t aLo = vmovl_u8(vget_low_u8(a)), aHi = vmovl_u8(vget_high_u8(a));
+                    float32x4_t alpha[4] = {
+                        vcvtq_f32_u32(vmovl_u16(vget_low_u16(aLo))), vcvtq_f32_u32(vmovl_u16(vget_high_u16(aLo))),
+                        vcvtq_f32_u32(vmovl_u16(vget_low_u16(aHi))), vcvtq_f32_u32(vmovl_u16(vget_high_u16(aHi))),
+                    };
+                    float32x4_t inverse[4];
+                    for (size_t k = 0; k < 4; ++k) {
+                        alpha[k] = vdivq_f32(alpha[k], vdupq_n_f32(255.f));
+                        inverse[k] = vsubq_f32(vdupq_n_f32(1.f), alpha[k]);
+                    }
+
+                    for (size_t c = 0; c < 3; ++c) {
+                        out.val[c] = vbslq_u8(inexact[c], blendFloat(d.val[c], s.val[c], alpha, inverse), out.val[c]);
+                    }
+                }
+
+                vst4q_u8(dst, out);
+            }
+            scalar::blendAlpha(dst, src, count - i);
+        }
+
+        static constexpr Kernels kernels {
+            .name = "neon",
+            .premultiply = &premultiply,
+            .unpremultiply = &unpremultiply,
+            .rgbToRgba = &rgbToRgba,
+            .swapRedBlue = &swapRedBlue,
+            .isOpaque = &isOpaque,
+            .blendAlpha = &blendAlpha,
+        };
+    }
+#endif
+
+    Kernels const& getScalarKernels() {
+        return scalar::kernels;
+    }
+
+    std::vector<Kernels const*> getAvailableKernels() {
+        std::vector<Kernels const*> result { &scalar::kernels };
+    #ifdef IMGP_PIXELS_X86
+        result.push_back(&sse2::kernels);
+        if (avx2::isSupported()) result.push_back(&avx2::kernels);
+    #endif
+    #ifdef IMGP_PIXELS_NEON
+        result.push_back(&neon::kernels);
+    #endif
+        return result;
+    }
+
+    Kernels const& getKernels() {
+        static Kernels const& best = *getAvailableKernels().back();
+        return best;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Per-pixel conversion routines with SIMD implementations picked at runtime.
+/// All functions operate on 8-bit channels, `count` is the number of pixels.
+namespace imgp::pixels {
+    struct Kernels {
+        char const* name;
+
+        /// @brief Multiplies RGB channels of RGBA pixels by alpha in place (c * a / 255, truncated)
+        void (*premultiply)(uint8_t* rgba, size_t count);
+
+        /// @brief Reverts premultiply in place (rounded, fully transparent pixels become zero)
+        void (*unpremultiply)(uint8_t* rgba, size_t count);
+
+        /// @brief Expands RGB pixels to RGBA with opaque alpha, buffers must not overlap
+        void (*rgbToRgba)(uint8_t const* rgb, uint8_t* rgba, size_t count);
+
+        /// @brief Swaps R and B channels (RGBA <-> BGRA), src and dst may be the same buffer
+        void (*swapRedBlue)(uint8_t const* src, uint8_t* dst, size_t count);
+
+        /// @brief Checks whether every RGBA pixel has alpha of 255
+        bool (*isOpaque)(uint8_t const* rgba, size_t count);
+
+        /// @brief Blends straight-alpha RGBA pixels over the destination, the way animated WebP frames are composited
+        /// @note Color is interpolated by source alpha, destination alpha becomes max(dst, src)
+        void (*blendAlpha)(uint8_t* dst, uint8_t const* src, size_t count);
+    };
+
+    /// @brief Portable implementations, also used for the tail of every SIMD routine
+    Kernels const& getScalarKernels();
+
+    /// @brief Best implementation supported by the current CPU
+    Kernels const& getKernels();
+
+    /// @brief Every implementation supported by the current CPU, scalar first
+    std::vector<Kernels const*> getAvailableKernels();
+
+    inline void premultiply(uint8_t* rgba, size_t count) {
+        getKernels().premultiply(rgba, count);
+    }
+
+    inline void unpremultiply(uint8_t* rgba, size_t count) {
+        getKernels().unpremultiply(rgba, count);
+    }
+
+    inline void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) {
+        getKernels().rgbToRgba(rgb, rgba, count);
+    }
+
+    inline void swapRedBlue(uint8_t const* src, uint8_t* dst, size_t count) {
+        getKernels().swapRedBlue(src, dst, count);
+    }
+
+    inline bool isOpaque(uint8_t const* rgba, size_t count) {
+        return getKernels().isOpaque(rgba, count);
+    }
+
+    inline void blendAlpha(uint8_t* dst, uint8_t const* src, size_t count) {
+        getKernels().blendAlpha(dst, src, count);
+    }
+}
@@ -0,0 +1,44 @@
+#include "PixelMemory.hpp"
+#include "BufferPool.hpp"
+
+#include <mutex>
+
+namespace imgp {
+    static void* defaultAllocate(size_t size, void*) {
+        return BufferPool::get().acquire(size).release();
+    }
+
+    static void defaultDeallocate(void* data, size_t size, void*) {
+        BufferPool::get().release(std::unique_ptr<uint8_t[]>(static_cast<uint8_t*>(data)), size);
+    }
+
+    static constexpr PixelAllocator DEFAULT_ALLOCATOR = { &defaultAllocate, &defaultDeallocate, nullptr };
+
+    static std::mutex s_allocatorMutex;
+    static PixelAllocator s_allocator = DEFAULT_ALLOCATOR;
+
+    void PixelDeleter::operator()(uint8_t* data) const {
+        if (data) allocator.deallocate(data, size, allocator.userdata);
+    }
+
+    PixelAllocator getPixelAllocator() {
+        std::lock_guard lock(s_allocatorMutex);
+        return s_allocator;
+    }
+
+    PixelBuffer allocatePixels(size_t size) {
+        return allocatePixels(size, getPixelAllocator());
+    }
+
+    PixelBuffer allocatePixels(size_t size, PixelAllocator const& allocator) {
+        auto data = static_cast<uint8_t*>(allocator.allocate(size, allocator.userdata));
+        return PixelBuffer(data, PixelDeleter{ allocator, size });
+    }
+}
+
+IMAGE_PLUS_BEGIN_NAMESPACE
+    void setPixelAllocator(PixelAllocator const& allocator) {
+        std::lock_guard lock(s_allocatorMutex);
+        s_allocator = allocator ? allocator : DEFAULT_ALLOCATOR;
+    }
+IMAGE_PLUS_END_NAMESPACE
@@ -0,0 +1,31 @@
+#pragma once
+#include <api.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace imgp {
+    /// @brief Releases a pixel buffer with the allocator it came from
+    struct PixelDeleter {
+        PixelAllocator allocator;
+        size_t size = 0;
+
+        void operator()(uint8_t* data) const;
+    };
+
+    /// @brief Pixel buffer owned by ImagePlus, allocated with the allocator set by setPixelAllocator.
+    /// Never hand these out as DecodedImage/AnimationFrame data, consumers free that with delete[]
+    using PixelBuffer = std::unique_ptr<uint8_t[], PixelDeleter>;
+
+    /// @brief Returns the allocator set by setPixelAllocator, or the default one (backed by BufferPool)
+    PixelAllocator getPixelAllocator();
+
+    /// @brief Allocates a pixel buffer with the current allocator
+    /// @return nullptr if the allocation failed
+    PixelBuffer allocatePixels(size_t size);
+
+    /// @brief Allocates a pixel buffer with the given allocator
+    /// @return nullptr if the allocation failed
+    PixelBuffer allocatePixels(size_t size, PixelAllocator const& allocator);
+}
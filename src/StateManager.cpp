@@ -1,41 +1,254 @@
 #include "StateManager.hpp"
 
-namespace imgp {
-    Animation::Animation(std::shared_ptr<DecodedAnimation> animation, cocos2d::CCTexture2D* first) {
-        m_frames.reserve(animation->frames.size());
-        m_delays.reserve(animation->frames.size());
+#include <Geode/cocos/CCConfiguration.h>
+#include <Geode/cocos/shaders/ccGLStateCache.h>
+
+#include <cstring>
 
-        if (animation->frames.empty()) {
+namespace imgp {
+    Animation::Animation(std::shared_ptr<AnimationSource> source, cocos2d::CCTexture2D* first, TextureMode mode)
+        : m_source(std::move(source)), m_first(first), m_mode(mode) {
+        if (m_source->getFrameCount() == 0) {
             geode::log::warn("Animation has no frames, cannot create Animation object");
             return;
         }
 
-        m_frames.push_back(first);
-        m_delays.push_back(animation->frames[0].delay);
+        if (m_mode == TextureMode::Atlas && !this->setupAtlas()) {
+            m_mode = TextureMode::PerFrame;
+        }
 
-        for (size_t i = 1; i < animation->frames.size(); ++i) {
-            auto& frame = animation->frames[i];
-            auto texture = new cocos2d::CCTexture2D();
-            texture->initWithData(
-                frame.data.get(),
-                animation->hasAlpha ? cocos2d::kTexture2DPixelFormat_RGBA8888 : cocos2d::kTexture2DPixelFormat_RGB888,
-                animation->width, animation->height,
-                cocos2d::CCSize{ static_cast<float>(animation->width), static_cast<float>(animation->height) }
-            );
-            texture->autorelease();
-            texture->retain();
-            m_frames.emplace_back(texture);
-            m_delays.push_back(frame.delay);
+        // other frames are uploaded on demand
+        if (m_mode == TextureMode::PerFrame) {
+            m_frames.resize(m_source->getFrameCount(), nullptr);
+            m_frames[0] = first;
         }
 
-        m_loopCount = animation->loopCount;
+        m_source->prefetch(0);
     }
 
     Animation::~Animation() {
         // Release all frames (except the first one, which holds the entire animation)
-        for (size_t i = 1; i < m_frames.size(); ++i) {
-            m_frames[i]->release();
+        for (auto index : m_resident) {
+            m_frames[index]->release();
+        }
+
+        for (auto texture : m_atlasPages) {
+            texture->release();
+        }
+    }
+
+    Animation::Stream::~Stream() {
+        for (auto texture : m_textures) {
+            if (texture) texture->release();
+        }
+    }
+
+    Animation::Frame Animation::getFrame(size_t index, Stream& stream) {
+        if (index != m_lastIndex) {
+            m_lastIndex = index;
+            m_source->prefetch(index);
+        }
+
+        switch (m_mode) {
+            case TextureMode::Streaming: return this->getStreamingFrame(index, stream);
+            case TextureMode::Atlas: return this->getAtlasFrame(index);
+            default: return this->getResidentFrame(index);
+        }
+    }
+
+    cocos2d::CCTexture2D* Animation::createTexture(uint8_t const* data, uint16_t width, uint16_t height) const {
+        auto texture = new cocos2d::CCTexture2D();
+        texture->initWithData(
+            data,
+            m_source->hasAlpha() ? cocos2d::kTexture2DPixelFormat_RGBA8888 : cocos2d::kTexture2DPixelFormat_RGB888,
+            width, height,
+            cocos2d::CCSize{ static_cast<float>(width), static_cast<float>(height) }
+        );
+        return texture;
+    }
+
+    void Animation::uploadFrame(cocos2d::CCTexture2D* texture, uint8_t const* data, FrameRect region, uint16_t x, uint16_t y) {
+        if (region.empty()) return;
+
+        bool alpha = m_source->hasAlpha();
+        size_t bytesPerPixel = alpha ? 4 : 3;
+        size_t stride = m_source->getWidth() * bytesPerPixel;
+        size_t rowSize = region.width * bytesPerPixel;
+
+        // full-width rows are already contiguous, otherwise they have to be packed
+        // (GLES2 doesn't have GL_UNPACK_ROW_LENGTH)
+        uint8_t const* pixels = data + region.y * stride + region.x * bytesPerPixel;
+        if (region.width != m_source->getWidth()) {
+            m_uploadRows.resize(rowSize * region.height);
+            for (size_t row = 0; row < region.height; ++row) {
+                std::memcpy(m_uploadRows.data() + row * rowSize, pixels + row * stride, rowSize);
+            }
+            pixels = m_uploadRows.data();
         }
+
+        // RGB rows are not guaranteed to be 4-byte aligned, the previous value is restored for everyone else
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alpha ? 4 : 1);
+        cocos2d::ccGLBindTexture2D(texture->getName());
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0, x + region.x, y + region.y,
+            region.width, region.height,
+            alpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, pixels
+        );
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    Animation::Frame Animation::getResidentFrame(size_t index) {
+        if (auto texture = m_frames[index]) {
+            return { texture };
+        }
+
+        auto frame = m_source->getFrame(index);
+        if (!frame) {
+            return {};
+        }
+
+        auto texture = this->createTexture(frame.get(), m_source->getWidth(), m_source->getHeight());
+        m_frames[index] = texture;
+        m_resident.push_back(index);
+
+        // keep as many textures as the memory budget allows (the source can cache fewer canvases than that)
+        while (m_resident.size() > m_source->getFrameBudget()) {
+            auto evicted = m_resident.front();
+            m_resident.pop_front();
+            m_frames[evicted]->release();
+            m_frames[evicted] = nullptr;
+        }
+
+        return { texture };
+    }
+
+    Animation::Frame Animation::getStreamingFrame(size_t index, Stream& stream) {
+        // first frame always stays in the original texture
+        if (index == 0) {
+            return { m_first };
+        }
+
+        for (size_t i = 0; i < stream.m_textures.size(); ++i) {
+            if (stream.m_textures[i] && stream.m_frames[i] == index) {
+                stream.m_front = i;
+                return { stream.m_textures[i] };
+            }
+        }
+
+        auto frame = m_source->getFrame(index);
+        if (!frame) {
+            return {};
+        }
+
+        // upload into the texture that is not on screen right now
+        size_t back = stream.m_front ^ 1;
+        auto& texture = stream.m_textures[back];
+        if (!texture) {
+            texture = this->createTexture(frame.get(), m_source->getWidth(), m_source->getHeight());
+        } else {
+            // when playing forward, only the regions changed since the frame the texture holds need updating
+            auto region = this->getFullRect();
+            if (size_t held = stream.m_frames[back]; held < index) {
+                region = {};
+                for (size_t i = held + 1; i <= index; ++i) {
+                    region = region.merge(m_source->getDirtyRect(i));
+                }
+            }
+            this->uploadFrame(texture, frame.get(), region);
+        }
+
+        stream.m_frames[back] = index;
+        stream.m_front = back;
+        return { texture };
+    }
+
+    // gap between atlas cells, so that linear filtering doesn't bleed neighbouring frames in
+    static constexpr size_t ATLAS_PADDING = 1;
+    static constexpr size_t ATLAS_MAX_SIZE = 2048;
+    static constexpr size_t ATLAS_MAX_PAGES = 4;
+
+    bool Animation::setupAtlas() {
+        size_t frameCount = m_source->getFrameCount();
+
+        // atlas keeps every frame in video memory, so all of them have to fit the memory budget
+        if (m_source->getFrameBudget() + 1 < frameCount) {
+            return false;
+        }
+
+        size_t maxSize = std::min<size_t>(
+            cocos2d::CCConfiguration::sharedConfiguration()->getMaxTextureSize(),
+            ATLAS_MAX_SIZE
+        );
+        size_t cellWidth = m_source->getWidth() + ATLAS_PADDING;
+        size_t cellHeight = m_source->getHeight() + ATLAS_PADDING;
+
+        size_t columns = std::min(frameCount, maxSize / cellWidth);
+        size_t rows = columns ? std::min((frameCount + columns - 1) / columns, maxSize / cellHeight) : 0;
+        if (columns == 0 || rows == 0) {
+            return false;
+        }
+
+        size_t perPage = columns * rows;
+        size_t pageCount = (frameCount + perPage - 1) / perPage;
+        if (pageCount > ATLAS_MAX_PAGES) {
+            return false;
+        }
+
+        size_t bytesPerPixel = m_source->hasAlpha() ? 4 : 3;
+        std::vector<uint8_t> blank;
+        for (size_t page = 0; page < pageCount; ++page) {
+            size_t framesOnPage = std::min(perPage, frameCount - page * perPage);
+            size_t pageRows = (framesOnPage + columns - 1) / columns;
+            size_t pageWidth = std::min(framesOnPage, columns) * cellWidth;
+            size_t pageHeight = pageRows * cellHeight;
+
+            // pages start out transparent, frames are filled in as they are requested
+            blank.assign(pageWidth * pageHeight * bytesPerPixel, 0);
+            m_atlasPages.push_back(this->createTexture(
+                blank.data(), static_cast<uint16_t>(pageWidth), static_cast<uint16_t>(pageHeight)
+            ));
+        }
+
+        m_atlasColumns = columns;
+        m_atlasFramesPerPage = perPage;
+        m_atlasUploaded.resize(frameCount, false);
+
+        // first frame goes in as well, so sprites can start on page 0 and be batched from the start
+        // (it's always resident in the source, so this can't fail)
+        this->getAtlasFrame(0);
+        return true;
+    }
+
+    cocos2d::CCRect Animation::getAtlasRect(size_t index) const {
+        size_t local = index % m_atlasFramesPerPage;
+        return {
+            static_cast<float>((local % m_atlasColumns) * (m_source->getWidth() + ATLAS_PADDING)),
+            static_cast<float>((local / m_atlasColumns) * (m_source->getHeight() + ATLAS_PADDING)),
+            static_cast<float>(m_source->getWidth()),
+            static_cast<float>(m_source->getHeight())
+        };
+    }
+
+    Animation::Frame Animation::getAtlasFrame(size_t index) {
+        auto texture = m_atlasPages[index / m_atlasFramesPerPage];
+        auto rect = this->getAtlasRect(index);
+
+        if (!m_atlasUploaded[index]) {
+            auto frame = m_source->getFrame(index);
+            if (!frame) {
+                return {};
+            }
+
+            this->uploadFrame(
+                texture, frame.get(), this->getFullRect(),
+                static_cast<uint16_t>(rect.origin.x), static_cast<uint16_t>(rect.origin.y)
+            );
+            m_atlasUploaded[index] = true;
+        }
+
+        return { texture, rect };
     }
 
     void StateManager::onTextureRemoval(cocos2d::CCTexture2D* texture) {
@@ -48,16 +261,22 @@ namespace imgp {
     bool StateManager::onImageRemoval(cocos2d::CCImage* image) {
         std::lock_guard lock(m_imageStorageMutex);
         if (auto it = m_imageStorage.find(image); it != m_imageStorage.end()) {
-            std::weak_ptr weakAnim = it->second;
             m_imageStorage.erase(it);
-            if (auto anim = weakAnim.lock()) {} else {
-                return true;
-            }
+            return true;
+        }
+        if (auto it = m_imageDataOwners.find(image); it != m_imageDataOwners.end()) {
+            m_imageDataOwners.erase(it);
+            return true;
         }
         return false;
     }
 
-    std::shared_ptr<DecodedAnimation>& StateManager::getImageStorage(cocos2d::CCImage* image) {
+    void StateManager::holdImageData(cocos2d::CCImage* image, std::shared_ptr<void const> owner) {
+        std::lock_guard lock(m_imageStorageMutex);
+        m_imageDataOwners[image] = std::move(owner);
+    }
+
+    std::shared_ptr<AnimationSource>& StateManager::getImageStorage(cocos2d::CCImage* image) {
         std::lock_guard lock(m_imageStorageMutex);
         return m_imageStorage[image];
     }
@@ -67,7 +286,7 @@ namespace imgp {
         return m_textureStorage[texture];
     }
 
-    std::optional<std::shared_ptr<DecodedAnimation>> StateManager::findImageStorage(cocos2d::CCImage* image) {
+    std::optional<std::shared_ptr<AnimationSource>> StateManager::findImageStorage(cocos2d::CCImage* image) {
         std::lock_guard lock(m_imageStorageMutex);
         if (auto it = m_imageStorage.find(image); it != m_imageStorage.end()) {
             return it->second;
@@ -1,21 +1,82 @@
 #pragma once
 #include <api.hpp>
+#include "AnimationSource.hpp"
+
+#include <array>
+#include <deque>
 
 namespace imgp {
     class Animation {
     public:
-        Animation(std::shared_ptr<DecodedAnimation> animation, cocos2d::CCTexture2D* first);
+        enum class TextureMode {
+            PerFrame,  ///< Every frame gets its own texture (up to the memory budget)
+            Streaming, ///< Every sprite reuses its own two textures, frames are uploaded into them in place
+            Atlas,     ///< Frames are packed into a few shared textures, sprites only switch texture rects
+        };
+
+        struct Frame {
+            cocos2d::CCTexture2D* texture = nullptr;
+            std::optional<cocos2d::CCRect> rect; ///< Region of the texture (in pixels), only set for atlas frames
+
+            operator bool() const { return texture != nullptr; }
+        };
+
+        /// @brief Textures a sprite streams frames into (TextureMode::Streaming). Every sprite has its own playhead,
+        /// so each one needs its own pair, otherwise one sprite could overwrite a frame another one is showing
+        class Stream {
+        public:
+            Stream() = default;
+            ~Stream();
+
+            Stream(Stream const&) = delete;
+            Stream& operator=(Stream const&) = delete;
+
+        private:
+            friend class Animation;
+
+            std::array<cocos2d::CCTexture2D*, 2> m_textures{};
+            std::array<size_t, 2> m_frames{}; // frame index currently held by each texture
+            size_t m_front = 0; // texture that was handed out last, never overwritten
+        };
+
+        Animation(std::shared_ptr<AnimationSource> source, cocos2d::CCTexture2D* first, TextureMode mode);
         ~Animation();
 
-        cocos2d::CCTexture2D* getFrame(size_t index) const { return m_frames[index]; }
-        uint32_t getDelay(size_t index) const { return m_delays[index]; }
-        uint16_t getLoopCount() const { return m_loopCount; }
-        size_t getFrameCount() const { return m_frames.size(); }
+        /// @brief Returns the texture for the given frame, uploading it if it's not resident
+        /// @param stream Textures of the sprite asking, only used in TextureMode::Streaming
+        Frame getFrame(size_t index, Stream& stream);
+        uint32_t getDelay(size_t index) const { return m_source->getDelay(index); }
+        uint16_t getLoopCount() const { return m_source->getLoopCount(); }
+        size_t getFrameCount() const { return m_source->getFrameCount(); }
 
     private:
-        std::vector<cocos2d::CCTexture2D*> m_frames;
-        std::vector<uint32_t> m_delays;
-        uint16_t m_loopCount = 0;
+        cocos2d::CCTexture2D* createTexture(uint8_t const* data, uint16_t width, uint16_t height) const;
+        /// @brief Uploads a region of the frame into the texture, offset by x/y
+        void uploadFrame(cocos2d::CCTexture2D* texture, uint8_t const* data, FrameRect region, uint16_t x = 0, uint16_t y = 0);
+        FrameRect getFullRect() const { return { 0, 0, m_source->getWidth(), m_source->getHeight() }; }
+
+        bool setupAtlas();
+        cocos2d::CCRect getAtlasRect(size_t index) const;
+
+        Frame getResidentFrame(size_t index);
+        Frame getStreamingFrame(size_t index, Stream& stream);
+        Frame getAtlasFrame(size_t index);
+
+        std::shared_ptr<AnimationSource> m_source;
+        cocos2d::CCTexture2D* m_first = nullptr;
+        TextureMode m_mode = TextureMode::PerFrame;
+        size_t m_lastIndex = 0;
+        std::vector<uint8_t> m_uploadRows; // partial uploads need tightly packed rows
+
+        // TextureMode::PerFrame
+        std::vector<cocos2d::CCTexture2D*> m_frames; // nullptr for frames that are not resident
+        std::deque<size_t> m_resident; // upload order, used for eviction
+
+        // TextureMode::Atlas
+        std::vector<cocos2d::CCTexture2D*> m_atlasPages;
+        std::vector<bool> m_atlasUploaded;
+        size_t m_atlasColumns = 0;
+        size_t m_atlasFramesPerPage = 0;
     };
 
     class StateManager {
@@ -36,17 +97,21 @@ namespace imgp {
 
         void onTextureRemoval(cocos2d::CCTexture2D* texture);
 
-        /// @return true if this was the last image holding a reference to DecodedAnimation
+        /// @return true if the image data was owned by an AnimationSource or shared with other images
         bool onImageRemoval(cocos2d::CCImage* image);
 
-        std::shared_ptr<DecodedAnimation>& getImageStorage(cocos2d::CCImage* image);
+        /// @brief Keeps shared pixel data alive for as long as the image uses it
+        void holdImageData(cocos2d::CCImage* image, std::shared_ptr<void const> owner);
+
+        std::shared_ptr<AnimationSource>& getImageStorage(cocos2d::CCImage* image);
         std::shared_ptr<Animation>& getTextureStorage(cocos2d::CCTexture2D* texture);
 
-        std::optional<std::shared_ptr<DecodedAnimation>> findImageStorage(cocos2d::CCImage* image);
+        std::optional<std::shared_ptr<AnimationSource>> findImageStorage(cocos2d::CCImage* image);
         std::optional<std::shared_ptr<Animation>> findTextureStorage(cocos2d::CCTexture2D* texture);
 
     private:
-        std::unordered_map<cocos2d::CCImage*, std::shared_ptr<DecodedAnimation>> m_imageStorage{};
+        std::unordered_map<cocos2d::CCImage*, std::shared_ptr<AnimationSource>> m_imageStorage{};
+        std::unordered_map<cocos2d::CCImage*, std::shared_ptr<void const>> m_imageDataOwners{};
         std::unordered_map<cocos2d::CCTexture2D*, std::shared_ptr<Animation>> m_textureStorage{};
         std::mutex m_imageStorageMutex{};
         std::mutex m_textureStorageMutex{};
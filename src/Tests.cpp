@@ -108,6 +108,84 @@ void testEncoder(std::string_view name, EncodeFn encode, DecodeFn decode) {
     geode::log::info("{} completed successfully", name);
 }
 
+void testBatch() {
+    geode::log::info("[TEST] Batch decoding ... ");
+    ScopedNest nest;
+
+    auto png = encode::png(TEST_IMAGE.data(), 2, 2, true);
+    auto qoi = encode::qoi(TEST_IMAGE.data(), 2, 2, true);
+    if (png.isErr() || qoi.isErr()) {
+        geode::log::error("Encoding failed");
+        return;
+    }
+
+    auto pngBytes = std::move(png).unwrap();
+    auto qoiBytes = std::move(qoi).unwrap();
+    constexpr std::array<uint8_t, 4> garbage = {1, 2, 3, 4};
+    std::array<EncodedImage, 3> images = {{
+        { pngBytes.data(), pngBytes.size(), ImageFormat::Png },
+        { garbage.data(), garbage.size() },
+        { qoiBytes.data(), qoiBytes.size() },
+    }};
+
+    auto results = tryDecodeBatch(images);
+    if (results.size() != images.size()) {
+        geode::log::error("Expected {} results, got {}", images.size(), results.size());
+        return;
+    }
+
+    for (size_t i : { 0, 2 }) {
+        auto img = results[i].isOk() ? std::get_if<DecodedImage>(&results[i].unwrap()) : nullptr;
+        if (!img || std::memcmp(img->data.get(), TEST_IMAGE.data(), TEST_IMAGE.size()) != 0) {
+            geode::log::error("Image {} was not decoded correctly", i);
+            return;
+        }
+    }
+
+    if (results[1].isOk()) {
+        geode::log::error("Invalid image was decoded successfully");
+        return;
+    }
+
+    geode::log::info("Batch decoding completed successfully");
+}
+
+void testSinks() {
+    geode::log::info("[TEST] Encoding into sinks ... ");
+    ScopedNest nest;
+
+    // too small on purpose, the size needed should still come back
+    std::vector<uint8_t> buffer(8);
+    auto size = encode::pngTo(TEST_IMAGE.data(), 2, 2, true, {}, OutputSink::buffer(buffer.data(), buffer.size()));
+    if (size.isErr() || size.unwrap() <= buffer.size()) {
+        geode::log::error("Expected the buffer to be too small");
+        return;
+    }
+
+    buffer.resize(size.unwrap());
+    auto written = encode::pngTo(TEST_IMAGE.data(), 2, 2, true, {}, OutputSink::buffer(buffer.data(), buffer.size()));
+    if (written.isErr() || written.unwrap() != buffer.size()) {
+        geode::log::error("Encoding into the buffer failed");
+        return;
+    }
+
+    auto dec = decode::png(buffer.data(), buffer.size());
+    if (dec.isErr() || std::memcmp(dec.unwrap().data.get(), TEST_IMAGE.data(), TEST_IMAGE.size()) != 0) {
+        geode::log::error("Image was not decoded correctly");
+        return;
+    }
+
+    auto aborted = encode::webpTo(
+        TEST_IMAGE.data(), 2, 2, true, {}, OutputSink::callback([](void const*, size_t) { return false; })
+    );
+    if (aborted.isOk()) {
+        geode::log::error("Encode didn't stop when the sink failed");
+        return;
+    }
+
+    geode::log::info("Encoding into sinks completed successfully");
+}
+
 class $modify(ImagePlusTest, MenuLayer) {
     bool init() override {
         if (!MenuLayer::init()) {
@@ -128,7 +206,13 @@ class $modify(ImagePlusTest, MenuLayer) {
     }
 
     void onTestButton(CCObject*) {
-        testEncoder("PNG", encode::png, decode::png);
+        testEncoder(
+            "PNG",
+            [](auto* img, uint16_t w, uint16_t h, bool a) {
+                return encode::png(img, w, h, a);
+            },
+            decode::png
+        );
         testEncoder("QOI", encode::qoi, decode::qoi);
         testEncoder(
             "WEBP",
@@ -143,6 +227,8 @@ class $modify(ImagePlusTest, MenuLayer) {
             },
             decode::jpegxl
         );
+        testBatch();
+        testSinks();
 
         geode::log::info("[TEST] All image format tests completed");
     }
@@ -0,0 +1,170 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace imgp {
+    bool ThreadPool::Task::tryRun() {
+        if (m_claimed.exchange(true)) return false;
+
+        m_func();
+        m_func = nullptr;
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_done = true;
+        }
+        m_condition.notify_all();
+        return true;
+    }
+
+    void ThreadPool::Task::wait() {
+        if (this->tryRun()) return;
+
+        std::unique_lock lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_done; });
+    }
+
+    ThreadPool& ThreadPool::get() {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    size_t ThreadPool::getThreadCount() const {
+        if (size_t count = m_maxThreads) return count;
+        return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    void ThreadPool::setMaxThreads(size_t count) {
+        m_maxThreads = count;
+
+        // parked workers have to re-check whether they're allowed to run
+        m_condition.notify_all();
+    }
+
+    ThreadPool::TaskPtr ThreadPool::submit(std::function<void()> func) {
+        auto task = std::make_shared<Task>(std::move(func));
+
+        // single-threaded, the task will run when someone waits on it
+        if (this->getThreadCount() <= 1) return task;
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_queue.push_back(task);
+
+            // the thread that waits on the result works too, so one less worker is needed
+            size_t workers = this->getThreadCount() - 1;
+            if (m_threads.size() < std::min(workers, m_queue.size())) {
+                m_threads.emplace_back([this, index = m_threads.size()] { this->workerLoop(index); });
+            }
+        }
+        m_condition.notify_one();
+        return task;
+    }
+
+    void ThreadPool::parallelFor(size_t count, std::function<void(size_t, size_t)> const& func, size_t maxThreads) {
+        size_t threads = std::min(maxThreads ? maxThreads : this->getThreadCount(), count);
+        if (threads <= 1) {
+            for (size_t i = 0; i < count; ++i) func(i, 0);
+            return;
+        }
+
+        struct alignas(64) Range {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        std::vector<Range> ranges(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            ranges[i].begin = count * i / threads;
+            ranges[i].end = count * (i + 1) / threads;
+        }
+
+        // owners take items from the front of their range, thieves take the back half
+        auto steal = [&](size_t self) {
+            size_t victim = self, largest = 0;
+            for (size_t i = 0; i < threads; ++i) {
+                if (i == self) continue;
+                std::lock_guard lock(ranges[i].mutex);
+                if (size_t left = ranges[i].end - ranges[i].begin; left > largest) {
+                    largest = left;
+                    victim = i;
+                }
+            }
+            if (victim == self) return false;
+
+            std::pair<size_t, size_t> stolen;
+            {
+                std::lock_guard lock(ranges[victim].mutex);
+                size_t left = ranges[victim].end - ranges[victim].begin;
+                if (left == 0) return true; // emptied in the meantime, look again
+                stolen = { ranges[victim].end - (left + 1) / 2, ranges[victim].end };
+                ranges[victim].end = stolen.first;
+            }
+
+            std::lock_guard lock(ranges[self].mutex);
+            ranges[self].begin = stolen.first;
+            ranges[self].end = stolen.second;
+            return true;
+        };
+
+        auto run = [&](size_t self) {
+            while (true) {
+                size_t index;
+                {
+                    std::lock_guard lock(ranges[self].mutex);
+                    index = ranges[self].begin;
+                    if (index < ranges[self].end) ranges[self].begin++;
+                    else index = count;
+                }
+
+                if (index < count) func(index, self);
+                else if (!steal(self)) return;
+            }
+        };
+
+        std::vector<TaskPtr> tasks;
+        tasks.reserve(threads - 1);
+        for (size_t i = 1; i < threads; ++i) {
+            tasks.push_back(this->submit([&run, i] { run(i); }));
+        }
+
+        run(0);
+
+        // a task nobody picked up runs here, finds every range empty and returns right away
+        for (auto& task : tasks) {
+            task->wait();
+        }
+    }
+
+    void ThreadPool::workerLoop(size_t index) {
+        while (true) {
+            TaskPtr task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_condition.wait(lock, [&] {
+                    return m_stop || (!m_queue.empty() && index + 1 < this->getThreadCount());
+                });
+                if (m_stop) return;
+
+                task = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            // might have been run by whoever was waiting on it already
+            task->tryRun();
+        }
+    }
+}
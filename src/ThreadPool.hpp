@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace imgp {
+    /// @brief Process-wide pool of worker threads for codec work.
+    /// Waiting on a task that no worker has picked up yet runs it on the waiting thread,
+    /// so tasks can safely wait on other tasks even when every worker is busy.
+    class ThreadPool {
+    public:
+        class Task {
+        public:
+            explicit Task(std::function<void()> func) : m_func(std::move(func)) {}
+
+            /// @brief Blocks until the task has finished, running it on the calling thread if it hasn't started yet
+            void wait();
+
+        private:
+            friend class ThreadPool;
+
+            /// @return false if another thread has already claimed the task
+            bool tryRun();
+
+            std::function<void()> m_func;
+            std::atomic_bool m_claimed = false;
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            bool m_done = false;
+        };
+
+        using TaskPtr = std::shared_ptr<Task>;
+
+        static ThreadPool& get();
+
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator=(ThreadPool const&) = delete;
+
+        /// @brief Queues a function to run on one of the workers
+        TaskPtr submit(std::function<void()> func);
+
+        /// @brief Calls func for every index in [0, count) on the workers and the calling thread, returns once all calls finished.
+        /// Indices are split into one contiguous range per thread, threads that run out of work steal half of the
+        /// largest remaining range, so a few slow items don't leave the other threads idle
+        /// @param func Receives the index and the number of the thread running it (never used by two calls at once)
+        /// @param maxThreads Limits the thread numbers to [0, maxThreads), 0 uses getThreadCount()
+        void parallelFor(size_t count, std::function<void(size_t index, size_t thread)> const& func, size_t maxThreads = 0);
+
+        /// @brief Limits the number of threads used for decoding (0 picks it based on the CPU)
+        void setMaxThreads(size_t count);
+        size_t getMaxThreads() const { return m_maxThreads; }
+
+        /// @brief Number of threads that may work on tasks at the same time, including the caller
+        size_t getThreadCount() const;
+
+    private:
+        ThreadPool() = default;
+        ~ThreadPool();
+
+        void workerLoop(size_t index);
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<TaskPtr> m_queue;
+        std::vector<std::thread> m_threads;
+        std::atomic<size_t> m_maxThreads = 0;
+        bool m_stop = false;
+    };
+}
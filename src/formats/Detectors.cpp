@@ -1,6 +1,14 @@
 #include <api.hpp>
+#include "Internal.hpp"
+#include "../DecodeCache.hpp"
+#include "../Metrics.hpp"
+#include "../PixelMemory.hpp"
+#include "../ThreadPool.hpp"
 
-#ifdef GEODE_IS_ANDROID
+#include <mutex>
+#include <optional>
+
+#if defined(GEODE_IS_ANDROID) || defined(IMAGEPLUS_HEADLESS)
 #include <arpa/inet.h> // for ntohl
 #endif
 
@@ -113,13 +121,7 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         return ImageFormat::Unknown;
     }
 
-    geode::Result<DecodedResult> tryDecode(void const* data, size_t size, ImageFormat format) {
-        using namespace formats;
-
-        if (format == ImageFormat::Unknown) {
-            format = guessFormat(data, size);
-        }
-
+    static geode::Result<DecodedResult> decodeAs(void const* data, size_t size, ImageFormat format) {
         #define FLATTEN_DECODED_IMAGE_RESULT(func) { \
             GEODE_UNWRAP_INTO(auto img, func(data, size)); \
             return geode::Ok(DecodedResult{std::move(img)}); \
@@ -137,4 +139,128 @@ IMAGE_PLUS_BEGIN_NAMESPACE
         }
     }
 
+    static geode::Result<DecodedResult> decodeFormat(void const* data, size_t size, ImageFormat format) {
+        if (format == ImageFormat::Unknown) {
+            format = guessFormat(data, size);
+        }
+
+        Metrics::Scope scope(format, Metrics::Op::Decode, size);
+        auto result = decodeAs(data, size, format);
+        if (result) {
+            auto [bytes, pixels] = Metrics::measure(result.unwrap());
+            scope.succeed(bytes, pixels);
+        }
+        return result;
+    }
+
+    geode::Result<DecodedResult> tryDecode(void const* data, size_t size, ImageFormat format) {
+        auto& cache = DecodeCache::get();
+        if (!cache.isEnabled()) {
+            return decodeFormat(data, size, format);
+        }
+
+        // only static images are cached, since results have to be copied for the caller anyway
+        auto key = DecodeCache::makeKey(data, size, DecodeCache::Kind::Decoded);
+        if (auto entry = cache.find(key)) {
+            GEODE_UNWRAP_INTO(auto img, DecodeCache::copyImage(entry->image));
+            return geode::Ok(DecodedResult{std::move(img)});
+        }
+
+        GEODE_UNWRAP_INTO(auto result, decodeFormat(data, size, format));
+        if (auto img = std::get_if<DecodedImage>(&result)) {
+            if (auto copy = DecodeCache::copyImage(*img)) {
+                cache.insert(key, std::move(copy).unwrap());
+            }
+        }
+
+        return geode::Ok(std::move(result));
+    }
+
+    void tryDecodeBatch(std::span<EncodedImage const> images, BatchCallback const& callback) {
+        std::mutex mutex;
+        ThreadPool::get().parallelFor(images.size(), [&](size_t index, size_t) {
+            auto const& image = images[index];
+            auto result = tryDecode(image.data, image.size, image.format);
+
+            std::lock_guard lock(mutex);
+            callback(index, std::move(result));
+        });
+    }
+
+    std::vector<geode::Result<DecodedResult>> tryDecodeBatch(std::span<EncodedImage const> images) {
+        // every image gets its own slot, so there's nothing to lock
+        std::vector<std::optional<geode::Result<DecodedResult>>> slots(images.size());
+        ThreadPool::get().parallelFor(images.size(), [&](size_t index, size_t) {
+            auto const& image = images[index];
+            slots[index] = tryDecode(image.data, image.size, image.format);
+        });
+
+        std::vector<geode::Result<DecodedResult>> results;
+        results.reserve(slots.size());
+        for (auto& slot : slots) {
+            results.push_back(std::move(*slot));
+        }
+        return results;
+    }
+
+    geode::Result<ImageInfo> getImageInfo(void const* data, size_t size, ImageFormat format) {
+        if (format == ImageFormat::Unknown) {
+            format = guessFormat(data, size);
+        }
+
+        switch (format) {
+            case ImageFormat::Png: return decode::pngInfo(data, size);
+            case ImageFormat::Qoi: return decode::qoiInfo(data, size);
+            case ImageFormat::Webp: return decode::webpInfo(data, size);
+            case ImageFormat::JpegXL: return decode::jpegxlInfo(data, size);
+            case ImageFormat::Gif: return decode::gifInfo(data, size);
+            default:
+                return geode::Err("Unsupported image format");
+        }
+    }
+
+    static geode::Result<size_t> decodeInto(
+        void const* data, size_t size, ImageFormat format, void* buf, size_t bufSize, size_t frame
+    ) {
+        if (frame > 0 && (format == ImageFormat::Png || format == ImageFormat::Qoi))
+            return geode::Err("Frame index is out of range");
+
+        switch (format) {
+            case ImageFormat::Png: return decode::pngInto(data, size, buf, bufSize);
+            case ImageFormat::Qoi: return decode::qoiInto(data, size, buf, bufSize);
+            case ImageFormat::Webp: return decode::webpInto(data, size, buf, bufSize, frame);
+            case ImageFormat::JpegXL: return decode::jpegxlInto(data, size, buf, bufSize, frame);
+            case ImageFormat::Gif: return decode::gifInto(data, size, buf, bufSize, frame);
+            default:
+                return geode::Err("Unsupported image format");
+        }
+    }
+
+    geode::Result<AllocatedImage> tryDecodeWith(
+        void const* data, size_t size, PixelAllocator const& allocator, ImageFormat format, size_t frame
+    ) {
+        if (!allocator)
+            return geode::Err("Invalid pixel allocator");
+
+        GEODE_UNWRAP_INTO(auto info, getImageInfo(data, size, format));
+
+        // JPEG XL is the only decoder that keeps 16 bits per channel
+        size_t bytesPerSample = info.format == ImageFormat::JpegXL && info.bit_depth > 8 ? 2 : 1;
+        size_t bufSize = static_cast<size_t>(info.width) * info.height * (info.hasAlpha ? 4 : 3) * bytesPerSample;
+
+        Metrics::Scope scope(info.format, Metrics::Op::Decode, size);
+        auto buffer = allocatePixels(bufSize, allocator);
+        if (!buffer)
+            return geode::Err("Failed to allocate memory for decoded image");
+
+        GEODE_UNWRAP(decodeInto(data, size, info.format, buffer.get(), bufSize, frame));
+        scope.succeed(bufSize, static_cast<uint64_t>(info.width) * info.height);
+
+        return geode::Ok(AllocatedImage {
+            .data = buffer.release(),
+            .size = bufSize,
+            .info = info,
+        });
+    }
+
 IMAGE_PLUS_END_NAMESPACE
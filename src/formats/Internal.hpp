@@ -0,0 +1,89 @@
+#pragma once
+#include <api.hpp>
+#include "../Headless.hpp"
+
+// Decoders (and encoder helpers) that are only used by the mod itself, and are not part of the public API
+IMAGE_PLUS_BEGIN_NAMESPACE
+    namespace decode {
+        /// @brief Decodes a PNG image row by row, premultiplying alpha of each row right after it's decoded
+        /// @note Result has isPreMultiplied set, so it can be used as CCImage data directly
+        geode::Result<DecodedImage> pngPremultiplied(void const* data, size_t size);
+
+        /// @brief Decodes at most maxFrames frames of a GIF, stopping right after the last one
+        /// @note Returns a single image if only one frame was decoded
+        geode::Result<DecodedResult> gifFrames(void const* data, size_t size, size_t maxFrames);
+
+        // == Header-only metadata probes, none of these allocate pixel buffers == //
+
+        geode::Result<ImageInfo> pngInfo(void const* data, size_t size);
+        geode::Result<ImageInfo> qoiInfo(void const* data, size_t size);
+        geode::Result<ImageInfo> webpInfo(void const* data, size_t size);
+        geode::Result<ImageInfo> jpegxlInfo(void const* data, size_t size);
+        geode::Result<ImageInfo> gifInfo(void const* data, size_t size);
+
+        /// @brief Converts metadata into the header-only result of the public *Header functions
+        /// (an image without data, or an animation without frames)
+        inline DecodedResult toHeaderResult(ImageInfo const& info) {
+            if (info.isAnimated()) {
+                DecodedAnimation anim;
+                anim.loopCount = info.loopCount;
+                anim.width = info.width;
+                anim.height = info.height;
+                anim.hasAlpha = info.hasAlpha;
+                return anim;
+            }
+
+            return DecodedImage {
+                .width = info.width,
+                .height = info.height,
+                .bit_depth = info.bit_depth,
+                .hasAlpha = info.hasAlpha,
+            };
+        }
+    }
+
+    namespace encode {
+        /// @brief Options matching the encode functions that only take a quality
+        inline EncodeOptions legacyOptions(float quality) {
+            EncodeOptions options;
+            options.quality = quality;
+            options.lossless = quality >= 99.f;
+            return options;
+        }
+
+        /// @brief Picks the value for the preset, unless the option was set explicitly (not -1)
+        inline int fromPreset(int option, EncodeOptions const& options, int fastest, int fast, int balanced, int smallest) {
+            if (option >= 0) return option;
+            switch (options.preset) {
+                case EncodePreset::Fastest: return fastest;
+                case EncodePreset::Fast: return fast;
+                case EncodePreset::Smallest: return smallest;
+                default: return balanced;
+            }
+        }
+
+        /// @brief Wraps an OutputSink for the codec callbacks, counting the bytes and remembering if the sink failed
+        struct SinkWriter {
+            OutputSink const& sink;
+            size_t written = 0;
+            bool failed = false;
+
+            bool write(void const* data, size_t size) {
+                if (failed) return false;
+                if (size == 0) return true;
+                if (!sink.write || !sink.write(data, size)) {
+                    failed = true;
+                    return false;
+                }
+                written += size;
+                return true;
+            }
+
+            /// @brief Result for the *To functions, once the encoder finished
+            geode::Result<size_t> finish() const {
+                if (failed) return geode::Err("Failed to write encoded data");
+                return geode::Ok(written);
+            }
+        };
+    }
+IMAGE_PLUS_END_NAMESPACE
@@ -4,8 +4,8 @@
 #import <ImageIO/ImageIO.h>
 #import <CoreGraphics/CoreGraphics.h>
 
+#include "../BufferPool.hpp"
 #include "../FakeVector.hpp"
-#include "../Utils.hpp"
 
 using namespace geode;
 
@@ -47,7 +47,7 @@ namespace decode {
         size_t height = CGImageGetHeight(image);
         size_t totalSize = width * height * 4;
 
-        auto output = util::make_unique(totalSize);
+        auto output = BufferPool::get().acquire(totalSize);
         if (!output) {
             CGImageRelease(image);
             return Err("Failed to allocate memory for decoded CgBI image");
@@ -5,81 +5,347 @@
 #define STBI_ONLY_GIF
 #include <stb_image.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <vector>
 
+#include "Internal.hpp"
+#include "../AnimationSource.hpp"
+#include "../BufferPool.hpp"
 #include "../Utils.hpp"
 
 using namespace geode;
 
 IMAGE_PLUS_BEGIN_NAMESPACE
 namespace decode {
-    Result<DecodedResult> gif(void const* data, size_t size) {
-        int* delays = nullptr;
-        int x, y, n, frames;
-
-        uint8_t* raw = stbi_load_gif_from_memory(
-            static_cast<stbi_uc const*>(data),
-            static_cast<int>(size),
-            &delays, &x, &y, &frames, &n, 4
-        );
+    /// @brief Frame timing info gathered without decoding any pixels
+    struct GifInfo {
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint16_t loopCount = 0;
+        std::vector<uint32_t> delays;
+        std::vector<FrameRect> dirty; // canvas region each frame can change, including previous frame disposal
+        bool restoresPrevious = false; // whether any frame uses "restore to previous" disposal
+    };
 
-        if (!raw) {
-            return Err(fmt::format("Failed to decode GIF: {}", stbi_failure_reason()));
+    static bool skipSubBlocks(uint8_t const* data, size_t size, size_t& offset) {
+        while (offset < size) {
+            uint8_t length = data[offset++];
+            if (length == 0) return true;
+            offset += length;
         }
+        return false;
+    }
 
-        if (frames <= 0) {
-            STBI_FREE(raw);
-            STBI_FREE(delays);
-            return Err("No frames found in GIF");
+    /// @brief Walks the GIF block structure to collect the frame count and delays
+    static Result<GifInfo> scanGif(void const* data, size_t size) {
+        auto bytes = static_cast<uint8_t const*>(data);
+        if (size < 13 || std::memcmp(bytes, "GIF8", 4) != 0)
+            return Err("Invalid GIF header");
+
+        GifInfo info;
+        info.width = static_cast<uint16_t>(bytes[6] | (bytes[7] << 8));
+        info.height = static_cast<uint16_t>(bytes[8] | (bytes[9] << 8));
+
+        size_t offset = 13;
+        if (bytes[10] & 0x80) {
+            offset += 3 * (1 << ((bytes[10] & 7) + 1));
         }
 
-        if (frames == 1) {
-            DecodedImage img;
-            img.width  = static_cast<uint16_t>(x);
-            img.height = static_cast<uint16_t>(y);
-            img.hasAlpha = true;
-            size_t imageSize = static_cast<size_t>(x) * y * 4;
-            img.data = util::make_unique(imageSize);
-            if (!img.data) {
-                STBI_FREE(raw);
-                STBI_FREE(delays);
-                return Err("Failed to allocate memory for GIF image");
+        uint32_t delay = 0;
+        uint8_t dispose = 0;
+        FrameRect disposed; // region that gets cleared/restored before the next frame
+        while (offset < size) {
+            switch (bytes[offset++]) {
+                case 0x21: { // extension
+                    if (offset >= size) return Err("Truncated GIF extension");
+                    uint8_t label = bytes[offset++];
+                    if (label == 0xF9 && offset + 5 <= size && bytes[offset] >= 4) {
+                        // graphic control extension, stb_image reports delays in milliseconds
+                        delay = 10 * (bytes[offset + 2] | (bytes[offset + 3] << 8));
+                        dispose = (bytes[offset + 1] >> 2) & 7;
+                    } else if (label == 0xFF && offset + 16 <= size && std::memcmp(bytes + offset + 1, "NETSCAPE2.0", 11) == 0) {
+                        if (bytes[offset + 12] >= 3 && bytes[offset + 13] == 1) {
+                            info.loopCount = static_cast<uint16_t>(bytes[offset + 14] | (bytes[offset + 15] << 8));
+                        }
+                    }
+                    if (!skipSubBlocks(bytes, size, offset)) return Err("Truncated GIF extension");
+                    break;
+                }
+                case 0x2C: { // image descriptor
+                    if (offset + 9 > size) return Err("Truncated GIF image descriptor");
+                    FrameRect rect {
+                        static_cast<uint16_t>(bytes[offset] | (bytes[offset + 1] << 8)),
+                        static_cast<uint16_t>(bytes[offset + 2] | (bytes[offset + 3] << 8)),
+                        static_cast<uint16_t>(bytes[offset + 4] | (bytes[offset + 5] << 8)),
+                        static_cast<uint16_t>(bytes[offset + 6] | (bytes[offset + 7] << 8)),
+                    };
+                    if (rect.x + rect.width > info.width || rect.y + rect.height > info.height)
+                        return Err("Invalid GIF image descriptor");
+
+                    uint8_t flags = bytes[offset + 8];
+                    offset += 9;
+                    if (flags & 0x80) {
+                        offset += 3 * (1 << ((flags & 7) + 1));
+                    }
+                    offset++; // LZW minimum code size
+                    if (!skipSubBlocks(bytes, size, offset)) return Err("Truncated GIF image data");
+
+                    // like stb_image, the last seen delay carries over to the following frames
+                    info.delays.push_back(std::max<uint32_t>(1, delay));
+
+                    // stb_image always composites the first frame over a fully cleared canvas
+                    if (info.dirty.empty()) info.dirty.push_back({ 0, 0, info.width, info.height });
+                    else info.dirty.push_back(rect.merge(disposed));
+
+                    // "restore to background" and "restore to previous" touch the whole frame rect
+                    disposed = dispose == 2 || dispose == 3 ? rect : FrameRect{};
+                    info.restoresPrevious |= dispose == 3;
+                    break;
+                }
+                case 0x3B: // trailer
+                    return Ok(std::move(info));
+                default:
+                    return Err("Unknown GIF block");
             }
+        }
+
+        // some encoders forget the trailer, stb_image doesn't mind either
+        if (info.delays.empty()) return Err("No frames found in GIF");
+        return Ok(std::move(info));
+    }
+
+    /// @brief Decodes GIF frames one at a time using stb_image internals,
+    /// instead of stb's loader that puts every frame into one contiguous block
+    class GifDecoder {
+    public:
+        /// @note Data is not copied, so it has to outlive the decoder
+        GifDecoder(uint8_t const* data, size_t size, uint16_t width, uint16_t height)
+            : m_data(data), m_size(size), m_width(width), m_height(height) {
+            this->reset();
+        }
+
+        ~GifDecoder() {
+            this->freeState();
+        }
 
-            std::memcpy(img.data.get(), raw, imageSize);
+        GifDecoder(GifDecoder const&) = delete;
+        GifDecoder& operator=(GifDecoder const&) = delete;
 
-            STBI_FREE(raw);
-            STBI_FREE(delays);
+        /// @brief Decodes the next frame and copies the composited RGBA canvas into the output buffer
+        /// @param out Output buffer, can be nullptr to only advance the decoder
+        /// @param twoBack Canvas from two frames ago, needed for "restore to previous" disposal
+        /// @return false if there are no more frames
+        Result<bool> next(uint8_t* out, uint8_t const* twoBack) {
+            int comp = 0;
+            auto* frame = stbi__gif_load_next(&m_context, m_gif.get(), &comp, 4, const_cast<stbi_uc*>(twoBack));
+            if (frame == reinterpret_cast<stbi_uc*>(&m_context))
+                return Ok(false);
+            if (!frame)
+                return Err(fmt::format("Failed to decode GIF frame: {}", stbi_failure_reason()));
+
+            if (m_gif->w != m_width || m_gif->h != m_height)
+                return Err("GIF frame size does not match the header");
+
+            if (out) std::memcpy(out, frame, static_cast<size_t>(m_width) * m_height * 4);
+            return Ok(true);
+        }
+
+        /// @brief Delay of the last decoded frame in milliseconds
+        uint32_t getDelay() const {
+            return static_cast<uint32_t>(std::max(1, m_gif->delay));
+        }
+
+        void reset() {
+            this->freeState();
+            if (!m_gif) m_gif = std::make_unique<stbi__gif>();
+            std::memset(m_gif.get(), 0, sizeof(stbi__gif));
+            stbi__start_mem(&m_context, m_data, static_cast<int>(m_size));
+        }
+
+    private:
+        void freeState() {
+            if (!m_gif) return;
+            STBI_FREE(m_gif->out);
+            STBI_FREE(m_gif->history);
+            STBI_FREE(m_gif->background);
+        }
+
+        uint8_t const* m_data;
+        size_t m_size;
+        uint16_t m_width;
+        uint16_t m_height;
+        stbi__context m_context{};
+        std::unique_ptr<stbi__gif> m_gif; // quite big, so it lives on the heap
+    };
+
+    Result<DecodedResult> gifFrames(void const* data, size_t size, size_t maxFrames) {
+        GEODE_UNWRAP_INTO(auto info, scanGif(data, size));
+
+        GifDecoder decoder(static_cast<uint8_t const*>(data), size, info.width, info.height);
+        size_t frameSize = static_cast<size_t>(info.width) * info.height * 4;
+
+        // every frame is composited straight into its final buffer, earlier frames double as history for stb
+        std::vector<AnimationFrame> frames;
+        frames.reserve(std::min(info.delays.size(), maxFrames));
+        while (frames.size() < maxFrames) {
+            AnimationFrame frame;
+            frame.data = BufferPool::get().acquire(frameSize);
+            if (!frame.data)
+                return Err("Failed to allocate memory for GIF frame");
+
+            uint8_t const* twoBack = frames.size() >= 2 ? frames[frames.size() - 2].data.get() : nullptr;
+            GEODE_UNWRAP_INTO(bool decoded, decoder.next(frame.data.get(), twoBack));
+            if (!decoded) break;
+
+            frame.delay = decoder.getDelay();
+            frames.push_back(std::move(frame));
+        }
+
+        if (frames.empty())
+            return Err("No frames found in GIF");
 
+        if (frames.size() == 1) {
+            DecodedImage img;
+            img.width  = info.width;
+            img.height = info.height;
+            img.hasAlpha = true;
+            img.data = std::move(frames[0].data);
             return Ok(DecodedResult{std::move(img)});
         }
 
         DecodedAnimation anim;
-        anim.width  = static_cast<uint16_t>(x);
-        anim.height = static_cast<uint16_t>(y);
+        anim.width  = info.width;
+        anim.height = info.height;
         anim.hasAlpha = true;
-        anim.loopCount = 0;
-
-        size_t frameSize = static_cast<size_t>(x) * y * 4;
-        for (int i = 0; i < frames; i++) {
-            AnimationFrame f;
-            f.delay = std::max(1, delays[i]);
-            f.data = util::make_unique(frameSize);
-            if (!f.data) {
-                STBI_FREE(raw);
-                STBI_FREE(delays);
-                return Err("Failed to allocate memory for GIF frame");
+        anim.loopCount = info.loopCount;
+        anim.frames = std::move(frames);
+
+        return Ok(DecodedResult{std::move(anim)});
+    }
+
+    Result<DecodedResult> gif(void const* data, size_t size) {
+        return gifFrames(data, size, std::numeric_limits<size_t>::max());
+    }
+
+    Result<size_t> gifInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame) {
+        GEODE_UNWRAP_INTO(auto info, scanGif(data, size));
+        if (frame >= info.delays.size())
+            return Err("Frame index is out of range");
+
+        size_t frameSize = static_cast<size_t>(info.width) * info.height * 4;
+        if (bufSize < frameSize)
+            return Err("Output buffer is too small for decoded GIF frame");
+
+        GifDecoder decoder(static_cast<uint8_t const*>(data), size, info.width, info.height);
+
+        // frames before the requested one only have to be kept if a later frame can restore them,
+        // otherwise stb's own canvas is enough and nothing is copied until the last frame
+        std::unique_ptr<uint8_t[]> history[2];
+        for (size_t i = 0; i <= frame; ++i) {
+            uint8_t* out = i == frame ? static_cast<uint8_t*>(buf) : nullptr;
+            uint8_t const* twoBack = nullptr;
+
+            if (info.restoresPrevious) {
+                auto& slot = history[i % 2];
+                if (i >= 2) twoBack = slot.get();
+                if (!out) {
+                    if (!slot) slot = util::make_unique(frameSize);
+                    if (!slot) return Err("Failed to allocate memory for GIF history");
+                    out = slot.get(); // safe to overwrite, twoBack is only read before the copy
+                }
             }
 
-            std::memcpy(f.data.get(), raw + i * frameSize, frameSize);
-            anim.frames.push_back(std::move(f));
+            GEODE_UNWRAP_INTO(bool decoded, decoder.next(out, twoBack));
+            if (!decoded)
+                return Err("Frame index is out of range");
         }
 
-        STBI_FREE(raw);
-        STBI_FREE(delays);
+        return Ok(frameSize);
+    }
 
-        return Ok(DecodedResult{std::move(anim)});
+    Result<ImageInfo> gifInfo(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto scan, scanGif(data, size));
+
+        // decoder always outputs RGBA, since any frame can have transparent pixels
+        ImageInfo info {
+            .format = ImageFormat::Gif,
+            .width = scan.width,
+            .height = scan.height,
+            .hasAlpha = true,
+            .frameCount = static_cast<uint32_t>(scan.delays.size()),
+        };
+
+        if (info.isAnimated()) {
+            info.loopCount = scan.loopCount;
+            for (auto delay : scan.delays) {
+                info.totalDuration += delay;
+            }
+        }
+
+        return Ok(info);
+    }
+
+    Result<DecodedResult> gifHeader(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto info, gifInfo(data, size));
+        return Ok(toHeaderResult(info));
+    }
+
+    /// @brief Streams frames from the GIF decoder, keeping only the last two canvases around for disposal
+    class GifAnimationSource : public AnimationSource {
+    public:
+        GifAnimationSource(std::vector<uint8_t> data, GifInfo&& info)
+            : AnimationSource(info.width, info.height, true, info.loopCount, std::move(info.delays)),
+              m_data(std::move(data)), m_dirty(std::move(info.dirty)),
+              m_decoder(m_data.data(), m_data.size(), this->getWidth(), this->getHeight()) {}
+
+        FrameRect getDirtyRect(size_t index) const override {
+            return m_dirty[index];
+        }
+
+    protected:
+        Result<> decodeNext(uint8_t* out) override {
+            // stb needs the frame from two steps back for "restore to previous" disposal
+            auto& history = m_history[m_next % 2];
+            uint8_t const* twoBack = m_next >= 2 ? history.get() : nullptr;
+
+            GEODE_UNWRAP_INTO(bool decoded, m_decoder.next(out, twoBack));
+            if (!decoded)
+                return Err("No more frames in animation");
+
+            size_t frameSize = this->getFrameSize();
+            if (!history) {
+                history = allocatePixels(frameSize);
+                if (!history) return Err("Failed to allocate memory for GIF history");
+            }
+            std::memcpy(history.get(), out, frameSize);
+
+            m_next++;
+            return Ok();
+        }
+
+        Result<> rewind() override {
+            m_decoder.reset();
+            m_next = 0;
+            return Ok();
+        }
+
+    private:
+        std::vector<uint8_t> m_data;
+        std::vector<FrameRect> m_dirty;
+        GifDecoder m_decoder; // has to be initialized after m_data
+        PixelBuffer m_history[2];
+        size_t m_next = 0;
+    };
+
+    Result<std::shared_ptr<AnimationSource>> gifSource(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto info, scanGif(data, size));
+        if (info.delays.size() <= 1) return Ok(nullptr);
+
+        std::vector<uint8_t> copy(static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+        return Ok(std::make_shared<GifAnimationSource>(std::move(copy), std::move(info)));
     }
 }
 IMAGE_PLUS_END_NAMESPACE
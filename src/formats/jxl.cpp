@@ -1,21 +1,53 @@
 #include <api.hpp>
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <jxl/decode.h>
 #include <jxl/decode_cxx.h>
 #include <jxl/encode.h>
 #include <jxl/encode_cxx.h>
-#include <jxl/resizable_parallel_runner_cxx.h>
+#include <jxl/parallel_runner.h>
+
+#include "Internal.hpp"
+#include "../AnimationSource.hpp"
+#include "../BufferPool.hpp"
+#include "../Metrics.hpp"
+#include "../ThreadPool.hpp"
 
 using namespace geode;
 
 IMAGE_PLUS_BEGIN_NAMESPACE
+/// @brief JxlParallelRunner that runs on the shared thread pool, so concurrent decodes don't each spawn their own threads
+/// @note The runner opaque can point to a size_t with a lower thread limit for this decoder/encoder
+static JxlParallelRetCode runOnThreadPool(
+    void* limit, void* opaque, JxlParallelRunInit init, JxlParallelRunFunction func, uint32_t start, uint32_t end
+) {
+    if (start > end) return JXL_PARALLEL_RET_RUNNER_ERROR;
+    if (start == end) return 0;
+
+    // thread numbers index libjxl's per-thread state, so they have to stay below what it was initialized with
+    auto& pool = ThreadPool::get();
+    size_t threads = std::min<size_t>(pool.getThreadCount(), end - start);
+    if (limit && *static_cast<size_t*>(limit)) threads = std::min(threads, *static_cast<size_t*>(limit));
+    if (auto ret = init(opaque, threads); ret != 0) return ret;
+
+    pool.parallelFor(end - start, [&](size_t index, size_t thread) {
+        func(opaque, start + static_cast<uint32_t>(index), thread);
+    }, threads);
+    return 0;
+}
+
 namespace decode {
+    static uint32_t frameDelay(JxlBasicInfo const& info, uint32_t duration) {
+        uint64_t ms_per_tick = 1000ULL * info.animation.tps_denominator / info.animation.tps_numerator;
+        return static_cast<uint32_t>(duration * ms_per_tick);
+    }
+
     Result<DecodedResult> jpegxl(void const* data, size_t size) {
-        auto runner = JxlResizableParallelRunnerMake(nullptr);
         auto decoder = JxlDecoderMake(nullptr);
-        if (!runner || !decoder)
-            return Err("Failed to allocate JPEG XL decoder or runner");
+        if (!decoder)
+            return Err("Failed to allocate JPEG XL decoder");
 
         constexpr uint32_t events = JXL_DEC_BASIC_INFO
                                   | JXL_DEC_COLOR_ENCODING
@@ -24,13 +56,8 @@ namespace decode {
         if (JxlDecoderSubscribeEvents(decoder.get(), events) != JXL_DEC_SUCCESS)
             return Err("Failed to subscribe to JPEG XL decoder events");
 
-        if (JxlDecoderSetParallelRunner(
-                decoder.get(),
-                JxlResizableParallelRunner,
-                runner.get()
-            ) != JXL_DEC_SUCCESS) {
+        if (JxlDecoderSetParallelRunner(decoder.get(), runOnThreadPool, nullptr) != JXL_DEC_SUCCESS)
             return Err("Failed to set JPEG XL parallel runner");
-        }
 
         JxlDecoderSetInput(decoder.get(), static_cast<uint8_t const*>(data), size);
 
@@ -67,12 +94,11 @@ namespace decode {
                 format.num_channels = anim.hasAlpha ? 4 : 3;
                 format.endianness = JXL_NATIVE_ENDIAN;
                 format.align = 0;
-
-                int threads = JxlResizableParallelRunnerSuggestThreads(info.xsize, info.ysize);
-                JxlResizableParallelRunnerSetThreads(runner.get(), threads);
             } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
                 JxlDecoderImageOutBufferSize(decoder.get(), &format, &frameBufSize);
-                frameBuf.reset(new uint8_t[frameBufSize]);
+                frameBuf = BufferPool::get().acquire(frameBufSize);
+                if (!frameBuf)
+                    return Err("Failed to allocate memory for JPEG XL frame");
 
                 if (JxlDecoderSetImageOutBuffer(
                         decoder.get(),
@@ -86,9 +112,7 @@ namespace decode {
                 AnimationFrame frame;
                 frame.data = std::move(frameBuf);
                 if (isAnim) {
-                    uint64_t ticks = frame_header.duration;
-                    uint64_t ms_per_tick = 1000ULL * info.animation.tps_denominator / info.animation.tps_numerator;
-                    frame.delay = static_cast<uint32_t>(ticks * ms_per_tick);
+                    frame.delay = frameDelay(info, frame_header.duration);
                 }
 
                 anim.frames.push_back(std::move(frame));
@@ -113,24 +137,248 @@ namespace decode {
             }
         }
     }
+
+    Result<size_t> jpegxlInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame) {
+        auto decoder = JxlDecoderMake(nullptr);
+        if (!decoder)
+            return Err("Failed to allocate JPEG XL decoder");
+
+        if (JxlDecoderSubscribeEvents(decoder.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+            return Err("Failed to subscribe to JPEG XL decoder events");
+
+        if (JxlDecoderSetParallelRunner(decoder.get(), runOnThreadPool, nullptr) != JXL_DEC_SUCCESS)
+            return Err("Failed to set JPEG XL parallel runner");
+
+        JxlDecoderSetInput(decoder.get(), static_cast<uint8_t const*>(data), size);
+        JxlDecoderCloseInput(decoder.get());
+
+        JxlBasicInfo info{};
+        JxlPixelFormat format{};
+        size_t outSize = 0;
+
+        while (true) {
+            auto status = JxlDecoderProcessInput(decoder.get());
+
+            if (status == JXL_DEC_ERROR)
+                return Err("JPEG XL decoder error");
+            if (status == JXL_DEC_NEED_MORE_INPUT)
+                return Err("JPEG XL needs more input unexpectedly");
+            if (status == JXL_DEC_SUCCESS)
+                return Err("Frame index is out of range");
+
+            if (status == JXL_DEC_BASIC_INFO) {
+                if (JxlDecoderGetBasicInfo(decoder.get(), &info) != JXL_DEC_SUCCESS)
+                    return Err("Failed to get JPEG XL basic info");
+
+                // same pixel layout as jpegxl() produces
+                format.data_type = info.bits_per_sample > 8 ? JXL_TYPE_UINT16 : JXL_TYPE_UINT8;
+                format.num_channels = info.alpha_bits > 0 ? 4 : 3;
+                format.endianness = JXL_NATIVE_ENDIAN;
+                format.align = 0;
+
+                // skipped frames are still decoded internally (later frames can reference them), but never output
+                if (frame > 0) {
+                    if (!info.have_animation)
+                        return Err("Frame index is out of range");
+                    JxlDecoderSkipFrames(decoder.get(), frame);
+                }
+            } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+                if (JxlDecoderImageOutBufferSize(decoder.get(), &format, &outSize) != JXL_DEC_SUCCESS)
+                    return Err("Failed to get JPEG XL decoded image size");
+
+                if (bufSize < outSize)
+                    return Err("Output buffer is too small for decoded JPEG XL image");
+
+                if (JxlDecoderSetImageOutBuffer(decoder.get(), &format, buf, outSize) != JXL_DEC_SUCCESS)
+                    return Err("Failed to set JPEG XL output buffer");
+            } else if (status == JXL_DEC_FULL_IMAGE) {
+                return Ok(outSize);
+            }
+        }
+    }
+
+    /// @brief Collects basic info and frame durations, skipping the pixel data
+    static Result<std::pair<JxlBasicInfo, std::vector<uint32_t>>> probeJxl(void const* data, size_t size) {
+        auto decoder = JxlDecoderMake(nullptr);
+        if (!decoder)
+            return Err("Failed to allocate JPEG XL decoder");
+
+        if (JxlDecoderSubscribeEvents(decoder.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FRAME) != JXL_DEC_SUCCESS)
+            return Err("Failed to subscribe to JPEG XL decoder events");
+
+        JxlDecoderSetInput(decoder.get(), static_cast<uint8_t const*>(data), size);
+        JxlDecoderCloseInput(decoder.get());
+
+        JxlBasicInfo info{};
+        std::vector<uint32_t> delays;
+
+        while (true) {
+            auto status = JxlDecoderProcessInput(decoder.get());
+
+            if (status == JXL_DEC_ERROR)
+                return Err("JPEG XL decoder error");
+            if (status == JXL_DEC_NEED_MORE_INPUT)
+                return Err("JPEG XL needs more input unexpectedly");
+
+            if (status == JXL_DEC_BASIC_INFO) {
+                if (JxlDecoderGetBasicInfo(decoder.get(), &info) != JXL_DEC_SUCCESS)
+                    return Err("Failed to get JPEG XL basic info");
+                if (!info.have_animation)
+                    return Ok(std::make_pair(info, std::move(delays)));
+            } else if (status == JXL_DEC_FRAME) {
+                JxlFrameHeader header{};
+                if (JxlDecoderGetFrameHeader(decoder.get(), &header) != JXL_DEC_SUCCESS)
+                    return Err("Failed to get JPEG XL frame header");
+                delays.push_back(frameDelay(info, header.duration));
+            } else if (status == JXL_DEC_SUCCESS) {
+                return Ok(std::make_pair(info, std::move(delays)));
+            }
+        }
+    }
+
+    /// @brief Keeps a JPEG XL decoder alive and pulls frames from it one at a time
+    class JxlAnimationSource : public AnimationSource {
+    public:
+        JxlAnimationSource(std::vector<uint8_t> data, JxlBasicInfo const& info, std::vector<uint32_t> delays)
+            : AnimationSource(
+                static_cast<uint16_t>(info.xsize), static_cast<uint16_t>(info.ysize),
+                info.alpha_bits > 0, static_cast<uint16_t>(info.animation.num_loops), std::move(delays)
+            ), m_data(std::move(data)) {
+            m_format.data_type = JXL_TYPE_UINT8;
+            m_format.num_channels = this->hasAlpha() ? 4 : 3;
+            m_format.endianness = JXL_NATIVE_ENDIAN;
+            m_format.align = 0;
+        }
+
+        Result<> init() {
+            m_decoder = JxlDecoderMake(nullptr);
+            if (!m_decoder)
+                return Err("Failed to allocate JPEG XL decoder");
+
+            if (JxlDecoderSubscribeEvents(m_decoder.get(), JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS)
+                return Err("Failed to subscribe to JPEG XL decoder events");
+
+            if (JxlDecoderSetParallelRunner(m_decoder.get(), runOnThreadPool, nullptr) != JXL_DEC_SUCCESS)
+                return Err("Failed to set JPEG XL parallel runner");
+
+            return this->rewind();
+        }
+
+    protected:
+        Result<> decodeNext(uint8_t* out) override {
+            while (true) {
+                auto status = JxlDecoderProcessInput(m_decoder.get());
+
+                if (status == JXL_DEC_ERROR)
+                    return Err("JPEG XL decoder error");
+                if (status == JXL_DEC_NEED_MORE_INPUT)
+                    return Err("JPEG XL needs more input unexpectedly");
+                if (status == JXL_DEC_SUCCESS)
+                    return Err("No more frames in animation");
+
+                if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+                    if (JxlDecoderSetImageOutBuffer(m_decoder.get(), &m_format, out, this->getFrameSize()) != JXL_DEC_SUCCESS)
+                        return Err("Failed to set JPEG XL output buffer");
+                } else if (status == JXL_DEC_FULL_IMAGE) {
+                    return Ok();
+                }
+            }
+        }
+
+        Result<> rewind() override {
+            JxlDecoderRewind(m_decoder.get());
+            if (JxlDecoderSetInput(m_decoder.get(), m_data.data(), m_data.size()) != JXL_DEC_SUCCESS)
+                return Err("Failed to set JPEG XL input");
+            JxlDecoderCloseInput(m_decoder.get());
+            return Ok();
+        }
+
+    private:
+        std::vector<uint8_t> m_data;
+        JxlDecoderPtr m_decoder;
+        JxlPixelFormat m_format{};
+    };
+
+    Result<ImageInfo> jpegxlInfo(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto probe, probeJxl(data, size));
+        auto& [basic, delays] = probe;
+
+        ImageInfo info {
+            .format = ImageFormat::JpegXL,
+            .width = static_cast<uint16_t>(basic.xsize),
+            .height = static_cast<uint16_t>(basic.ysize),
+            .bit_depth = static_cast<uint8_t>(basic.bits_per_sample),
+            .hasAlpha = basic.alpha_bits > 0,
+        };
+
+        // single frame "animations" are decoded as static images
+        if (basic.have_animation && delays.size() > 1) {
+            info.frameCount = static_cast<uint32_t>(delays.size());
+            info.loopCount = static_cast<uint16_t>(basic.animation.num_loops);
+            for (auto delay : delays) {
+                info.totalDuration += delay;
+            }
+        }
+
+        return Ok(info);
+    }
+
+    Result<DecodedResult> jpegxlHeader(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto info, jpegxlInfo(data, size));
+        return Ok(toHeaderResult(info));
+    }
+
+    Result<std::shared_ptr<AnimationSource>> jpegxlSource(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto probe, probeJxl(data, size));
+        auto& [info, delays] = probe;
+        if (!info.have_animation || delays.size() <= 1) return Ok(nullptr);
+
+        std::vector<uint8_t> copy(static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+        auto source = std::make_shared<JxlAnimationSource>(std::move(copy), info, std::move(delays));
+        GEODE_UNWRAP(source->init());
+        return Ok(std::move(source));
+    }
 }
 
 namespace encode {
-    Result<ByteVector> jpegxl(void const* image, uint16_t width, uint16_t height, bool hasAlpha, float quality) {
+    /// @brief Creates settings for the next frame, Balanced uses effort 7
+    static Result<JxlEncoderFrameSettings*> makeFrameSettings(JxlEncoder* encoder, EncodeOptions const& options) {
+        auto frame_settings = JxlEncoderFrameSettingsCreate(encoder, nullptr);
+        if (!frame_settings)
+            return Err("Failed to create JPEG XL frame settings");
+
+        if (options.lossless) {
+            if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) != JXL_ENC_SUCCESS)
+                return Err("Failed to enable lossless JPEG XL encode");
+        } else {
+            float distance = JxlEncoderDistanceFromQuality(options.quality);
+            if (JxlEncoderSetFrameDistance(frame_settings, distance) != JXL_ENC_SUCCESS)
+                return Err("Failed to set JPEG XL frame distance");
+        }
+
+        int effort = fromPreset(options.jpegxl.effort, options, 1, 3, 7, 9);
+        if (JxlEncoderFrameSettingsSetOption(frame_settings, JXL_ENC_FRAME_SETTING_EFFORT, effort) != JXL_ENC_SUCCESS)
+            return Err("Failed to set JPEG XL effort");
+
+        return Ok(frame_settings);
+    }
+
+    /// @brief Sets up the parallel runner, reading the thread limit from `threads` while the encoder runs
+    static Result<> setRunner(JxlEncoder* encoder, size_t* threads) {
+        if (JxlEncoderSetParallelRunner(encoder, runOnThreadPool, threads) != JXL_ENC_SUCCESS)
+            return Err("Failed to set JPEG XL parallel runner");
+        return Ok();
+    }
+
+    static Result<> addImage(
+        JxlEncoder* encoder, void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options
+    ) {
         if (!image)
             return Err("Invalid image data");
 
         if (width == 0 || height == 0)
             return Err("Invalid image dimensions");
 
-        auto runner = JxlResizableParallelRunnerMake(nullptr);
-        auto encoder = JxlEncoderMake(nullptr);
-        if (!runner || !encoder)
-            return Err("Failed to allocate JPEG XL encoder or runner");
-
-        if (JxlEncoderSetParallelRunner(encoder.get(), JxlResizableParallelRunner, runner.get()) != JXL_ENC_SUCCESS)
-            return Err("Failed to set JPEG XL parallel runner");
-
         JxlBasicInfo basic_info{};
         JxlEncoderInitBasicInfo(&basic_info);
         basic_info.xsize = static_cast<uint32_t>(width);
@@ -139,26 +387,12 @@ namespace encode {
         basic_info.alpha_bits = hasAlpha ? 8u : 0u;
         basic_info.num_extra_channels = hasAlpha ? 1u : 0u;
         basic_info.have_animation = JXL_FALSE;
-        basic_info.uses_original_profile = quality >= 99.0f ? JXL_TRUE : JXL_FALSE;
+        basic_info.uses_original_profile = options.lossless ? JXL_TRUE : JXL_FALSE;
 
-        if (JxlEncoderSetBasicInfo(encoder.get(), &basic_info) != JXL_ENC_SUCCESS)
+        if (JxlEncoderSetBasicInfo(encoder, &basic_info) != JXL_ENC_SUCCESS)
             return Err("Failed to set JPEG XL basic info");
 
-        auto frame_settings = JxlEncoderFrameSettingsCreate(encoder.get(), nullptr);
-        if (!frame_settings)
-            return Err("Failed to create JPEG XL frame settings");
-
-        if (quality >= 99.0f) {
-            if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) != JXL_ENC_SUCCESS)
-                return Err("Failed to enable lossless JPEG XL encode");
-        } else {
-            float distance = JxlEncoderDistanceFromQuality(quality);
-            if (JxlEncoderSetFrameDistance(frame_settings, distance) != JXL_ENC_SUCCESS)
-                return Err("Failed to set JPEG XL frame distance");
-        }
-
-        if (JxlEncoderFrameSettingsSetOption(frame_settings, JXL_ENC_FRAME_SETTING_EFFORT, 7) != JXL_ENC_SUCCESS)
-            return Err("Failed to set JPEG XL effort");
+        GEODE_UNWRAP_INTO(auto frame_settings, makeFrameSettings(encoder, options));
 
         JxlPixelFormat pixel_format{};
         pixel_format.data_type = JXL_TYPE_UINT8;
@@ -173,45 +407,14 @@ namespace encode {
         if (JxlEncoderAddImageFrame(frame_settings, &pixel_format, image, total_bytes) != JXL_ENC_SUCCESS)
             return Err("Failed to add image frame to JPEG XL encoder");
 
-        JxlEncoderCloseInput(encoder.get());
-
-        ByteVector out;
-        constexpr size_t chunk_size = 1 << 15;
-        std::vector<uint8_t> buffer(chunk_size);
-
-        while (true) {
-            uint8_t* out_ptr = buffer.data();
-            size_t avail = buffer.size();
-            JxlEncoderStatus status = JxlEncoderProcessOutput(encoder.get(), &out_ptr, &avail);
-
-            size_t written = buffer.size() - avail;
-            if (written)
-                out.insert(out.end(), buffer.data(), buffer.data() + written);
-
-            if (status == JXL_ENC_SUCCESS)
-                break;
-
-            if (status == JXL_ENC_ERROR) {
-                auto err = JxlEncoderGetError(encoder.get());
-                return Err(fmt::format("JPEG XL encoding error: {}", static_cast<uint32_t>(err)));
-            }
-        }
-
-        return Ok(std::move(out));
+        JxlEncoderCloseInput(encoder);
+        return Ok();
     }
 
-    Result<ByteVector> jpegxl(DecodedAnimation const& anim, float quality) {
+    static Result<> addAnimation(JxlEncoder* encoder, DecodedAnimation const& anim, EncodeOptions const& options) {
         if (anim.frames.empty())
             return Err("Animation has no frames");
 
-        auto runner = JxlResizableParallelRunnerMake(nullptr);
-        auto encoder = JxlEncoderMake(nullptr);
-        if (!runner || !encoder)
-            return Err("Failed to allocate JPEG XL encoder or runner");
-
-        if (JxlEncoderSetParallelRunner(encoder.get(), JxlResizableParallelRunner, runner.get()) != JXL_ENC_SUCCESS)
-            return Err("Failed to set JPEG XL parallel runner");
-
         JxlBasicInfo basic_info{};
         JxlEncoderInitBasicInfo(&basic_info);
         basic_info.xsize = static_cast<uint32_t>(anim.width);
@@ -224,7 +427,7 @@ namespace encode {
         basic_info.animation.tps_numerator = 1000;
         basic_info.animation.tps_denominator = 1;
 
-        if (JxlEncoderSetBasicInfo(encoder.get(), &basic_info) != JXL_ENC_SUCCESS)
+        if (JxlEncoderSetBasicInfo(encoder, &basic_info) != JXL_ENC_SUCCESS)
             return Err("Failed to set JPEG XL basic info for animation");
 
         JxlPixelFormat pixel_format{};
@@ -234,21 +437,7 @@ namespace encode {
         pixel_format.align = 0;
 
         for (auto const& f : anim.frames) {
-            auto frame_settings = JxlEncoderFrameSettingsCreate(encoder.get(), nullptr);
-            if (!frame_settings)
-                return Err("Failed to create JPEG XL frame settings for animation");
-
-            if (quality >= 99.0f) {
-                if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) != JXL_ENC_SUCCESS)
-                    return Err("Failed to enable lossless JPEG XL encode for animation");
-            } else {
-                float distance = JxlEncoderDistanceFromQuality(quality);
-                if (JxlEncoderSetFrameDistance(frame_settings, distance) != JXL_ENC_SUCCESS)
-                    return Err("Failed to set JPEG XL frame distance for animation");
-            }
-
-            if (JxlEncoderFrameSettingsSetOption(frame_settings, JXL_ENC_FRAME_SETTING_EFFORT, 7) != JXL_ENC_SUCCESS)
-                return Err("Failed to set JPEG XL effort for animation");
+            GEODE_UNWRAP_INTO(auto frame_settings, makeFrameSettings(encoder, options));
 
             JxlFrameHeader frame_header{};
             JxlEncoderInitFrameHeader(&frame_header);
@@ -267,31 +456,129 @@ namespace encode {
                 return Err("Failed to add animation frame to JPEG XL encoder");
         }
 
-        JxlEncoderCloseInput(encoder.get());
+        JxlEncoderCloseInput(encoder);
+        return Ok();
+    }
+
+    static std::string encoderError(JxlEncoder* encoder) {
+        return fmt::format("JPEG XL encoding error: {}", static_cast<uint32_t>(JxlEncoderGetError(encoder)));
+    }
 
-        ByteVector out;
-        constexpr size_t chunk_size = 1 << 15;
-        std::vector<uint8_t> buffer(chunk_size);
+    /// @brief Collects the encoded file, letting the encoder write straight into the vector's spare space
+    static Result<ByteVector> collectOutput(JxlEncoder* encoder) {
+        ByteVector out(1 << 16);
+        size_t size = 0;
+
+        while (true) {
+            uint8_t* out_ptr = out.data() + size;
+            size_t avail = out.size() - size;
+            JxlEncoderStatus status = JxlEncoderProcessOutput(encoder, &out_ptr, &avail);
+            size = out_ptr - out.data();
+
+            if (status == JXL_ENC_SUCCESS) {
+                out.resize(size);
+                return Ok(std::move(out));
+            }
+
+            if (status == JXL_ENC_ERROR)
+                return Err(encoderError(encoder));
+
+            out.resize(out.size() * 2);
+        }
+    }
+
+    /// @brief Passes the encoded file to the sink in fixed-size chunks, instead of collecting it into one buffer first
+    /// @note libjxl still keeps the whole codestream internally until it's drained here (that would need
+    /// JxlEncoderSetOutputProcessor), so this only saves the extra copy collectOutput makes
+    static Result<size_t> writeOutput(JxlEncoder* encoder, OutputSink const& sink) {
+        SinkWriter writer{sink};
+        std::vector<uint8_t> buffer(1 << 16);
 
         while (true) {
             uint8_t* out_ptr = buffer.data();
             size_t avail = buffer.size();
-            JxlEncoderStatus status = JxlEncoderProcessOutput(encoder.get(), &out_ptr, &avail);
+            JxlEncoderStatus status = JxlEncoderProcessOutput(encoder, &out_ptr, &avail);
 
-            size_t written = buffer.size() - avail;
-            if (written)
-                out.insert(out.end(), buffer.data(), buffer.data() + written);
+            if (!writer.write(buffer.data(), buffer.size() - avail) || status == JXL_ENC_SUCCESS)
+                return writer.finish();
 
-            if (status == JXL_ENC_SUCCESS)
-                break;
-
-            if (status == JXL_ENC_ERROR) {
-                auto err = JxlEncoderGetError(encoder.get());
-                return Err(fmt::format("JPEG XL encoding error: {}", static_cast<uint32_t>(err)));
-            }
+            if (status == JXL_ENC_ERROR)
+                return Err(encoderError(encoder));
         }
+    }
+
+    Result<ByteVector> jpegxl(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::JpegXL, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
+        auto encoder = JxlEncoderMake(nullptr);
+        if (!encoder)
+            return Err("Failed to allocate JPEG XL encoder");
+
+        size_t threads = options.threads;
+        GEODE_UNWRAP(setRunner(encoder.get(), &threads));
+        GEODE_UNWRAP(addImage(encoder.get(), image, width, height, hasAlpha, options));
+        GEODE_UNWRAP_INTO(auto encoded, collectOutput(encoder.get()));
+        scope.succeed(encoded.size(), pixelCount);
+        return Ok(std::move(encoded));
+    }
 
-        return Ok(std::move(out));
+    Result<ByteVector> jpegxl(void const* image, uint16_t width, uint16_t height, bool hasAlpha, float quality) {
+        return jpegxl(image, width, height, hasAlpha, legacyOptions(quality));
+    }
+
+    Result<size_t> jpegxlTo(
+        void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+    ) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::JpegXL, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
+        auto encoder = JxlEncoderMake(nullptr);
+        if (!encoder)
+            return Err("Failed to allocate JPEG XL encoder");
+
+        size_t threads = options.threads;
+        GEODE_UNWRAP(setRunner(encoder.get(), &threads));
+        GEODE_UNWRAP(addImage(encoder.get(), image, width, height, hasAlpha, options));
+        GEODE_UNWRAP_INTO(auto written, writeOutput(encoder.get(), sink));
+        scope.succeed(written, pixelCount);
+        return Ok(written);
+    }
+
+    Result<ByteVector> jpegxl(DecodedAnimation const& anim, EncodeOptions const& options) {
+        uint64_t pixelCount = static_cast<uint64_t>(anim.width) * anim.height * anim.frames.size();
+        Metrics::Scope scope(ImageFormat::JpegXL, Metrics::Op::Encode, pixelCount * (anim.hasAlpha ? 4 : 3));
+
+        auto encoder = JxlEncoderMake(nullptr);
+        if (!encoder)
+            return Err("Failed to allocate JPEG XL encoder");
+
+        size_t threads = options.threads;
+        GEODE_UNWRAP(setRunner(encoder.get(), &threads));
+        GEODE_UNWRAP(addAnimation(encoder.get(), anim, options));
+        GEODE_UNWRAP_INTO(auto encoded, collectOutput(encoder.get()));
+        scope.succeed(encoded.size(), pixelCount);
+        return Ok(std::move(encoded));
+    }
+
+    Result<ByteVector> jpegxl(DecodedAnimation const& anim, float quality) {
+        return jpegxl(anim, legacyOptions(quality));
+    }
+
+    Result<size_t> jpegxlTo(DecodedAnimation const& anim, EncodeOptions const& options, OutputSink const& sink) {
+        uint64_t pixelCount = static_cast<uint64_t>(anim.width) * anim.height * anim.frames.size();
+        Metrics::Scope scope(ImageFormat::JpegXL, Metrics::Op::Encode, pixelCount * (anim.hasAlpha ? 4 : 3));
+
+        auto encoder = JxlEncoderMake(nullptr);
+        if (!encoder)
+            return Err("Failed to allocate JPEG XL encoder");
+
+        size_t threads = options.threads;
+        GEODE_UNWRAP(setRunner(encoder.get(), &threads));
+        GEODE_UNWRAP(addAnimation(encoder.get(), anim, options));
+        GEODE_UNWRAP_INTO(auto written, writeOutput(encoder.get(), sink));
+        scope.succeed(written, pixelCount);
+        return Ok(written);
     }
 }
 IMAGE_PLUS_END_NAMESPACE
\ No newline at end of file
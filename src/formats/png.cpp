@@ -1,8 +1,11 @@
 #include <api.hpp>
 #include <spng.h>
 
+#include "Internal.hpp"
+#include "../BufferPool.hpp"
 #include "../FakeVector.hpp"
-#include "../Utils.hpp"
+#include "../Metrics.hpp"
+#include "../PixelKernels.hpp"
 
 using namespace geode;
 
@@ -23,7 +26,30 @@ namespace decode {
         return Ok();
     }
 
-    Result<DecodedImage> png(void const* data, size_t size) {
+    /// @brief Decodes rows one at a time, so that each row can be premultiplied while it's still in cache
+    static Result<> decodeRows(spng_ctx* ctx, int format, uint8_t* output, size_t rowSize, uint32_t width) {
+        if (spng_decode_image(ctx, nullptr, 0, format, SPNG_DECODE_PROGRESSIVE | (hasAlpha ? SPNG_DECODE_TRNS : 0)) != 0)
+            return Err("Failed to start progressive PNG decode");
+
+        int ret;
+        do {
+            spng_row_info info;
+            if (ret = spng_get_row_info(ctx, &info); ret != 0) break;
+
+            uint8_t* row = output + static_cast<size_t>(info.row_num) * rowSize;
+            ret = spng_decode_row(ctx, row, rowSize);
+            if (ret == 0 || ret == SPNG_EOI) {
+                pixels::premultiply(row, width);
+            }
+        } while (ret == 0);
+
+        if (ret != SPNG_EOI)
+            return Err(fmt::format("Failed to decode PNG image: {}", spng_strerror(ret)));
+
+        return Ok();
+    }
+
+    static Result<DecodedImage> decodePng(void const* data, size_t size, bool premultiply) {
         std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(0), &spng_ctx_free);
         spng_ihdr ihdr;
         GEODE_UNWRAP(parseHeader(data, size, ctx.get(), ihdr));
@@ -34,12 +60,21 @@ namespace decode {
         if (spng_decoded_image_size(ctx.get(), fmt, &totalSize) != 0)
             return Err("Failed to get PNG decoded image size");
 
-        auto output = util::make_unique(totalSize);
+        auto output = BufferPool::get().acquire(totalSize);
         if (!output)
             return Err("Failed to allocate memory for PNG image data");
 
-        if (spng_decode_image(ctx.get(), output.get(), totalSize, fmt, hasAlpha ? SPNG_DECODE_TRNS : 0) != 0) {
-            return Err("Failed to decode PNG image");
+        // interlaced images visit every row several times, so they have to be premultiplied afterwards
+        if (premultiply && ihdr.interlace_method == SPNG_INTERLACE_NONE) {
+            GEODE_UNWRAP(decodeRows(ctx.get(), fmt, output.get(), totalSize / ihdr.height, ihdr.width));
+        } else {
+            if (spng_decode_image(ctx.get(), output.get(), totalSize, fmt, hasAlpha ? SPNG_DECODE_TRNS : 0) != 0) {
+                return Err("Failed to decode PNG image");
+            }
+
+            if (premultiply) {
+                pixels::premultiply(output.get(), static_cast<size_t>(ihdr.width) * ihdr.height);
+            }
         }
 
         return Ok(DecodedImage{
@@ -47,10 +82,19 @@ namespace decode {
             .width = static_cast<uint16_t>(ihdr.width),
             .height = static_cast<uint16_t>(ihdr.height),
             .bit_depth = ihdr.bit_depth,
-            .hasAlpha = hasAlpha
+            .hasAlpha = hasAlpha,
+            .isPreMultiplied = premultiply
         });
     }
 
+    Result<DecodedImage> png(void const* data, size_t size) {
+        return decodePng(data, size, false);
+    }
+
+    Result<DecodedImage> pngPremultiplied(void const* data, size_t size) {
+        return decodePng(data, size, true);
+    }
+
     Result<DecodedImage> pngHeader(void const* data, size_t size) {
         std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(0), &spng_ctx_free);
         spng_ihdr ihdr;
@@ -65,6 +109,20 @@ namespace decode {
         });
     }
 
+    Result<ImageInfo> pngInfo(void const* data, size_t size) {
+        std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(0), &spng_ctx_free);
+        spng_ihdr ihdr;
+        GEODE_UNWRAP(parseHeader(data, size, ctx.get(), ihdr));
+
+        return Ok(ImageInfo {
+            .format = ImageFormat::Png,
+            .width = static_cast<uint16_t>(ihdr.width),
+            .height = static_cast<uint16_t>(ihdr.height),
+            .bit_depth = ihdr.bit_depth,
+            .hasAlpha = hasAlpha,
+        });
+    }
+
     Result<size_t> pngInto(void const* data, size_t size, void* buf, size_t bufSize) {
         std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(0), &spng_ctx_free);
         spng_ihdr ihdr;
@@ -88,17 +146,19 @@ namespace decode {
 }
 
 namespace encode {
-    Result<ByteVector> png(void const* image, uint16_t width, uint16_t height, bool hasAlpha) {
+    using PngContext = std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)>;
+
+    /// @brief Encodes the image into a context that was already set up to write to a buffer or a stream
+    static Result<> encodeImage(
+        spng_ctx* ctx, void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options
+    ) {
         if (!image)
             return Err("Invalid image data");
 
-        std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(SPNG_CTX_ENCODER), &spng_ctx_free);
-        if (!ctx)
-            return Err("Failed to create PNG context");
-
-        // Enable encoding to internal buffer
-        if (spng_set_option(ctx.get(), SPNG_ENCODE_TO_BUFFER, 1) != 0)
-            return Err("Failed to set buffer encoding option");
+        // Balanced keeps the zlib default (6)
+        int level = fromPreset(options.png.compressionLevel, options, 1, 3, -1, 9);
+        if (level >= 0 && spng_set_option(ctx, SPNG_IMG_COMPRESSION_LEVEL, level) != 0)
+            return Err("Failed to set PNG compression level");
 
         spng_ihdr ihdr = {};
         ihdr.width = width;
@@ -106,7 +166,7 @@ namespace encode {
         ihdr.bit_depth = 8;
         ihdr.color_type = hasAlpha ? SPNG_COLOR_TYPE_TRUECOLOR_ALPHA : SPNG_COLOR_TYPE_TRUECOLOR;
 
-        if (spng_set_ihdr(ctx.get(), &ihdr) != 0)
+        if (spng_set_ihdr(ctx, &ihdr) != 0)
             return Err("Failed to set PNG header");
 
         // Calculate the expected data size
@@ -114,9 +174,26 @@ namespace encode {
         size_t expectedSize = static_cast<size_t>(width) * height * channels;
 
         // Use SPNG_FMT_PNG to match the format specified in ihdr
-        if (spng_encode_image(ctx.get(), image, expectedSize, SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE) != 0)
+        if (spng_encode_image(ctx, image, expectedSize, SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE) != 0)
             return Err("Failed to encode PNG image");
 
+        return Ok();
+    }
+
+    Result<ByteVector> png(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::Png, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
+        PngContext ctx(spng_ctx_new(SPNG_CTX_ENCODER), &spng_ctx_free);
+        if (!ctx)
+            return Err("Failed to create PNG context");
+
+        // Enable encoding to internal buffer
+        if (spng_set_option(ctx.get(), SPNG_ENCODE_TO_BUFFER, 1) != 0)
+            return Err("Failed to set buffer encoding option");
+
+        GEODE_UNWRAP(encodeImage(ctx.get(), image, width, height, hasAlpha, options));
+
         // Get the encoded PNG buffer
         size_t pngSize;
         int ret;
@@ -125,7 +202,38 @@ namespace encode {
         if (!pngBuffer || ret != 0)
             return Err("Failed to get PNG buffer");
 
+        scope.succeed(pngSize, pixelCount);
         return Ok(FakeVector(pngBuffer, pngSize));
     }
+
+    Result<ByteVector> png(void const* image, uint16_t width, uint16_t height, bool hasAlpha) {
+        return png(image, width, height, hasAlpha, EncodeOptions{});
+    }
+
+    Result<size_t> pngTo(
+        void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+    ) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::Png, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
+        PngContext ctx(spng_ctx_new(SPNG_CTX_ENCODER), &spng_ctx_free);
+        if (!ctx)
+            return Err("Failed to create PNG context");
+
+        // spng hands over every chunk as soon as it's compressed
+        SinkWriter writer{sink};
+        auto write = [](spng_ctx*, void* user, void* data, size_t size) {
+            return static_cast<SinkWriter*>(user)->write(data, size) ? 0 : static_cast<int>(SPNG_IO_ERROR);
+        };
+        if (spng_set_png_stream(ctx.get(), write, &writer) != 0)
+            return Err("Failed to set PNG output stream");
+
+        auto res = encodeImage(ctx.get(), image, width, height, hasAlpha, options);
+        if (writer.failed) return writer.finish();
+        GEODE_UNWRAP(std::move(res));
+
+        scope.succeed(writer.written, pixelCount);
+        return writer.finish();
+    }
 }
 IMAGE_PLUS_END_NAMESPACE
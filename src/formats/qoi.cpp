@@ -1,33 +1,115 @@
 #include <api.hpp>
+#include "Internal.hpp"
+#include "../BufferPool.hpp"
 #include "../FakeVector.hpp"
+#include "../Metrics.hpp"
+
+#include <new>
+
+namespace {
+    // qoi_decode allocates the output itself, decoders point that allocation at their own buffer instead
+    struct QoiTarget {
+        void* data = nullptr;
+        size_t size = 0;
+    };
+
+    thread_local QoiTarget s_qoiTarget;
+
+    void* qoiMalloc(size_t size) {
+        // only the encoder gets here, its output ends up in a ByteVector (see FakeVector)
+        if (!s_qoiTarget.data) return ::operator new(size, std::nothrow);
+        return size <= s_qoiTarget.size ? s_qoiTarget.data : nullptr;
+    }
+}
 
 #define QOI_IMPLEMENTATION
 #define QOI_NO_STDIO
+#define QOI_MALLOC(sz) qoiMalloc(sz)
 #include <qoi.h>
 
 using namespace geode;
 
 IMAGE_PLUS_BEGIN_NAMESPACE
 namespace decode {
-    Result<DecodedImage> qoi(void const* data, size_t size) {
+    /// @brief Runs qoi_decode with its output going to the given buffer
+    static Result<> decodeInto(void const* data, size_t size, void* buf, size_t bufSize) {
+        s_qoiTarget = { buf, bufSize };
         qoi_desc desc;
-        auto* output = static_cast<uint8_t*>(qoi_decode(data, size, &desc, 0));
-        if (!output) {
+        void* output = qoi_decode(data, size, &desc, 0);
+        s_qoiTarget = {};
+
+        if (!output)
             return Err("Failed to decode QOI image");
-        }
+
+        return Ok();
+    }
+
+    Result<ImageInfo> qoiInfo(void const* data, size_t size) {
+        auto bytes = static_cast<uint8_t const*>(data);
+        if (size < QOI_HEADER_SIZE + sizeof(qoi_padding) || std::memcmp(bytes, "qoif", 4) != 0)
+            return Err("Invalid QOI header");
+
+        auto read32 = [&](size_t offset) {
+            return static_cast<uint32_t>(bytes[offset]) << 24 | bytes[offset + 1] << 16 | bytes[offset + 2] << 8 | bytes[offset + 3];
+        };
+
+        uint32_t width = read32(4);
+        uint32_t height = read32(8);
+        uint8_t channels = bytes[12];
+        if (width == 0 || height == 0 || width > 65535 || height > 65535 || (channels != 3 && channels != 4))
+            return Err("Invalid QOI header");
+
+        return Ok(ImageInfo {
+            .format = ImageFormat::Qoi,
+            .width = static_cast<uint16_t>(width),
+            .height = static_cast<uint16_t>(height),
+            .bit_depth = 8,
+            .hasAlpha = channels == 4,
+        });
+    }
+
+    Result<DecodedImage> qoi(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto info, qoiInfo(data, size));
+        size_t outSize = static_cast<size_t>(info.width) * info.height * (info.hasAlpha ? 4 : 3);
+
+        // qoi_decode would use malloc, while DecodedImage is freed with delete[]
+        auto output = BufferPool::get().acquire(outSize);
+        if (!output)
+            return Err("Failed to allocate memory for QOI image");
+
+        GEODE_UNWRAP(decodeInto(data, size, output.get(), outSize));
 
         return Ok(DecodedImage{
-            .data = std::unique_ptr<uint8_t[]>(output),
-            .width = static_cast<uint16_t>(desc.width),
-            .height = static_cast<uint16_t>(desc.height),
+            .data = std::move(output),
+            .width = info.width,
+            .height = info.height,
             .bit_depth = 8,
-            .hasAlpha = desc.channels == 4,
+            .hasAlpha = info.hasAlpha,
         });
     }
+
+    Result<size_t> qoiInto(void const* data, size_t size, void* buf, size_t bufSize) {
+        // header is checked first, so a small buffer isn't reported as a decoding failure
+        GEODE_UNWRAP_INTO(auto info, qoiInfo(data, size));
+        size_t outSize = static_cast<size_t>(info.width) * info.height * (info.hasAlpha ? 4 : 3);
+        if (bufSize < outSize)
+            return Err("Output buffer is too small for decoded QOI image");
+
+        GEODE_UNWRAP(decodeInto(data, size, buf, bufSize));
+        return Ok(outSize);
+    }
+
+    Result<DecodedImage> qoiHeader(void const* data, size_t size) {
+        GEODE_UNWRAP_INTO(auto info, qoiInfo(data, size));
+        return Ok(std::get<DecodedImage>(toHeaderResult(info)));
+    }
 }
 
 namespace encode {
     Result<ByteVector> qoi(void const* image, uint16_t width, uint16_t height, bool hasAlpha) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::Qoi, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
         if (!image) {
             return Err("Invalid image data");
         }
@@ -44,7 +126,17 @@ namespace encode {
             return Err("Failed to encode QOI image");
         }
 
+        scope.succeed(size, pixelCount);
         return Ok(FakeVector(encoded, size));
     }
+
+    Result<size_t> qoiTo(void const* image, uint16_t width, uint16_t height, bool hasAlpha, OutputSink const& sink) {
+        // qoi.h only encodes to memory, so this still holds the whole file once (and qoi() counts the encode)
+        GEODE_UNWRAP_INTO(auto encoded, qoi(image, width, height, hasAlpha));
+
+        SinkWriter writer{sink};
+        writer.write(encoded.data(), encoded.size());
+        return writer.finish();
+    }
 }
 IMAGE_PLUS_END_NAMESPACE
\ No newline at end of file
@@ -3,17 +3,86 @@
 #include <webp/demux.h>
 #include <webp/encode.h>
 #include <webp/mux.h>
+#include <src/utils/thread_utils.h>
 
+#ifndef IMAGEPLUS_HEADLESS
+#include <Geode/Geode.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <memory>
 #include <vector>
 
+#include "Internal.hpp"
+#include "../AnimationSource.hpp"
+#include "../BufferPool.hpp"
 #include "../FakeVector.hpp"
-#include "../Utils.hpp"
+#include "../Metrics.hpp"
+#include "../PixelKernels.hpp"
+#include "../ThreadPool.hpp"
 
 using namespace geode;
 
 IMAGE_PLUS_BEGIN_NAMESPACE
+/// @brief libwebp worker interface backed by the shared thread pool, instead of a new thread for every worker.
+/// Used by the encoder (thread_level) and the incremental decoder (use_threads)
+namespace worker {
+    static ThreadPool::TaskPtr& getTask(WebPWorker* const worker) {
+        return *static_cast<ThreadPool::TaskPtr*>(worker->impl_);
+    }
+
+    static void init(WebPWorker* const worker) {
+        std::memset(worker, 0, sizeof(*worker));
+        worker->status_ = NOT_OK;
+    }
+
+    static void execute(WebPWorker* const worker) {
+        if (worker->hook) {
+            worker->had_error |= !worker->hook(worker->data1, worker->data2);
+        }
+    }
+
+    static int sync(WebPWorker* const worker) {
+        if (worker->status_ == WORK) {
+            getTask(worker)->wait();
+            getTask(worker) = nullptr;
+            worker->status_ = OK;
+        }
+        return !worker->had_error;
+    }
+
+    static int reset(WebPWorker* const worker) {
+        worker->had_error = 0;
+        if (worker->status_ < OK) {
+            worker->impl_ = new (std::nothrow) ThreadPool::TaskPtr();
+            if (!worker->impl_) return 0;
+            worker->status_ = OK;
+            return 1;
+        }
+        return sync(worker);
+    }
+
+    static void launch(WebPWorker* const worker) {
+        if (worker->status_ < OK) return;
+        sync(worker); // previous job has to finish first
+        getTask(worker) = ThreadPool::get().submit([worker] { execute(worker); });
+        worker->status_ = WORK;
+    }
+
+    static void end(WebPWorker* const worker) {
+        if (worker->status_ >= OK) {
+            sync(worker);
+            delete static_cast<ThreadPool::TaskPtr*>(worker->impl_);
+            worker->impl_ = nullptr;
+        }
+        worker->status_ = NOT_OK;
+    }
+
+    static constexpr WebPWorkerInterface s_interface = { init, reset, sync, launch, execute, end };
+}
+
 namespace decode {
     static void blend_noover(
         uint8_t* canvas, uint8_t const* src,
@@ -36,25 +105,75 @@ namespace decode {
     ) {
         for (int y = 0; y < srcH; y++) {
             uint8_t* dstRow = canvas + ((offsetY + y) * canvasW + offsetX) * 4;
-            const uint8_t* srcRow = src + y * srcW * 4;
-            for (int x = 0; x < srcW; x++) {
-                uint8_t rs = srcRow[4 * x + 0], gs = srcRow[4 * x + 1],
-                        bs = srcRow[4 * x + 2], as = srcRow[4 * x + 3];
-                uint8_t* dst = dstRow + 4 * x;
-                if (as == 255) {
-                    dst[0] = rs; dst[1] = gs; dst[2] = bs; dst[3] = 255;
-                } else if (as > 0) {
-                    float alpha = as / 255.0f;
-                    dst[0] = static_cast<uint8_t>(dst[0] * (1 - alpha) + rs * alpha);
-                    dst[1] = static_cast<uint8_t>(dst[1] * (1 - alpha) + gs * alpha);
-                    dst[2] = static_cast<uint8_t>(dst[2] * (1 - alpha) + bs * alpha);
-                    dst[3] = dst[3] < as ? as : dst[3];
+            uint8_t const* srcRow = src + y * srcW * 4;
+            pixels::blendAlpha(dstRow, srcRow, srcW);
+        }
+    }
+
+    /// @brief Placement and blending info of a single animation frame
+    struct WebPFrameInfo {
+        WebPData fragment;
+        int x = 0, y = 0;
+        int width = 0, height = 0;
+        uint32_t duration = 0;
+        WebPMuxAnimBlend blend = WEBP_MUX_BLEND;
+        WebPMuxAnimDispose dispose = WEBP_MUX_DISPOSE_NONE;
+
+        static WebPFrameInfo from(WebPIterator const& iter) {
+            return {
+                .fragment = iter.fragment,
+                .x = iter.x_offset, .y = iter.y_offset,
+                .width = iter.width, .height = iter.height,
+                .duration = static_cast<uint32_t>(iter.duration),
+                .blend = iter.blend_method,
+                .dispose = iter.dispose_method,
+            };
+        }
+    };
+
+    static void composeFrame(
+        uint8_t* canvas, uint8_t const* decoded,
+        uint32_t canvasW, uint32_t canvasH,
+        WebPFrameInfo const& frame, bool hasAlpha
+    ) {
+        if (hasAlpha) {
+            if (frame.blend == WEBP_MUX_NO_BLEND) {
+                for (int row = 0; row < frame.height; row++) {
+                    uint8_t* dest = canvas + (((frame.y + row) * canvasW + frame.x) * 4);
+                    std::memset(dest, 0, frame.width * 4);
                 }
             }
+            blend_alpha(canvas, decoded, canvasW, canvasH, frame.width, frame.height, frame.x, frame.y);
+        } else {
+            blend_noover(canvas, decoded, canvasW, canvasH, frame.width, frame.height, frame.x, frame.y);
+        }
+    }
+
+    static size_t fragmentSize(WebPFrameInfo const& frame, bool hasAlpha) {
+        return static_cast<size_t>(frame.width) * frame.height * (hasAlpha ? 4 : 3);
+    }
+
+    /// @brief Decodes the frame fragment into a buffer of fragmentSize() bytes
+    static bool decodeFragmentInto(WebPFrameInfo const& frame, bool hasAlpha, uint8_t* out) {
+        size_t size = fragmentSize(frame, hasAlpha);
+        int stride = frame.width * (hasAlpha ? 4 : 3);
+        uint8_t* decoded = hasAlpha
+            ? WebPDecodeRGBAInto(frame.fragment.bytes, frame.fragment.size, out, size, stride)
+            : WebPDecodeRGBInto(frame.fragment.bytes, frame.fragment.size, out, size, stride);
+        return decoded != nullptr;
+    }
+
+    static void disposeFrame(uint8_t* canvas, uint32_t canvasW, WebPFrameInfo const& frame, bool hasAlpha) {
+        if (frame.dispose != WEBP_MUX_DISPOSE_BACKGROUND) return;
+
+        size_t channels = hasAlpha ? 4 : 3;
+        for (int row = 0; row < frame.height; row++) {
+            uint8_t* dest = canvas + (((frame.y + row) * canvasW + frame.x) * channels);
+            std::memset(dest, 0, frame.width * channels);
         }
     }
 
-    static Result<DecodedResult> webpInner(void const* data, size_t size, bool onlyHeader) {
+    static Result<DecodedResult> webpInner(void const* data, size_t size) {
         WebPData webpData{static_cast<const uint8_t*>(data), size};
 
         std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> demux(WebPDemux(&webpData), &WebPDemuxDelete);
@@ -73,15 +192,18 @@ namespace decode {
                 .hasAlpha = feats.has_alpha != 0
             };
 
-            if (onlyHeader) return Ok(std::move(img));
+            // libwebp's own buffer comes from malloc, while DecodedImage is freed with delete[]
+            int stride = feats.width * (feats.has_alpha ? 4 : 3);
+            size_t outSize = static_cast<size_t>(stride) * feats.height;
+            img.data = BufferPool::get().acquire(outSize);
+            if (!img.data) return Err("Failed to allocate memory for WebP image");
 
             uint8_t* decoded = feats.has_alpha
-                               ? WebPDecodeRGBA(webpData.bytes, webpData.size, nullptr, nullptr)
-                               : WebPDecodeRGB(webpData.bytes, webpData.size, nullptr, nullptr);
+                               ? WebPDecodeRGBAInto(webpData.bytes, webpData.size, img.data.get(), outSize, stride)
+                               : WebPDecodeRGBInto(webpData.bytes, webpData.size, img.data.get(), outSize, stride);
 
             if (!decoded) return Err("Failed to decode static WebP image");
 
-            img.data = std::unique_ptr<uint8_t[]>(decoded);
             return Ok(DecodedResult{std::move(img)});
         }
 
@@ -97,136 +219,685 @@ namespace decode {
         anim.width = static_cast<uint16_t>(canvasW);
         anim.height = static_cast<uint16_t>(canvasH);
 
-        if (onlyHeader) return Ok(DecodedResult{std::move(anim)});
-
         size_t canvasSize = canvasW * canvasH * (hasAlpha ? 4 : 3);
         std::vector<uint8_t> canvas(canvasSize, 0);
 
+        std::vector<WebPFrameInfo> infos;
+        infos.reserve(frameCount);
+
         WebPIterator iter;
         if (!WebPDemuxGetFrame(demux.get(), 1, &iter))
             return Err("Failed to get initial frame");
 
         do {
-            uint8_t* frameDecoded = hasAlpha
-                ? WebPDecodeRGBA(iter.fragment.bytes, iter.fragment.size, nullptr, nullptr)
-                : WebPDecodeRGB(iter.fragment.bytes, iter.fragment.size, nullptr, nullptr);
+            infos.push_back(WebPFrameInfo::from(iter));
+        } while (WebPDemuxNextFrame(&iter));
+        WebPDemuxReleaseIterator(&iter);
 
-            if (!frameDecoded) {
-                WebPDemuxReleaseIterator(&iter);
-                return Err("Failed to decode animation frame");
+        // fragments don't depend on each other, so they are decoded on the thread pool,
+        // only compositing has to happen in order (and it overlaps with decoding of the next frames)
+        auto& pool = ThreadPool::get();
+        auto& bufferPool = BufferPool::get();
+        size_t window = pool.getThreadCount() * 2; // limits how many decoded fragments are kept around
+        std::vector<std::unique_ptr<uint8_t[]>> fragments(infos.size());
+        std::vector<ThreadPool::TaskPtr> tasks(infos.size());
+        std::atomic_bool cancelled = false;
+
+        auto submit = [&](size_t index) {
+            tasks[index] = pool.submit([&, index] {
+                if (cancelled) return;
+                auto buffer = bufferPool.acquire(fragmentSize(infos[index], hasAlpha));
+                if (buffer && decodeFragmentInto(infos[index], hasAlpha, buffer.get())) {
+                    fragments[index] = std::move(buffer);
+                }
+            });
+        };
+
+        // tasks reference locals, so all of them have to finish before returning
+        auto fail = [&](std::string_view message) -> Result<DecodedResult> {
+            cancelled = true;
+            for (auto& task : tasks) {
+                if (task) task->wait();
             }
+            return Err(std::string(message));
+        };
 
-            if (hasAlpha) {
-                if (iter.blend_method == WEBP_MUX_NO_BLEND) {
-                    for (int row = 0; row < iter.height; row++) {
-                        uint8_t* dest = canvas.data() + (((iter.y_offset + row) * canvasW + iter.x_offset) * 4);
-                        std::memset(dest, 0, iter.width * 4);
-                    }
-                }
-                blend_alpha(canvas.data(), frameDecoded, canvasW, canvasH, iter.width, iter.height, iter.x_offset, iter.y_offset);
-            } else {
-                blend_noover(canvas.data(), frameDecoded, canvasW, canvasH, iter.width, iter.height, iter.x_offset, iter.y_offset);
+        for (size_t i = 0; i < std::min(window, infos.size()); ++i) {
+            submit(i);
+        }
+
+        for (size_t i = 0; i < infos.size(); ++i) {
+            if (i + window < infos.size()) {
+                submit(i + window);
             }
 
-            WebPFree(frameDecoded);
+            tasks[i]->wait();
+            tasks[i] = nullptr;
+            auto fragment = std::move(fragments[i]);
+            if (!fragment) return fail("Failed to decode animation frame");
+
+            auto const& info = infos[i];
+            composeFrame(canvas.data(), fragment.get(), canvasW, canvasH, info, hasAlpha);
+            bufferPool.release(std::move(fragment), fragmentSize(info, hasAlpha));
 
             // copy full canvas to frame
             AnimationFrame frame;
-            frame.delay = iter.duration;
-            frame.data = util::make_unique(canvasSize);
-            if (!frame.data) {
-                WebPDemuxReleaseIterator(&iter);
-                return Err("Failed to allocate memory for animation frame");
-            }
+            frame.delay = info.duration;
+            frame.data = bufferPool.acquire(canvasSize);
+            if (!frame.data) return fail("Failed to allocate memory for animation frame");
 
             std::memcpy(frame.data.get(), canvas.data(), canvasSize);
             anim.frames.push_back(std::move(frame));
 
-            if (iter.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND) {
-                for (int row = 0; row < iter.height; row++) {
-                    uint8_t* dest = canvas.data() + (((iter.y_offset + row) * canvasW + iter.x_offset) * (hasAlpha ? 4 : 3));
-                    std::memset(dest, 0, iter.width * (hasAlpha ? 4 : 3));
+            disposeFrame(canvas.data(), canvasW, info, hasAlpha);
+        }
+
+        return Ok(DecodedResult{std::move(anim)});
+    }
+
+    /// @brief Composites animation frames one at a time, keeping only the encoded data around.
+    /// If the memory budget allows it, decoded fragments are kept as delta frames
+    /// (changed rectangle + blend/dispose info), so every frame is only decoded once.
+    class WebPAnimationSource : public AnimationSource {
+    public:
+        WebPAnimationSource(
+            std::vector<uint8_t> data, std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> demux,
+            std::vector<WebPFrameInfo> frames, std::vector<uint32_t> delays,
+            uint32_t canvasW, uint32_t canvasH, bool hasAlpha, uint16_t loopCount
+        ) : AnimationSource(canvasW, canvasH, hasAlpha, loopCount, std::move(delays)),
+            m_data(std::move(data)), m_demux(std::move(demux)), m_frames(std::move(frames)) {
+            size_t channels = hasAlpha ? 4 : 3;
+            m_dirty.reserve(m_frames.size());
+            for (size_t i = 0; i < m_frames.size(); ++i) {
+                auto const& frame = m_frames[i];
+                m_deltaBytes += static_cast<size_t>(frame.width) * frame.height * channels;
+
+                if (i == 0) {
+                    m_dirty.push_back({ 0, 0, static_cast<uint16_t>(canvasW), static_cast<uint16_t>(canvasH) });
+                    continue;
+                }
+
+                auto dirty = toRect(frame);
+                if (m_frames[i - 1].dispose == WEBP_MUX_DISPOSE_BACKGROUND) {
+                    dirty = dirty.merge(toRect(m_frames[i - 1]));
+                }
+                m_dirty.push_back(dirty);
+            }
+        }
+
+        FrameRect getDirtyRect(size_t index) const override {
+            return m_dirty[index];
+        }
+
+    protected:
+        void applyMemoryBudget(size_t bytes) override {
+            // composing a frame from a stored delta is about as cheap as copying a cached canvas,
+            // so if all deltas fit, only a few full canvases are kept around
+            constexpr size_t cachedCanvases = 4;
+            if (m_deltaBytes > bytes) {
+                m_deltas.reset();
+                m_deltaReady.clear();
+            } else if (!m_deltas) {
+                // all deltas share one allocation, instead of one heap block per frame
+                std::vector<size_t> sizes;
+                sizes.reserve(m_frames.size());
+                for (auto const& frame : m_frames) {
+                    sizes.push_back(fragmentSize(frame, this->hasAlpha()));
+                }
+
+                m_deltas = FrameArena::create(sizes);
+                m_deltaReady.assign(m_frames.size(), false);
+            }
+
+            if (m_deltas) {
+                AnimationSource::applyMemoryBudget(std::min(bytes - m_deltaBytes, this->getFrameSize() * cachedCanvases));
+            } else {
+                AnimationSource::applyMemoryBudget(bytes);
+            }
+        }
+
+        Result<> decodeNext(uint8_t* out) override {
+            if (m_next >= m_frames.size())
+                return Err("No more frames in animation");
+
+            if (m_canvas.empty()) {
+                m_canvas.resize(this->getFrameSize(), 0);
+            }
+
+            auto const& frame = m_frames[m_next];
+            GEODE_UNWRAP_INTO(auto fragment, this->decodeFragment(m_next));
+
+            composeFrame(m_canvas.data(), fragment, this->getWidth(), this->getHeight(), frame, this->hasAlpha());
+            std::memcpy(out, m_canvas.data(), m_canvas.size());
+            disposeFrame(m_canvas.data(), this->getWidth(), frame, this->hasAlpha());
+
+            m_next++;
+            return Ok();
+        }
+
+        Result<> rewind() override {
+            std::fill(m_canvas.begin(), m_canvas.end(), 0);
+            m_next = 0;
+            return Ok();
+        }
+
+    private:
+        static FrameRect toRect(WebPFrameInfo const& frame) {
+            return {
+                static_cast<uint16_t>(frame.x), static_cast<uint16_t>(frame.y),
+                static_cast<uint16_t>(frame.width), static_cast<uint16_t>(frame.height)
+            };
+        }
+
+        /// @brief Returns decoded pixels of the frame fragment, reusing the stored delta if there is one
+        Result<uint8_t const*> decodeFragment(size_t index) {
+            bool keepDelta = m_deltas != nullptr;
+            if (keepDelta && m_deltaReady[index]) {
+                return Ok(m_deltas->getSlot(index));
+            }
+
+            auto const& frame = m_frames[index];
+
+            uint8_t* target = nullptr;
+            if (keepDelta) {
+                target = m_deltas->getSlot(index);
+            } else {
+                size_t size = fragmentSize(frame, this->hasAlpha());
+                if (m_fragment.size() < size) {
+                    m_fragment.resize(size);
                 }
+                target = m_fragment.data();
             }
+
+            if (!decodeFragmentInto(frame, this->hasAlpha(), target))
+                return Err("Failed to decode animation frame");
+
+            if (keepDelta) m_deltaReady[index] = true;
+            return Ok(target);
+        }
+
+        std::vector<uint8_t> m_data; // demuxer and frame infos point into this buffer
+        std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> m_demux;
+        std::vector<WebPFrameInfo> m_frames;
+        std::vector<FrameRect> m_dirty;
+        std::shared_ptr<FrameArena> m_deltas; // nullptr if deltas don't fit the memory budget
+        std::vector<bool> m_deltaReady;
+        size_t m_deltaBytes = 0;
+        std::vector<uint8_t> m_canvas;
+        std::vector<uint8_t> m_fragment;
+        size_t m_next = 0;
+    };
+
+    Result<std::shared_ptr<AnimationSource>> webpSource(void const* data, size_t size) {
+        // most images are static, so check the caller's buffer before copying anything
+        WebPData webpData{static_cast<uint8_t const*>(data), size};
+        std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> demux(WebPDemux(&webpData), &WebPDemuxDelete);
+        if (!demux) return Err("Failed to demux WebP data");
+
+        uint32_t frameCount = WebPDemuxGetI(demux.get(), WEBP_FF_FRAME_COUNT);
+        if (frameCount <= 1) return Ok(nullptr);
+
+        // the source outlives the caller's buffer, so the demuxer has to point into our own copy
+        std::vector<uint8_t> copy(static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+        webpData = {copy.data(), copy.size()};
+        demux.reset(WebPDemux(&webpData));
+        if (!demux) return Err("Failed to demux WebP data");
+
+        uint32_t loopCount = WebPDemuxGetI(demux.get(), WEBP_FF_LOOP_COUNT);
+        uint32_t canvasW = WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_WIDTH);
+        uint32_t canvasH = WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_HEIGHT);
+        bool hasAlpha = WebPDemuxGetI(demux.get(), WEBP_FF_FORMAT_FLAGS) & ANIMATION_FLAG;
+
+        std::vector<WebPFrameInfo> frames;
+        std::vector<uint32_t> delays;
+        frames.reserve(frameCount);
+        delays.reserve(frameCount);
+
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(demux.get(), 1, &iter))
+            return Err("Failed to get initial frame");
+
+        do {
+            frames.push_back(WebPFrameInfo::from(iter));
+            delays.push_back(frames.back().duration);
         } while (WebPDemuxNextFrame(&iter));
 
         WebPDemuxReleaseIterator(&iter);
-        return Ok(DecodedResult{std::move(anim)});
+
+        return Ok(std::make_shared<WebPAnimationSource>(
+            std::move(copy), std::move(demux), std::move(frames), std::move(delays),
+            canvasW, canvasH, hasAlpha, static_cast<uint16_t>(loopCount)
+        ));
     }
 
     Result<DecodedResult> webp(void const* data, size_t size) {
-        return webpInner(data, size, false);
+        return webpInner(data, size);
+    }
+
+    /// @brief Whether the frame can be composited without knowing the canvas before it
+    static bool isKeyFrame(std::vector<WebPFrameInfo> const& frames, size_t index, uint32_t canvasW, uint32_t canvasH, bool hasAlpha) {
+        if (index == 0) return true;
+
+        auto coversCanvas = [&](WebPFrameInfo const& frame) {
+            return frame.x == 0 && frame.y == 0
+                && static_cast<uint32_t>(frame.width) == canvasW && static_cast<uint32_t>(frame.height) == canvasH;
+        };
+
+        auto const& frame = frames[index];
+        if (coversCanvas(frame) && (frame.blend == WEBP_MUX_NO_BLEND || !hasAlpha))
+            return true;
+
+        // previous frame clears the whole canvas, so this one starts from scratch like the first frame
+        auto const& prev = frames[index - 1];
+        return prev.dispose == WEBP_MUX_DISPOSE_BACKGROUND && coversCanvas(prev);
+    }
+
+    Result<size_t> webpInto(void const* data, size_t size, void* buf, size_t bufSize, size_t frame) {
+        WebPData webpData{static_cast<const uint8_t*>(data), size};
+
+        std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> demux(WebPDemux(&webpData), &WebPDemuxDelete);
+        if (!demux) return Err("Failed to demux WebP data");
+
+        uint32_t frameCount = WebPDemuxGetI(demux.get(), WEBP_FF_FRAME_COUNT);
+        if (frame >= std::max<uint32_t>(frameCount, 1))
+            return Err("Frame index is out of range");
+
+        if (frameCount <= 1) {
+            WebPBitstreamFeatures feats;
+            if (WebPGetFeatures(webpData.bytes, webpData.size, &feats) != VP8_STATUS_OK)
+                return Err("Failed to get WebP features");
+
+            int stride = feats.width * (feats.has_alpha ? 4 : 3);
+            size_t outSize = static_cast<size_t>(stride) * feats.height;
+            if (bufSize < outSize)
+                return Err("Output buffer is too small for decoded WebP image");
+
+            auto out = static_cast<uint8_t*>(buf);
+            uint8_t* decoded = feats.has_alpha
+                               ? WebPDecodeRGBAInto(webpData.bytes, webpData.size, out, outSize, stride)
+                               : WebPDecodeRGBInto(webpData.bytes, webpData.size, out, outSize, stride);
+            if (!decoded) return Err("Failed to decode static WebP image");
+
+            return Ok(outSize);
+        }
+
+        uint32_t canvasW = WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_WIDTH);
+        uint32_t canvasH = WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_HEIGHT);
+        bool hasAlpha = WebPDemuxGetI(demux.get(), WEBP_FF_FORMAT_FLAGS) & ANIMATION_FLAG;
+
+        size_t canvasSize = static_cast<size_t>(canvasW) * canvasH * (hasAlpha ? 4 : 3);
+        if (bufSize < canvasSize)
+            return Err("Output buffer is too small for decoded WebP frame");
+
+        std::vector<WebPFrameInfo> frames;
+        frames.reserve(frame + 1);
+
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(demux.get(), 1, &iter))
+            return Err("Failed to get initial frame");
+
+        do {
+            frames.push_back(WebPFrameInfo::from(iter));
+        } while (frames.size() <= frame && WebPDemuxNextFrame(&iter));
+        WebPDemuxReleaseIterator(&iter);
+
+        if (frames.size() <= frame)
+            return Err("Frame index is out of range");
+
+        // caller's buffer is the canvas, compositing starts from the closest frame that doesn't depend on earlier ones
+        size_t start = frame;
+        while (!isKeyFrame(frames, start, canvasW, canvasH, hasAlpha)) {
+            start--;
+        }
+
+        auto canvas = static_cast<uint8_t*>(buf);
+        std::memset(canvas, 0, canvasSize);
+
+        std::vector<uint8_t> fragment;
+        for (size_t i = start; i <= frame; ++i) {
+            auto const& info = frames[i];
+            size_t needed = fragmentSize(info, hasAlpha);
+            if (fragment.size() < needed) {
+                fragment.resize(needed);
+            }
+
+            if (!decodeFragmentInto(info, hasAlpha, fragment.data()))
+                return Err("Failed to decode animation frame");
+
+            composeFrame(canvas, fragment.data(), canvasW, canvasH, info, hasAlpha);
+            if (i != frame) disposeFrame(canvas, canvasW, info, hasAlpha);
+        }
+
+        return Ok(canvasSize);
+    }
+
+    Result<ImageInfo> webpInfo(void const* data, size_t size) {
+        WebPData webpData{static_cast<const uint8_t*>(data), size};
+
+        // demuxer only parses chunk headers, frame bitstreams are left untouched
+        std::unique_ptr<WebPDemuxer, decltype(&WebPDemuxDelete)> demux(WebPDemux(&webpData), &WebPDemuxDelete);
+        if (!demux) return Err("Failed to demux WebP data");
+
+        uint32_t frameCount = WebPDemuxGetI(demux.get(), WEBP_FF_FRAME_COUNT);
+        if (frameCount <= 1) {
+            WebPBitstreamFeatures feats;
+            if (WebPGetFeatures(webpData.bytes, webpData.size, &feats) != VP8_STATUS_OK)
+                return Err("Failed to get WebP features");
+
+            return Ok(ImageInfo {
+                .format = ImageFormat::Webp,
+                .width = static_cast<uint16_t>(feats.width),
+                .height = static_cast<uint16_t>(feats.height),
+                .hasAlpha = feats.has_alpha != 0,
+            });
+        }
+
+        ImageInfo info {
+            .format = ImageFormat::Webp,
+            .width = static_cast<uint16_t>(WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_WIDTH)),
+            .height = static_cast<uint16_t>(WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_HEIGHT)),
+            .hasAlpha = (WebPDemuxGetI(demux.get(), WEBP_FF_FORMAT_FLAGS) & ANIMATION_FLAG) != 0,
+            .frameCount = frameCount,
+            .loopCount = static_cast<uint16_t>(WebPDemuxGetI(demux.get(), WEBP_FF_LOOP_COUNT)),
+        };
+
+        WebPIterator iter;
+        if (!WebPDemuxGetFrame(demux.get(), 1, &iter))
+            return Err("Failed to get initial frame");
+
+        do {
+            info.totalDuration += static_cast<uint32_t>(iter.duration);
+        } while (WebPDemuxNextFrame(&iter));
+        WebPDemuxReleaseIterator(&iter);
+
+        return Ok(info);
     }
 
     Result<DecodedResult> webpHeader(void const* data, size_t size) {
-        return webpInner(data, size, false);
+        GEODE_UNWRAP_INTO(auto info, webpInfo(data, size));
+        return Ok(toHeaderResult(info));
     }
 }
 
 namespace encode {
+    /// @brief Encodes an image (or a region of a larger one, using its stride), passing the output to the writer function
+    static bool encodePicture(
+        WebPConfig const& config, uint8_t const* pixels, int width, int height, int stride,
+        bool hasAlpha, WebPWriterFunction write, void* custom
+    ) {
+        WebPPicture picture;
+        if (!WebPPictureInit(&picture)) return false;
+
+        picture.width = width;
+        picture.height = height;
+        picture.use_argb = config.lossless;
+        picture.writer = write;
+        picture.custom_ptr = custom;
+
+        bool ok = hasAlpha ? WebPPictureImportRGBA(&picture, pixels, stride)
+                           : WebPPictureImportRGB(&picture, pixels, stride);
+        ok = ok && WebPEncode(&config, &picture);
+        WebPPictureFree(&picture);
+        return ok;
+    }
+
+    /// @brief Encodes an image (or a region of a larger one, using its stride) into the writer
+    static bool encodePicture(
+        WebPConfig const& config, uint8_t const* pixels, int width, int height, int stride,
+        bool hasAlpha, WebPMemoryWriter& writer
+    ) {
+        return encodePicture(config, pixels, width, height, stride, hasAlpha, WebPMemoryWrite, &writer)
+            && writer.size > 0;
+    }
+
+    /// @brief Balanced matches WebPEncodeRGBA/WebPEncodeLosslessRGBA (method 4, lossless quality 70)
+    static bool makeConfig(EncodeOptions const& options, WebPConfig& config) {
+        if (!WebPConfigInit(&config)) return false;
+
+        config.lossless = options.lossless;
+        config.method = fromPreset(options.webp.method, options, 0, 2, 4, 6);
+        // for lossless encodes, quality is how hard the encoder tries
+        config.quality = options.lossless ? fromPreset(options.webp.losslessQuality, options, 25, 50, 70, 100) : options.quality;
+        config.thread_level = options.threads != 1;
+        return WebPValidateConfig(&config);
+    }
+
+    Result<ByteVector> webp(void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::Webp, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
+        if (!image)
+            return Err("Invalid image data");
+
+        WebPConfig config;
+        if (!makeConfig(options, config))
+            return Err("Invalid WebP config");
+
+        WebPMemoryWriter writer;
+        WebPMemoryWriterInit(&writer);
+
+        auto pixels = static_cast<uint8_t const*>(image);
+        if (!encodePicture(config, pixels, width, height, width * (hasAlpha ? 4 : 3), hasAlpha, writer)) {
+            WebPMemoryWriterClear(&writer);
+            return Err("Failed to encode WebP image");
+        }
+
+        scope.succeed(writer.size, pixelCount);
+        return Ok(FakeVector(writer.mem, writer.size));
+    }
+
     Result<ByteVector> webp(void const* image, uint16_t width, uint16_t height, bool hasAlpha, float quality) {
+        return webp(image, width, height, hasAlpha, legacyOptions(quality));
+    }
+
+    Result<size_t> webpTo(
+        void const* image, uint16_t width, uint16_t height, bool hasAlpha, EncodeOptions const& options, OutputSink const& sink
+    ) {
+        uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+        Metrics::Scope scope(ImageFormat::Webp, Metrics::Op::Encode, pixelCount * (hasAlpha ? 4 : 3));
+
         if (!image)
             return Err("Invalid image data");
 
-        uint8_t* output = nullptr;
-        size_t outputSize = 0;
+        WebPConfig config;
+        if (!makeConfig(options, config))
+            return Err("Invalid WebP config");
 
-        #define ARGS(stride) static_cast<uint8_t const*>(image), width, height, stride, quality, &output
+        // the encoder writes the headers first and then the bitstream as it's produced
+        SinkWriter writer{sink};
+        auto write = [](uint8_t const* data, size_t size, WebPPicture const* picture) {
+            return static_cast<SinkWriter*>(picture->custom_ptr)->write(data, size) ? 1 : 0;
+        };
 
-        if (quality >= 99.f) {
-            if (hasAlpha) {
-                outputSize = WebPEncodeLosslessRGBA(
-                    static_cast<uint8_t const*>(image),
-                    width, height,
-                    width * 4,
-                    &output
-                );
-            } else {
-                outputSize = WebPEncodeLosslessRGB(
-                    static_cast<uint8_t const*>(image),
-                    width, height,
-                    width * 3,
-                    &output
-                );
-            }
-        } else {
-            if (hasAlpha) {
-                outputSize = WebPEncodeRGBA(
-                    static_cast<uint8_t const*>(image),
-                    width, height,
-                    width * 4,
-                    quality,
-                    &output
-                );
-            } else {
-                outputSize = WebPEncodeRGB(
-                    static_cast<uint8_t const*>(image),
-                    width, height,
-                    width * 3,
-                    quality,
-                    &output
-                );
+        auto pixels = static_cast<uint8_t const*>(image);
+        bool ok = encodePicture(config, pixels, width, height, width * (hasAlpha ? 4 : 3), hasAlpha, write, &writer);
+        if (!ok && !writer.failed)
+            return Err("Failed to encode WebP image");
+
+        if (ok) scope.succeed(writer.written, pixelCount);
+        return writer.finish();
+    }
+
+    enum class AnimationMode {
+        Fast,     ///< Frames are encoded in parallel, each one only covering what changed since the previous frame
+        Smallest, ///< WebPAnimEncoder, which also tries blending and key frames, one frame at a time
+    };
+
+    static AnimationMode parseAnimationMode(std::string_view mode) {
+        return mode == "Fast" ? AnimationMode::Fast : AnimationMode::Smallest;
+    }
+
+    static AnimationMode animationMode() {
+    #ifdef IMAGEPLUS_HEADLESS
+        return AnimationMode::Smallest;
+    #else
+        static AnimationMode mode = (
+            listenForSettingChanges<std::string>("webp-animation-encoding", [](std::string val) { mode = parseAnimationMode(val); }),
+            parseAnimationMode(getMod()->getSettingValue<std::string>("webp-animation-encoding"))
+        );
+        return mode;
+    #endif
+    }
+
+    struct Rect {
+        int x = 0, y = 0, width = 0, height = 0;
+    };
+
+    /// @brief Finds the area that differs between two frames, with an even offset as required by the format
+    /// @return Empty rect if the frames are identical
+    static Rect changedRect(uint8_t const* prev, uint8_t const* cur, int width, int height, int channels) {
+        size_t stride = static_cast<size_t>(width) * channels;
+        auto rowEqual = [&](int y) {
+            return std::memcmp(prev + y * stride, cur + y * stride, stride) == 0;
+        };
+
+        int top = 0;
+        while (top < height && rowEqual(top)) top++;
+        if (top == height) return {};
+
+        int bottom = height - 1;
+        while (bottom > top && rowEqual(bottom)) bottom--;
+
+        // columns only have to be scanned up to the bounds found in the rows before
+        int left = width, right = -1;
+        for (int y = top; y <= bottom; ++y) {
+            auto a = prev + y * stride, b = cur + y * stride;
+            int x = 0;
+            while (x < left && std::memcmp(a + x * channels, b + x * channels, channels) == 0) x++;
+            left = std::min(left, x);
+
+            x = width - 1;
+            while (x > right && std::memcmp(a + x * channels, b + x * channels, channels) == 0) x--;
+            right = std::max(right, x);
+        }
+
+        int x = left & ~1, y = top & ~1;
+        return { x, y, right + 1 - x, bottom + 1 - y };
+    }
+
+    static Result<ByteVector> webpFast(DecodedAnimation const& anim, EncodeOptions const& options) {
+        int width = anim.width, height = anim.height;
+        int channels = anim.hasAlpha ? 4 : 3;
+        int stride = width * channels;
+        auto& pool = ThreadPool::get();
+
+        // frames are compared with the previous source frame (same as WebPAnimEncoder does),
+        // so they don't depend on how the frames before them were encoded
+        std::vector<Rect> rects(anim.frames.size());
+        pool.parallelFor(anim.frames.size(), [&](size_t i, size_t) {
+            rects[i] = i == 0 ? Rect{ 0, 0, width, height } : changedRect(
+                anim.frames[i - 1].data.get(), anim.frames[i].data.get(), width, height, channels
+            );
+        }, options.threads);
+
+        struct Frame {
+            size_t source;
+            Rect rect;
+            uint32_t duration;
+        };
+
+        // unchanged frames only extend the one before them
+        std::vector<Frame> frames;
+        for (size_t i = 0; i < anim.frames.size(); ++i) {
+            if (i > 0 && rects[i].width == 0) {
+                frames.back().duration += anim.frames[i].delay;
+                continue;
             }
+            frames.push_back({ i, rects[i], anim.frames[i].delay });
         }
 
+        WebPConfig config;
+        if (!makeConfig(options, config))
+            return Err("Invalid WebP config");
 
-        if (outputSize == 0 || !output) {
-            return Err("Failed to encode WebP image");
+        struct Writers {
+            std::vector<WebPMemoryWriter> items;
+            explicit Writers(size_t count) : items(count) {
+                for (auto& writer : items) WebPMemoryWriterInit(&writer);
+            }
+            ~Writers() {
+                for (auto& writer : items) WebPMemoryWriterClear(&writer);
+            }
+        } writers(frames.size());
+
+        std::atomic_bool failed = false;
+        pool.parallelFor(frames.size(), [&](size_t i, size_t) {
+            if (failed) return;
+            auto const& frame = frames[i];
+            auto pixels = anim.frames[frame.source].data.get() + frame.rect.y * stride + frame.rect.x * channels;
+            if (!encodePicture(config, pixels, frame.rect.width, frame.rect.height, stride, anim.hasAlpha, writers.items[i])) {
+                failed = true;
+            }
+        }, options.threads);
+
+        if (failed)
+            return Err("Failed to encode animation frame");
+
+        std::unique_ptr<WebPMux, decltype(&WebPMuxDelete)> mux(WebPMuxNew(), &WebPMuxDelete);
+        if (!mux)
+            return Err("Failed to create WebP muxer");
+
+        for (size_t i = 0; i < frames.size(); ++i) {
+            auto const& frame = frames[i];
+            WebPMuxFrameInfo info{};
+            info.bitstream.bytes = writers.items[i].mem;
+            info.bitstream.size = writers.items[i].size;
+            info.x_offset = frame.rect.x;
+            info.y_offset = frame.rect.y;
+            info.duration = static_cast<int>(std::min<uint32_t>(frame.duration, (1 << 24) - 1));
+            info.id = WEBP_CHUNK_ANMF;
+            info.dispose_method = WEBP_MUX_DISPOSE_NONE;
+            info.blend_method = WEBP_MUX_NO_BLEND;
+
+            if (WebPMuxPushFrame(mux.get(), &info, 0) != WEBP_MUX_OK)
+                return Err("Failed to add frame to animation");
+        }
+
+        WebPMuxAnimParams params{};
+        params.bgcolor = 0xFFFFFFFF; // same as WebPAnimEncoder
+        params.loop_count = anim.loopCount;
+        if (WebPMuxSetAnimationParams(mux.get(), &params) != WEBP_MUX_OK
+            || WebPMuxSetCanvasSize(mux.get(), width, height) != WEBP_MUX_OK) {
+            return Err("Failed to set animation parameters");
         }
 
-        return Ok(FakeVector(output, outputSize));
+        WebPData webpData;
+        WebPDataInit(&webpData);
+        if (WebPMuxAssemble(mux.get(), &webpData) != WEBP_MUX_OK)
+            return Err("Failed to assemble animation");
+
+        return Ok(FakeVector(webpData.bytes, webpData.size));
     }
 
-    Result<ByteVector> webp(DecodedAnimation const& anim, float quality) {
+    Result<ByteVector> webp(DecodedAnimation const& anim, EncodeOptions const& options) {
+        uint64_t pixelCount = static_cast<uint64_t>(anim.width) * anim.height * anim.frames.size();
+        Metrics::Scope scope(ImageFormat::Webp, Metrics::Op::Encode, pixelCount * (anim.hasAlpha ? 4 : 3));
+
         if (anim.frames.empty())
             return Err("Animation has no frames");
 
+        // Balanced (and the overload without options) stays on WebPAnimEncoder, like before the parallel path existed,
+        // unless the player picked Fast in the settings
+        bool balancedParallel = animationMode() == AnimationMode::Fast;
+        if (fromPreset(options.webp.parallelFrames, options, 1, 1, balancedParallel, 0)) {
+            GEODE_UNWRAP_INTO(auto encoded, webpFast(anim, options));
+            scope.succeed(encoded.size(), pixelCount);
+            return Ok(std::move(encoded));
+        }
+
         WebPAnimEncoderOptions animOptions;
         if (!WebPAnimEncoderOptionsInit(&animOptions))
             return Err("Failed to initialize animation encoder options");
 
-        animOptions.minimize_size = 1;
-        animOptions.kmax = 9;
+        animOptions.minimize_size = fromPreset(options.webp.minimizeSize, options, 0, 0, 1, 1);
+        if (int kmax = fromPreset(options.webp.keyframeMax, options, -1, -1, 9, 9); kmax >= 0) {
+            animOptions.kmax = kmax;
+        }
+        animOptions.anim_params.loop_count = anim.loopCount;
+
+        WebPConfig config;
+        if (!makeConfig(options, config))
+            return Err("Invalid WebP config");
 
         std::unique_ptr<WebPAnimEncoder, decltype(&WebPAnimEncoderDelete)> enc(
             WebPAnimEncoderNew(anim.width, anim.height, &animOptions),
@@ -240,17 +911,6 @@ namespace encode {
         for (size_t i = 0; i < anim.frames.size(); ++i) {
             auto const& frame = anim.frames[i];
 
-            WebPConfig config;
-            if (!WebPConfigInit(&config))
-                return Err("Failed to initialize WebP config");
-
-            config.quality = quality;
-            config.method = 4;
-            config.lossless = (quality >= 99.0f);
-
-            if (!WebPValidateConfig(&config))
-                return Err("Invalid WebP config");
-
             WebPPicture picture;
             if (!WebPPictureInit(&picture))
                 return Err("Failed to initialize WebP picture");
@@ -288,8 +948,35 @@ namespace encode {
         if (!WebPAnimEncoderAssemble(enc.get(), &webpData))
             return Err("Failed to assemble animation");
 
+        scope.succeed(webpData.size, pixelCount);
         return Ok(FakeVector(webpData.bytes, webpData.size));
     }
+
+    Result<ByteVector> webp(DecodedAnimation const& anim, float quality) {
+        // unlike the static overload (WebPEncodeLosslessRGBA, always 70), this one has always used the quality
+        // for lossless frames as well
+        auto options = legacyOptions(quality);
+        options.webp.losslessQuality = static_cast<int8_t>(std::clamp(quality, 0.f, 100.f));
+        return webp(anim, options);
+    }
+
+    Result<size_t> webpTo(DecodedAnimation const& anim, EncodeOptions const& options, OutputSink const& sink) {
+        // both the muxer and WebPAnimEncoder assemble the whole file in memory, so it can only be passed on in one piece
+        // (and webp() counts the encode)
+        GEODE_UNWRAP_INTO(auto encoded, webp(anim, options));
+
+        SinkWriter writer{sink};
+        writer.write(encoded.data(), encoded.size());
+        return writer.finish();
+    }
 }
 IMAGE_PLUS_END_NAMESPACE
 
+#ifdef IMAGEPLUS_HEADLESS
+// there's no mod to load, so set it up as soon as the codecs are loaded
+static bool const s_workerInterfaceSet = WebPSetWorkerInterface(&imgp::worker::s_interface);
+#else
+$on_mod(Loaded) {
+    WebPSetWorkerInterface(&imgp::worker::s_interface);
+}
+#endif
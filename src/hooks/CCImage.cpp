@@ -1,14 +1,24 @@
 #include <Geode/modify/CCImage.hpp>
+#include "../BufferPool.hpp"
+#include "../DecodeCache.hpp"
+#include "../DiskCache.hpp"
+#include "../MappedFile.hpp"
+#include "../Metrics.hpp"
+#include "../PixelKernels.hpp"
 #include "../StateManager.hpp"
+#include "../formats/Internal.hpp"
 
 using namespace geode::prelude;
 using namespace imgp;
 
-#define SCALAR_PREMUL_PIXEL(r, g, b, a) \
-    (((uint32_t)((r) * (a) / 255) << 0) | \
-     ((uint32_t)((g) * (a) / 255) << 8) | \
-     ((uint32_t)((b) * (a) / 255) << 16) | \
-     (uint32_t)(a << 24))
+/// @brief Where a decoded image should be cached, if anywhere
+struct CacheTargets {
+    std::optional<DecodeCache::Key> memory;
+    std::optional<DiskCache::Source> disk; ///< Only set for images loaded from a file
+};
+
+// file that initWithImageFile is currently loading on this thread, picked up by initWithImageData
+static thread_local std::optional<DiskCache::Source> s_loadingFile;
 
 class ImagePlusImage : public CCImage {
 public:
@@ -26,10 +36,15 @@ public:
         return vtable;
     }
 
-    static std::shared_ptr<DecodedAnimation>& hook(CCImage* self) {
+    static std::shared_ptr<AnimationSource>& hook(CCImage* self) {
         *reinterpret_cast<void***>(self) = getVTable();
         return StateManager::get().getImageStorage(self);
     }
+
+    static void share(CCImage* self, std::shared_ptr<void const> owner) {
+        *reinterpret_cast<void***>(self) = getVTable();
+        StateManager::get().holdImageData(self, std::move(owner));
+    }
 };
 
 class $modify(ImagePlusImageHook, CCImage) {
@@ -37,35 +52,47 @@ class $modify(ImagePlusImageHook, CCImage) {
     //     (void)self.setHookPriority("cocos2d::CCImage::initWithImageData", -1000);
     // }
 
-    bool initFromDecodeResult(DecodedImage&& result) {
+    bool initFromDecodeResult(DecodedImage&& result, CacheTargets const& cache) {
         if (!result) return false;
 
+        // premultiply alpha if needed
+        if (result.hasAlpha && !result.isPreMultiplied) {
+            pixels::premultiply(result.data.get(), static_cast<size_t>(result.width) * result.height);
+            result.isPreMultiplied = true;
+        }
+
+        if (cache.disk) {
+            DiskCache::get().store(*cache.disk, result);
+        }
+
+        if (cache.memory) {
+            return this->initFromCacheEntry(DecodeCache::get().insert(*cache.memory, std::move(result)));
+        }
+
         m_nWidth = result.width;
         m_nHeight = result.height;
         m_bHasAlpha = result.hasAlpha;
         m_nBitsPerComponent = result.bit_depth;
         m_bPreMulti = result.hasAlpha;
-        m_pData = result.data.release(); // take ownership of the data
-
-        // premultiply alpha if needed
-        if (m_bPreMulti && !result.isPreMultiplied) {
-            size_t imageSize = m_nWidth * m_nHeight * 4;
-            size_t iters = imageSize / sizeof(uint32_t);
-
-            for (size_t i = 0; i < iters; i++) {
-                uint8_t const* pixel = &static_cast<uint8_t const*>(m_pData)[4 * i];
-                uint32_t* outpixel = &reinterpret_cast<uint32_t*>(m_pData)[i];
 
-                *outpixel = SCALAR_PREMUL_PIXEL(pixel[0], pixel[1], pixel[2], pixel[3]);
-            }
+        if (BufferPool::get().getMaxSize() == 0) {
+            m_pData = result.data.release(); // take ownership of the data
+            return true;
         }
 
+        // images are usually released right after the texture upload, so the next image of the same size can reuse the buffer
+        size_t size = static_cast<size_t>(result.width) * result.height * (result.hasAlpha ? 4 : 3);
+        m_pData = result.data.get();
+        ImagePlusImage::share(this, std::shared_ptr<uint8_t>(result.data.release(), [size](uint8_t* data) {
+            BufferPool::get().release(std::unique_ptr<uint8_t[]>(data), size);
+        }));
+
         return true;
     }
 
-    bool initFromDecodeResult(DecodedResult&& result) {
+    bool initFromDecodeResult(DecodedResult&& result, CacheTargets const& cache) {
         if (std::holds_alternative<DecodedImage>(result)) {
-            return initFromDecodeResult(std::move(std::get<DecodedImage>(result)));
+            return initFromDecodeResult(std::move(std::get<DecodedImage>(result)), cache);
         }
 
         auto& anim = std::get<DecodedAnimation>(result);
@@ -73,29 +100,136 @@ class $modify(ImagePlusImageHook, CCImage) {
             return false;
         }
 
-        m_nWidth = anim.width;
-        m_nHeight = anim.height;
-        m_pData = anim.frames[0].data.get();
+        return this->initFromAnimationSource(AnimationSource::fromDecoded(std::move(anim)), cache);
+    }
+
+    bool initFromCacheEntry(DecodeCache::EntryPtr entry) {
+        if (entry->animation) {
+            return this->useAnimationSource(entry->animation);
+        }
+
+        auto& image = entry->image;
+        if (!image) return false;
+
+        m_nWidth = image.width;
+        m_nHeight = image.height;
+        m_bHasAlpha = image.hasAlpha;
+        m_nBitsPerComponent = image.bit_depth;
+        m_bPreMulti = image.hasAlpha;
+        m_pData = const_cast<uint8_t*>(image.data.get()); // shared with every image decoded from the same data
+
+        ImagePlusImage::share(this, std::move(entry));
+
+        return true;
+    }
+
+    bool initFromDiskEntry(std::shared_ptr<DiskCache::Entry> entry) {
+        m_nWidth = entry->width;
+        m_nHeight = entry->height;
+        m_bHasAlpha = entry->hasAlpha;
+        m_nBitsPerComponent = entry->bitDepth;
+        m_bPreMulti = entry->hasAlpha;
+        m_pData = entry->pixels; // already premultiplied, mapped straight from the cache file
+
+        ImagePlusImage::share(this, std::move(entry));
+
+        return true;
+    }
+
+    static size_t animationMemoryBudget() {
+        static size_t budget = (
+            listenForSettingChanges<int64_t>("animation-memory-budget", [](int64_t val) { budget = val << 20; }),
+            getMod()->getSettingValue<int64_t>("animation-memory-budget") << 20
+        );
+
+        return budget;
+    }
+
+    /// @brief Sets up a freshly created source. Cached sources skip this, since other sprites may be playing them already
+    bool initFromAnimationSource(std::shared_ptr<AnimationSource> source, CacheTargets const& cache) {
+        // has to happen before the source is shared, the budget decides how many frames it keeps
+        source->setMemoryBudget(animationMemoryBudget());
+
+        // decoded up front, so a broken file doesn't end up in the cache
+        if (!source->getFirstFrame()) return false;
+
+        // sprites sharing a source each have their own playhead, so if it can't keep every frame,
+        // they'd keep rewinding and decoding it again on almost every frame
+        if (cache.memory && source->isFullyResident()) {
+            DecodeCache::get().insert(*cache.memory, source);
+        }
+
+        return this->useAnimationSource(std::move(source));
+    }
+
+    bool useAnimationSource(std::shared_ptr<AnimationSource> source) {
+        // first frame stays alive for as long as the source does
+        auto first = source->getFirstFrame();
+        if (!first) return false;
+
+        m_nWidth = source->getWidth();
+        m_nHeight = source->getHeight();
+        m_pData = first;
         m_nBitsPerComponent = 8; // assuming 8 bits per channel for animations
-        m_bHasAlpha = anim.hasAlpha;
+        m_bHasAlpha = source->hasAlpha();
         m_bPreMulti = false;
 
-        ImagePlusImage::hook(this) = std::make_shared<DecodedAnimation>(std::move(anim));
+        ImagePlusImage::hook(this) = std::move(source);
 
         return true;
     }
 
+    /// @brief Finishes the decode scope with the pixels the image ended up with (the first frame for animations)
+    bool recordDecode(std::optional<Metrics::Scope>& scope, bool success) {
+        if (success && scope) {
+            uint64_t pixels = static_cast<uint64_t>(m_nWidth) * m_nHeight;
+            scope->succeed(pixels * (m_bHasAlpha ? 4 : 3), pixels);
+        }
+        return success;
+    }
+
+    // falls through to the static decoder if the image is not animated
+    #define TRY_FROM_ANIMATION_SOURCE(sourceFunc) { \
+            auto result = sourceFunc(data, size); \
+            if (result.isErr()) { log::warn("{}", result.unwrapErr()); break; } \
+            if (auto source = std::move(result).unwrap()) { \
+                return this->recordDecode(scope, this->initFromAnimationSource(std::move(source), cache)); \
+            } \
+        }
+
     #define TRY_FROM_DECODE_RESULT(decodeFunc) { \
             auto result = decodeFunc(data, size); \
             if (result.isOk()) { \
-                return this->initFromDecodeResult(std::move(result).unwrap()); \
+                return this->recordDecode(scope, this->initFromDecodeResult(std::move(result).unwrap(), cache)); \
             } else { log::warn("{}", result.unwrapErr()); } \
             break; \
         }
 
+    bool initWithFileData(std::string const& fullPath, void* data, int size, EImageFormat fmt) {
+        // lets the disk cache know which file the data came from
+        if (DiskCache::get().isEnabled()) {
+            s_loadingFile = DiskCache::describe(fullPath);
+        }
+
+        bool result = CCImage::initWithImageData(data, size, fmt, 0, 0, 8, 0);
+        s_loadingFile.reset();
+        return result;
+    }
+
     bool initWithImageFile(char const* path, EImageFormat fmt) {
         auto fullPath = CCFileUtils::get()->fullPathForFilename(path, false);
 
+        // mapping saves a heap allocation and a copy of the whole file, and decoders that
+        // only need the header (or reject the format) never touch the rest of it.
+        // copy-on-write, since initWithImageData takes a mutable pointer
+        if (auto mapped = MappedFile::open(fullPath, MappedFile::Mode::CopyOnWrite)) {
+            auto file = std::move(mapped).unwrap();
+            if (file->size() <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+                return this->initWithFileData(fullPath, file->data(), static_cast<int>(file->size()), fmt);
+            }
+        }
+
+        // files packed into the APK (or anything else that can't be mapped) are read the usual way
 #ifdef GEODE_IS_ANDROID
         unsigned long size = 0;
         std::unique_ptr<uint8_t[]> data(
@@ -106,7 +240,7 @@ class $modify(ImagePlusImageHook, CCImage) {
             return false;
         }
 
-        return CCImage::initWithImageData(data.get(), size, fmt, 0, 0, 8, 0);
+        return this->initWithFileData(fullPath, data.get(), size, fmt);
 #else
         auto res = file::readBinary(fullPath);
         if (!res) {
@@ -114,7 +248,7 @@ class $modify(ImagePlusImageHook, CCImage) {
         }
 
         auto& vec = res.unwrap();
-        return CCImage::initWithImageData(vec.data(), static_cast<int>(vec.size()), fmt, 0, 0, 8, 0);
+        return this->initWithFileData(fullPath, vec.data(), static_cast<int>(vec.size()), fmt);
 #endif
     }
 
@@ -127,6 +261,22 @@ class $modify(ImagePlusImageHook, CCImage) {
         return disablePng;
     }
 
+    /// @brief Whether the format is handled by one of our decoders (and not passed on to cocos)
+    static bool isCacheable(ImageFormat format) {
+        switch (format) {
+            case ImageFormat::Png:
+            case ImageFormat::CgBI:
+                return !disablePngHandler();
+            case ImageFormat::Qoi:
+            case ImageFormat::Webp:
+            case ImageFormat::JpegXL:
+            case ImageFormat::Gif:
+                return true;
+            default:
+                return false;
+        }
+    }
+
     bool initWithImageData(void* data, int size, EImageFormat fmt, int width, int height, int bpc, int whoKnows) {
         static bool alwaysGuess = (
             listenForSettingChanges<bool>("force-autodetect", [](bool val) { alwaysGuess = val; }),
@@ -144,15 +294,50 @@ class $modify(ImagePlusImageHook, CCImage) {
             fmt = +format;
         }
 
+        CacheTargets cache;
+        auto loadingFile = std::exchange(s_loadingFile, std::nullopt);
+        bool useMemory = DecodeCache::get().isEnabled();
+        bool useDisk = loadingFile && DiskCache::get().isEnabled();
+        if ((useMemory || useDisk) && isCacheable(format)) {
+            auto key = DecodeCache::makeKey(data, size, DecodeCache::Kind::Texture);
+            if (useMemory) {
+                if (auto entry = DecodeCache::get().find(key)) {
+                    return this->initFromCacheEntry(std::move(entry));
+                }
+                cache.memory = key;
+            }
+
+            if (useDisk) {
+                loadingFile->hash = key.hash;
+                if (auto entry = DiskCache::get().find(*loadingFile)) {
+                    return this->initFromDiskEntry(std::move(entry));
+                }
+                cache.disk = std::move(loadingFile);
+            }
+        }
+
+        // formats that go straight to cocos aren't counted
+        std::optional<Metrics::Scope> scope;
+        if (isCacheable(format)) scope.emplace(format, Metrics::Op::Decode, size);
+
         switch (format) {
             case ImageFormat::Png: {
                 if (disablePngHandler()) break;
-                TRY_FROM_DECODE_RESULT(decode::png);
+                TRY_FROM_DECODE_RESULT(decode::pngPremultiplied);
             }
             case ImageFormat::Qoi: TRY_FROM_DECODE_RESULT(decode::qoi);
-            case ImageFormat::Webp: TRY_FROM_DECODE_RESULT(decode::webp);
-            case ImageFormat::JpegXL: TRY_FROM_DECODE_RESULT(decode::jpegxl);
-            case ImageFormat::Gif: TRY_FROM_DECODE_RESULT(decode::gif);
+            case ImageFormat::Webp: {
+                TRY_FROM_ANIMATION_SOURCE(decode::webpSource);
+                TRY_FROM_DECODE_RESULT(decode::webp);
+            }
+            case ImageFormat::JpegXL: {
+                TRY_FROM_ANIMATION_SOURCE(decode::jpegxlSource);
+                TRY_FROM_DECODE_RESULT(decode::jpegxl);
+            }
+            case ImageFormat::Gif: {
+                TRY_FROM_ANIMATION_SOURCE(decode::gifSource);
+                TRY_FROM_DECODE_RESULT(decode::gif);
+            }
             case ImageFormat::CgBI: {
                 if (disablePngHandler()) break;
                 GEODE_IOS(TRY_FROM_DECODE_RESULT(decode::cgbi);)
@@ -167,6 +352,8 @@ class $modify(ImagePlusImageHook, CCImage) {
             default: break;
         }
 
+        // our decoder failed (or there was none), recorded before the fallback so it doesn't count towards the latency
+        scope.reset();
         return CCImage::initWithImageData(data, size, fmt, width, height, bpc, whoKnows);
     }
 };
@@ -18,7 +18,9 @@ void ImagePlusSprite::setCurrentFrame(uint32_t frame) {
     if (fields->animation && frame < fields->animation->getFrameCount()) {
         fields->frameIndex = frame;
         fields->frameTime = 0.0f; // reset frame time
-        this->setTexture(fields->animation->getFrame(frame));
+        if (auto next = fields->animation->getFrame(frame, *fields->stream)) {
+            this->applyFrame(next);
+        }
     }
 }
 
@@ -68,7 +70,7 @@ int ImagePlusSprite::getActualLoopCount(Fields* fields, imgp::Animation const* a
     return loopCount;
 }
 
-CCTexture2D* ImagePlusSprite::advanceFrame(Fields* fields, imgp::Animation const* anim) {
+imgp::Animation::Frame ImagePlusSprite::advanceFrame(Fields* fields, imgp::Animation* anim) {
     int64_t idx = fields->frameIndex;
     auto loopCount = getActualLoopCount(fields, anim);
 
@@ -82,16 +84,16 @@ CCTexture2D* ImagePlusSprite::advanceFrame(Fields* fields, imgp::Animation const
 
             // if loop count is 0, we loop indefinitely
             if (loopCount > 0 && fields->loopCount >= loopCount) {
-                return nullptr;
+                return {};
             }
         }
     }
 
     fields->frameIndex = idx;
-    return anim->getFrame(idx);
+    return anim->getFrame(idx, *fields->stream);
 }
 
-CCTexture2D* ImagePlusSprite::backwardFrame(Fields* fields, imgp::Animation const* anim) {
+imgp::Animation::Frame ImagePlusSprite::backwardFrame(Fields* fields, imgp::Animation* anim) {
     int64_t idx = fields->frameIndex;
     auto loopCount = getActualLoopCount(fields, anim);
 
@@ -102,7 +104,7 @@ CCTexture2D* ImagePlusSprite::backwardFrame(Fields* fields, imgp::Animation cons
             fields->loopCount++;
 
             if (loopCount > 0 && fields->loopCount >= loopCount) {
-                return nullptr; // stop the animation
+                return {}; // stop the animation
             }
         }
 
@@ -110,7 +112,7 @@ CCTexture2D* ImagePlusSprite::backwardFrame(Fields* fields, imgp::Animation cons
     }
 
     fields->frameIndex = idx;
-    return anim->getFrame(idx);
+    return anim->getFrame(idx, *fields->stream);
 }
 
 void ImagePlusSprite::animationUpdate(float dt) {
@@ -137,7 +139,7 @@ void ImagePlusSprite::animationUpdate(float dt) {
         fields->frameIndex = 0;
     }
 
-    CCTexture2D* frame = nullptr;
+    imgp::Animation::Frame frame;
     if (fields->playbackSpeed >= 0) {
         frame = this->advanceFrame(fields, anim.get());
     } else {
@@ -148,7 +150,21 @@ void ImagePlusSprite::animationUpdate(float dt) {
         return;
     }
 
-    this->setTexture(frame);
+    this->applyFrame(frame);
+}
+
+void ImagePlusSprite::applyFrame(imgp::Animation::Frame const& frame) {
+    bool textureChanged = frame.texture != m_pobTexture;
+    this->setTexture(frame.texture);
+
+    // atlas frames share a texture, so usually only the texture rect changes.
+    // setTexture doesn't update the texture coordinates though, so they have to be redone for a new page
+    if (frame.rect) {
+        auto rect = CC_RECT_PIXELS_TO_POINTS(*frame.rect);
+        if (textureChanged || !rect.equals(m_obRect)) {
+            this->setTextureRect(rect, false, rect.size);
+        }
+    }
 }
 
 bool ImagePlusSprite::initWithTexture(CCTexture2D* texture, CCRect const& rect, bool rotated) {
@@ -160,7 +176,13 @@ bool ImagePlusSprite::initWithTexture(CCTexture2D* texture, CCRect const& rect,
         auto fields = m_fields.self();
         fields->firstFrame = texture;
         fields->animation = *anim;
+        fields->stream = std::make_shared<imgp::Animation::Stream>();
         this->schedule(schedule_selector(ImagePlusSprite::animationUpdate));
+
+        // atlas animations draw every frame from the shared pages, the first one included
+        if (auto first = fields->animation->getFrame(0, *fields->stream); first.rect) {
+            this->applyFrame(first);
+        }
     }
 
     return true;
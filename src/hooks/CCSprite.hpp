@@ -6,6 +6,7 @@ struct ImagePlusSprite : geode::Modify<ImagePlusSprite, cocos2d::CCSprite>{
     struct Fields {
         std::shared_ptr<imgp::Animation> animation = nullptr;
         geode::Ref<cocos2d::CCTexture2D> firstFrame = nullptr;
+        std::shared_ptr<imgp::Animation::Stream> stream = nullptr; // this sprite's textures in streaming mode
 
         double frameTime = 0.0f; // time spent on the current frame
         float playbackSpeed = 1.0f; // speed of playback, 1.0 is normal speed (negative values are reversed)
@@ -39,8 +40,9 @@ struct ImagePlusSprite : geode::Modify<ImagePlusSprite, cocos2d::CCSprite>{
     void stopAndClearAnimation(Fields* fields);
     int getActualLoopCount(Fields* fields, imgp::Animation const* anim);
 
-    cocos2d::CCTexture2D* advanceFrame(Fields* fields, imgp::Animation const* anim);
-    cocos2d::CCTexture2D* backwardFrame(Fields* fields, imgp::Animation const* anim);
+    imgp::Animation::Frame advanceFrame(Fields* fields, imgp::Animation* anim);
+    imgp::Animation::Frame backwardFrame(Fields* fields, imgp::Animation* anim);
+    void applyFrame(imgp::Animation::Frame const& frame);
 
     void animationUpdate(float dt);
 
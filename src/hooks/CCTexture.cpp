@@ -24,9 +24,24 @@ public:
 };
 
 class $modify(ImagePlusTextureHook, CCTexture2D) {
+    static imgp::Animation::TextureMode parseTextureMode(std::string_view mode) {
+        if (mode == "Streaming") return imgp::Animation::TextureMode::Streaming;
+        if (mode == "Atlas") return imgp::Animation::TextureMode::Atlas;
+        return imgp::Animation::TextureMode::PerFrame;
+    }
+
+    static imgp::Animation::TextureMode animationTextureMode() {
+        static imgp::Animation::TextureMode mode = (
+            listenForSettingChanges<std::string>("animation-texture-mode", [](std::string val) { mode = parseTextureMode(val); }),
+            parseTextureMode(getMod()->getSettingValue<std::string>("animation-texture-mode"))
+        );
+
+        return mode;
+    }
+
     bool initWithImage(CCImage* image) {
         if (auto anim = imgp::StateManager::get().findImageStorage(image)) {
-            ImagePlusTexture::hook(this) = std::make_shared<imgp::Animation>(*anim, this);
+            ImagePlusTexture::hook(this) = std::make_shared<imgp::Animation>(*anim, this, animationTextureMode());
         }
         return CCTexture2D::initWithImage(image);
     }
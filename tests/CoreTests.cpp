@@ -0,0 +1,517 @@
+// Tests for imageplus_core, the codecs built without Geode: round-trips, header probes, the *Into decoders,
+// animation compositing, animation sources under concurrent use, output sinks and codec stats.
+// Built with -DIMAGEPLUS_HEADLESS=ON and run by ctest, add -DIMAGEPLUS_SANITIZE=address,undefined (or thread)
+// to run them under the sanitizers.
+// Usage: ImagePlusCoreTests [filter]
+
+#include <api.hpp>
+#include "../src/AnimationSource.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace imgp;
+
+// == Test runner == //
+
+static int s_failures = 0;
+
+/// @brief Fails the current test (returns from it) if the condition doesn't hold
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);      \
+            ++s_failures;                                                                   \
+            return;                                                                         \
+        }                                                                                   \
+    } while (0)
+
+/// @brief Like CHECK, but also prints the error of a failed Result
+#define CHECK_OK(result)                                                                    \
+    do {                                                                                    \
+        if ((result).isErr()) {                                                             \
+            std::printf("  %s:%d: %s failed: %s\n", __FILE__, __LINE__, #result,             \
+                std::string((result).unwrapErr()).c_str());                                 \
+            ++s_failures;                                                                   \
+            return;                                                                         \
+        }                                                                                   \
+    } while (0)
+
+// == Test images == //
+
+struct Pixels {
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::vector<std::vector<uint8_t>> frames; // RGBA
+};
+
+/// @brief Gradient with noise and a box that moves between frames, so animations have partial updates.
+/// Alpha is never 0, lossless WebP would be free to change the color of fully transparent pixels
+static Pixels makePixels(uint16_t width, uint16_t height, size_t frameCount, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Pixels pixels{width, height, {}};
+    std::vector<uint8_t> background(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < background.size(); i += 4) {
+        size_t x = i / 4 % width, y = i / 4 / width;
+        background[i + 0] = static_cast<uint8_t>(x * 255 / width);
+        background[i + 1] = static_cast<uint8_t>(y * 255 / height);
+        background[i + 2] = static_cast<uint8_t>(rng());
+        background[i + 3] = static_cast<uint8_t>(1 + rng() % 255);
+    }
+
+    for (size_t f = 0; f < frameCount; ++f) {
+        auto frame = background;
+        uint16_t boxX = static_cast<uint16_t>(f * width / frameCount / 2), boxY = height / 4;
+        for (uint16_t y = boxY; y < boxY + height / 3; ++y) {
+            for (uint16_t x = boxX; x < boxX + width / 3; ++x) {
+                uint8_t* px = &frame[(static_cast<size_t>(y) * width + x) * 4];
+                px[0] = 255; px[1] = static_cast<uint8_t>(f * 40); px[2] = 0; px[3] = 255;
+            }
+        }
+        pixels.frames.push_back(std::move(frame));
+    }
+    return pixels;
+}
+
+static DecodedAnimation toAnimation(Pixels const& pixels) {
+    DecodedAnimation anim;
+    anim.width = pixels.width;
+    anim.height = pixels.height;
+    anim.hasAlpha = true;
+    for (auto const& frame : pixels.frames) {
+        auto data = std::make_unique<uint8_t[]>(frame.size());
+        std::memcpy(data.get(), frame.data(), frame.size());
+        anim.frames.push_back({std::move(data), 50});
+    }
+    return anim;
+}
+
+static bool samePixels(void const* data, std::vector<uint8_t> const& expected) {
+    return data && std::memcmp(data, expected.data(), expected.size()) == 0;
+}
+
+struct GifFrame {
+    uint16_t x, y, width, height;
+    uint8_t dispose;
+    std::vector<uint8_t> indices;
+};
+
+static constexpr uint8_t GIF_PALETTE[4][3] = {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+
+/// @brief GIF with a 4 color palette (ImagePlus can't encode GIFs). Codes are 3 bits wide, with a clear code
+/// after every two pixels so the LZW table never grows
+static std::vector<uint8_t> writeGif(uint16_t width, uint16_t height, std::vector<GifFrame> const& frames) {
+    std::vector<uint8_t> out;
+    auto u8 = [&](uint8_t v) { out.push_back(v); };
+    auto u16 = [&](uint16_t v) { u8(v & 0xFF); u8(v >> 8); };
+
+    out.insert(out.end(), {'G', 'I', 'F', '8', '9', 'a'});
+    u16(width); u16(height);
+    u8(0xF1); u8(0); u8(0); // global color table with 4 entries
+    for (auto const& color : GIF_PALETTE) { u8(color[0]); u8(color[1]); u8(color[2]); }
+
+    u8(0x21); u8(0xFF); u8(11);
+    out.insert(out.end(), {'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0'});
+    u8(3); u8(1); u16(0); u8(0);
+
+    for (auto const& frame : frames) {
+        u8(0x21); u8(0xF9); u8(4);
+        u8(static_cast<uint8_t>(frame.dispose << 2));
+        u16(5); u8(0); u8(0);
+
+        u8(0x2C);
+        u16(frame.x); u16(frame.y); u16(frame.width); u16(frame.height);
+        u8(0);
+
+        std::vector<uint8_t> codes;
+        uint32_t bits = 0, bitCount = 0;
+        auto put = [&](uint32_t code) {
+            bits |= code << bitCount;
+            bitCount += 3;
+            while (bitCount >= 8) {
+                codes.push_back(bits & 0xFF);
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        };
+        for (size_t i = 0; i < frame.indices.size(); ++i) {
+            if (i % 2 == 0) put(4);
+            put(frame.indices[i]);
+        }
+        put(5);
+        if (bitCount) codes.push_back(bits & 0xFF);
+
+        u8(2);
+        for (size_t i = 0; i < codes.size(); i += 255) {
+            size_t block = std::min<size_t>(255, codes.size() - i);
+            u8(static_cast<uint8_t>(block));
+            out.insert(out.end(), codes.begin() + i, codes.begin() + i + block);
+        }
+        u8(0);
+    }
+
+    u8(0x3B);
+    return out;
+}
+
+// == Tests == //
+
+struct StaticCodec {
+    char const* name;
+    ImageFormat format;
+    std::function<geode::Result<geode::ByteVector>(Pixels const&)> encode;
+    std::function<geode::Result<size_t>(void const*, size_t, void*, size_t)> decodeInto;
+};
+
+static std::vector<StaticCodec> const& staticCodecs() {
+    static std::vector<StaticCodec> const codecs = {
+        {"png", ImageFormat::Png,
+            [](Pixels const& p) { return encode::png(p.frames[0].data(), p.width, p.height, true); },
+            decode::pngInto},
+        {"qoi", ImageFormat::Qoi,
+            [](Pixels const& p) { return encode::qoi(p.frames[0].data(), p.width, p.height, true); },
+            decode::qoiInto},
+        {"webp", ImageFormat::Webp,
+            [](Pixels const& p) { return encode::webp(p.frames[0].data(), p.width, p.height, true, 100.f); },
+            [](void const* data, size_t size, void* buf, size_t bufSize) { return decode::webpInto(data, size, buf, bufSize); }},
+        {"jxl", ImageFormat::JpegXL,
+            [](Pixels const& p) { return encode::jpegxl(p.frames[0].data(), p.width, p.height, true, 100.f); },
+            [](void const* data, size_t size, void* buf, size_t bufSize) { return decode::jpegxlInto(data, size, buf, bufSize); }},
+    };
+    return codecs;
+}
+
+static void testRoundTrip() {
+    // odd sizes, so rows don't line up with any SIMD width
+    for (auto [width, height] : {std::pair<uint16_t, uint16_t>{2, 2}, {67, 45}, {300, 7}}) {
+        auto pixels = makePixels(width, height, 1, width * height);
+        for (auto const& codec : staticCodecs()) {
+            std::printf("  %s %ux%u\n", codec.name, width, height);
+            auto encoded = codec.encode(pixels);
+            CHECK_OK(encoded);
+            auto bytes = std::move(encoded).unwrap();
+            CHECK(guessFormat(bytes.data(), bytes.size()) == codec.format);
+
+            auto decoded = tryDecode(bytes.data(), bytes.size());
+            CHECK_OK(decoded);
+            auto image = std::get_if<DecodedImage>(&decoded.unwrap());
+            CHECK(image && image->width == width && image->height == height && image->hasAlpha);
+            CHECK(samePixels(image->data.get(), pixels.frames[0]));
+        }
+    }
+}
+
+static void testHeaderProbes() {
+    auto pixels = makePixels(67, 45, 1, 1);
+    for (auto const& codec : staticCodecs()) {
+        std::printf("  %s\n", codec.name);
+        auto encoded = codec.encode(pixels);
+        CHECK_OK(encoded);
+        auto bytes = std::move(encoded).unwrap();
+
+        auto info = getImageInfo(bytes.data(), bytes.size());
+        CHECK_OK(info);
+        CHECK(info.unwrap().format == codec.format);
+        CHECK(info.unwrap().width == 67 && info.unwrap().height == 45);
+        CHECK(info.unwrap().hasAlpha && !info.unwrap().isAnimated());
+
+        // a truncated header is an error, not a crash
+        CHECK(getImageInfo(bytes.data(), 8, codec.format).isErr());
+    }
+
+    auto anim = toAnimation(makePixels(32, 24, 3, 2));
+    auto webp = encode::webp(anim, 100.f);
+    CHECK_OK(webp);
+    auto header = decode::webpHeader(webp.unwrap().data(), webp.unwrap().size());
+    CHECK_OK(header);
+    auto headerAnim = std::get_if<DecodedAnimation>(&header.unwrap());
+    CHECK(headerAnim && headerAnim->width == 32 && headerAnim->height == 24 && headerAnim->frames.empty());
+
+    auto info = getImageInfo(webp.unwrap().data(), webp.unwrap().size());
+    CHECK_OK(info);
+    CHECK(info.unwrap().frameCount == 3 && info.unwrap().totalDuration == 150);
+
+    constexpr uint8_t garbage[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    CHECK(guessFormat(garbage, sizeof(garbage)) == ImageFormat::Unknown);
+    CHECK(getImageInfo(garbage, sizeof(garbage)).isErr());
+}
+
+static void testDecodeInto() {
+    auto pixels = makePixels(67, 45, 1, 3);
+    size_t imageSize = pixels.frames[0].size();
+    for (auto const& codec : staticCodecs()) {
+        std::printf("  %s\n", codec.name);
+        auto encoded = codec.encode(pixels);
+        CHECK_OK(encoded);
+        auto bytes = std::move(encoded).unwrap();
+
+        std::vector<uint8_t> buffer(imageSize);
+        auto written = codec.decodeInto(bytes.data(), bytes.size(), buffer.data(), buffer.size());
+        CHECK_OK(written);
+        CHECK(written.unwrap() == imageSize);
+        CHECK(samePixels(buffer.data(), pixels.frames[0]));
+
+        CHECK(codec.decodeInto(bytes.data(), bytes.size(), buffer.data(), buffer.size() - 1).isErr());
+    }
+
+    // tryDecodeWith goes through the same decoders
+    auto png = encode::png(pixels.frames[0].data(), pixels.width, pixels.height, true);
+    CHECK_OK(png);
+    size_t allocated = 0;
+    PixelAllocator allocator {
+        [](size_t size, void* userdata) -> void* { *static_cast<size_t*>(userdata) += size; return new uint8_t[size]; },
+        [](void* data, size_t size, void* userdata) { *static_cast<size_t*>(userdata) -= size; delete[] static_cast<uint8_t*>(data); },
+        &allocated,
+    };
+    auto image = tryDecodeWith(png.unwrap().data(), png.unwrap().size(), allocator);
+    CHECK_OK(image);
+    CHECK(allocated == imageSize && samePixels(image.unwrap().data, pixels.frames[0]));
+    allocator.deallocate(image.unwrap().data, image.unwrap().size, allocator.userdata);
+    CHECK(allocated == 0);
+}
+
+/// @brief Decodes the animation both at once and frame by frame, both have to match the source frames
+static void checkAnimation(char const* name, ImageFormat format, geode::ByteVector const& bytes, Pixels const& pixels) {
+    std::printf("  %s\n", name);
+    auto decoded = tryDecode(bytes.data(), bytes.size(), format);
+    CHECK_OK(decoded);
+    auto anim = std::get_if<DecodedAnimation>(&decoded.unwrap());
+    CHECK(anim && anim->frames.size() == pixels.frames.size());
+    CHECK(anim->width == pixels.width && anim->height == pixels.height && anim->hasAlpha);
+
+    std::vector<uint8_t> buffer(pixels.frames[0].size());
+    // backwards, so every frame is composited from scratch instead of following the previous one
+    for (size_t i = pixels.frames.size(); i-- > 0;) {
+        CHECK(samePixels(anim->frames[i].data.get(), pixels.frames[i]));
+
+        auto into = format == ImageFormat::Webp
+            ? decode::webpInto(bytes.data(), bytes.size(), buffer.data(), buffer.size(), i)
+            : decode::jpegxlInto(bytes.data(), bytes.size(), buffer.data(), buffer.size(), i);
+        CHECK_OK(into);
+        CHECK(samePixels(buffer.data(), pixels.frames[i]));
+    }
+}
+
+static void testAnimations() {
+    auto pixels = makePixels(48, 40, 5, 4);
+    auto anim = toAnimation(pixels);
+
+    EncodeOptions options;
+    options.lossless = true;
+    options.webp.parallelFrames = 0;
+    auto webp = encode::webp(anim, options);
+    CHECK_OK(webp);
+    checkAnimation("webp (WebPAnimEncoder)", ImageFormat::Webp, webp.unwrap(), pixels);
+
+    options.webp.parallelFrames = 1;
+    auto webpParallel = encode::webp(anim, options);
+    CHECK_OK(webpParallel);
+    checkAnimation("webp (parallel frames)", ImageFormat::Webp, webpParallel.unwrap(), pixels);
+
+    auto jxl = encode::jpegxl(anim, options);
+    CHECK_OK(jxl);
+    checkAnimation("jxl", ImageFormat::JpegXL, jxl.unwrap(), pixels);
+
+    CHECK(decode::webpInto(webp.unwrap().data(), webp.unwrap().size(), nullptr, 0, pixels.frames.size()).isErr());
+}
+
+static void testGifCompositing() {
+    // 4x4 red canvas, a 2x2 green patch that stays, then two blue pixels that get disposed
+    std::vector<GifFrame> frames = {
+        {0, 0, 4, 4, 1, std::vector<uint8_t>(16, 1)},
+        {1, 1, 2, 2, 1, std::vector<uint8_t>(4, 2)},
+        {0, 0, 2, 1, 2, {3, 3}},
+        {3, 3, 1, 1, 1, {2}},
+    };
+    auto gif = writeGif(4, 4, frames);
+
+    std::vector<std::vector<uint8_t>> expected;
+    std::vector<uint8_t> canvas(4 * 4 * 4);
+    for (auto const& frame : frames) {
+        auto previous = canvas;
+        for (uint16_t y = 0; y < frame.height; ++y) {
+            for (uint16_t x = 0; x < frame.width; ++x) {
+                uint8_t* px = &canvas[((frame.y + y) * 4 + frame.x + x) * 4];
+                auto color = GIF_PALETTE[frame.indices[y * frame.width + x]];
+                px[0] = color[0]; px[1] = color[1]; px[2] = color[2]; px[3] = 255;
+            }
+        }
+        expected.push_back(canvas);
+        // stb_image restores the frame rect to what was there before the frame ("background" is the previous canvas)
+        if (frame.dispose == 2) canvas = std::move(previous);
+    }
+
+    auto info = getImageInfo(gif.data(), gif.size());
+    CHECK_OK(info);
+    CHECK(info.unwrap().format == ImageFormat::Gif && info.unwrap().frameCount == frames.size());
+    CHECK(info.unwrap().totalDuration == 50 * frames.size());
+
+    auto decoded = decode::gif(gif.data(), gif.size());
+    CHECK_OK(decoded);
+    auto anim = std::get_if<DecodedAnimation>(&decoded.unwrap());
+    CHECK(anim && anim->frames.size() == frames.size());
+
+    std::vector<uint8_t> buffer(canvas.size());
+    for (size_t i = frames.size(); i-- > 0;) {
+        CHECK(samePixels(anim->frames[i].data.get(), expected[i]));
+        auto into = decode::gifInto(gif.data(), gif.size(), buffer.data(), buffer.size(), i);
+        CHECK_OK(into);
+        CHECK(samePixels(buffer.data(), expected[i]));
+    }
+}
+
+static void testAnimationSourceThreads() {
+    // fewer cached frames than the animation has, so frames keep getting evicted and decoded again
+    // while other threads still hold them (and the prefetch worker decodes ahead)
+    auto pixels = makePixels(32, 24, 12, 7);
+    auto source = AnimationSource::fromDecoded(toAnimation(pixels));
+    source->setMemoryBudget(source->getFrameSize() * 3);
+    CHECK(source->getCapacity() == 3 && source->getFrameBudget() == 3 && !source->isFullyResident());
+    CHECK(samePixels(source->getFirstFrame(), pixels.frames[0]));
+
+    std::atomic_bool mismatch = false;
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int i = 0; i < 500; ++i) {
+                size_t index = rng() % pixels.frames.size();
+                source->prefetch(index);
+                if (!samePixels(source->getFrame(index).get(), pixels.frames[index])) mismatch = true;
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        for (size_t i = 0; i < 100; ++i) source->setMemoryBudget(source->getFrameSize() * (2 + i % 12));
+    });
+    for (auto& thread : threads) thread.join();
+    CHECK(!mismatch);
+
+    source->setMemoryBudget(source->getFrameSize() * pixels.frames.size());
+    CHECK(source->isFullyResident());
+}
+
+static void testSinks() {
+    auto pixels = makePixels(67, 45, 1, 5);
+    auto const& image = pixels.frames[0];
+
+    std::printf("  buffer\n");
+    std::vector<uint8_t> buffer(16);
+    auto needed = encode::pngTo(image.data(), pixels.width, pixels.height, true, {}, OutputSink::buffer(buffer.data(), buffer.size()));
+    CHECK_OK(needed);
+    CHECK(needed.unwrap() > buffer.size());
+    buffer.resize(needed.unwrap());
+    auto written = encode::pngTo(image.data(), pixels.width, pixels.height, true, {}, OutputSink::buffer(buffer.data(), buffer.size()));
+    CHECK_OK(written);
+    CHECK(written.unwrap() == buffer.size());
+    auto png = decode::png(buffer.data(), buffer.size());
+    CHECK_OK(png);
+    CHECK(samePixels(png.unwrap().data.get(), image));
+
+    // chunked output has to add up to the same file as the in-memory encoders
+    EncodeOptions lossless;
+    lossless.lossless = true;
+    using EncodeTo = std::function<geode::Result<size_t>(OutputSink const&)>;
+    std::pair<char const*, EncodeTo> encoders[] = {
+        {"qoi", [&](OutputSink const& sink) { return encode::qoiTo(image.data(), pixels.width, pixels.height, true, sink); }},
+        {"webp", [&](OutputSink const& sink) { return encode::webpTo(image.data(), pixels.width, pixels.height, true, lossless, sink); }},
+        {"jxl", [&](OutputSink const& sink) { return encode::jpegxlTo(image.data(), pixels.width, pixels.height, true, lossless, sink); }},
+    };
+    for (auto const& [name, encodeTo] : encoders) {
+        std::printf("  %s\n", name);
+        std::vector<uint8_t> chunks;
+        auto size = encodeTo(OutputSink::callback([&](void const* data, size_t size) {
+            chunks.insert(chunks.end(), static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+            return true;
+        }));
+        CHECK_OK(size);
+        CHECK(size.unwrap() == chunks.size());
+
+        auto decoded = tryDecode(chunks.data(), chunks.size());
+        CHECK_OK(decoded);
+        auto decodedImage = std::get_if<DecodedImage>(&decoded.unwrap());
+        CHECK(decodedImage && samePixels(decodedImage->data.get(), image));
+
+        CHECK(encodeTo(OutputSink::callback([](void const*, size_t) { return false; })).isErr());
+    }
+}
+
+static void testBatch() {
+    std::vector<Pixels> sources;
+    std::vector<geode::ByteVector> encoded;
+    std::vector<EncodedImage> images;
+    for (uint32_t i = 0; i < 16; ++i) {
+        sources.push_back(makePixels(static_cast<uint16_t>(20 + i), 17, 1, i));
+        auto png = encode::png(sources.back().frames[0].data(), sources.back().width, 17, true);
+        CHECK_OK(png);
+        encoded.push_back(std::move(png).unwrap());
+    }
+    for (auto const& bytes : encoded) images.push_back({bytes.data(), bytes.size()});
+
+    auto results = tryDecodeBatch(images);
+    CHECK(results.size() == images.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        CHECK_OK(results[i]);
+        auto image = std::get_if<DecodedImage>(&results[i].unwrap());
+        CHECK(image && samePixels(image->data.get(), sources[i].frames[0]));
+    }
+}
+
+static void testStats() {
+    resetCodecStats();
+    auto pixels = makePixels(67, 45, 1, 6);
+    auto png = encode::png(pixels.frames[0].data(), pixels.width, pixels.height, true);
+    CHECK_OK(png);
+    auto bytes = std::move(png).unwrap();
+    CHECK(tryDecode(bytes.data(), bytes.size()).isOk());
+    CHECK(tryDecode(bytes.data(), 16, ImageFormat::Png).isErr());
+
+    auto stats = getCodecStats(ImageFormat::Png);
+    CHECK(stats.encode.calls == 1 && stats.encode.failures == 0);
+    CHECK(stats.encode.bytesIn == pixels.frames[0].size() && stats.encode.bytesOut == bytes.size());
+    CHECK(stats.encode.pixels == 67 * 45);
+    CHECK(stats.decode.calls == 2 && stats.decode.failures == 1);
+    CHECK(stats.decode.bytesIn == bytes.size() + 16 && stats.decode.bytesOut == pixels.frames[0].size());
+
+    uint64_t histogram = 0;
+    for (auto count : stats.decode.latency) histogram += count;
+    CHECK(histogram == 2 && stats.decode.latencyPercentile(1.0) > 0);
+    CHECK(getCodecStats(ImageFormat::Qoi).decode.calls == 0);
+
+    resetCodecStats();
+    CHECK(getCodecStats(ImageFormat::Png).encode.calls == 0);
+}
+
+int main(int argc, char** argv) {
+    std::string_view filter = argc > 1 ? argv[1] : "";
+    std::pair<char const*, void(*)()> tests[] = {
+        {"round-trip", testRoundTrip},
+        {"header probes", testHeaderProbes},
+        {"decode into", testDecodeInto},
+        {"animations", testAnimations},
+        {"gif compositing", testGifCompositing},
+        {"animation source threads", testAnimationSourceThreads},
+        {"sinks", testSinks},
+        {"batch", testBatch},
+        {"stats", testStats},
+    };
+
+    for (auto [name, test] : tests) {
+        if (!filter.empty() && std::string_view(name).find(filter) == std::string_view::npos) continue;
+        int failures = s_failures;
+        std::printf("[TEST] %s\n", name);
+        test();
+        std::printf("[TEST] %s %s\n", name, s_failures == failures ? "passed" : "FAILED");
+    }
+
+    if (s_failures) std::printf("%d check(s) failed\n", s_failures);
+    return s_failures ? 1 : 0;
+}